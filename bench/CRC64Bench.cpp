@@ -0,0 +1,167 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===------------------------- crc64 microbenchmark -----------------------===//
+//
+// This times the table driven crc64 in the MAGEEC library against the
+// original bitwise implementation, for both small buffers, such as
+// serialized feature sets, and large buffers. The outputs of the two are
+// first checked to be identical, and the benchmark fails if they differ.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mageec/Util.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mageec;
+
+/// \brief Calculate the crc64 of a buffer one bit at a time
+///
+/// This is the original implementation of util::crc64, and is the
+/// reference which the table driven implementation is checked against.
+static uint64_t referenceCRC64(const uint8_t *message, unsigned len) {
+  uint64_t crc = 0xFFFFFFFFFFFFFFFFULL;
+  for (unsigned i = 0; i < len; ++i) {
+    crc ^= message[i];
+    for (int j = 7; j >= 0; --j) {
+      uint64_t mask = -(crc & 1);
+      crc = (crc >> 1) ^ (0xC96C5795D7870F42ULL & mask);
+    }
+  }
+  return ~crc;
+}
+
+/// \brief Check that both implementations agree on a set of buffers
+///
+/// \return True if the outputs were identical for every buffer
+static bool checkCRC64(std::mt19937 &rng) {
+  bool ok = true;
+
+  // Standard check value for CRC-64/XZ
+  const std::string check = "123456789";
+  const uint64_t check_crc = 0x995DC9BBDF1939FAULL;
+  const uint8_t *check_data = reinterpret_cast<const uint8_t *>(check.data());
+  unsigned check_len = static_cast<unsigned>(check.size());
+
+  if (referenceCRC64(check_data, check_len) != check_crc) {
+    std::cerr << "reference crc64 of check string is incorrect\n";
+    ok = false;
+  }
+  if (util::crc64(check_data, check_len) != check_crc) {
+    std::cerr << "crc64 of check string is incorrect\n";
+    ok = false;
+  }
+
+  // Random buffers of every length up to a few table strides, at every
+  // alignment, plus some larger buffers. Also check that splitting a
+  // buffer and using crc64Update gives the same result.
+  std::uniform_int_distribution<unsigned> byte_dist(0, 255);
+  std::vector<uint8_t> buf(4096 + 8);
+  for (auto &b : buf) {
+    b = static_cast<uint8_t>(byte_dist(rng));
+  }
+
+  std::vector<unsigned> lens;
+  for (unsigned len = 0; len <= 64; ++len) {
+    lens.push_back(len);
+  }
+  lens.push_back(1000);
+  lens.push_back(4096);
+
+  for (unsigned len : lens) {
+    for (unsigned offset = 0; offset < 8; ++offset) {
+      const uint8_t *data = buf.data() + offset;
+      uint64_t expected = referenceCRC64(data, len);
+      if (util::crc64(data, len) != expected) {
+        std::cerr << "crc64 mismatch, length " << len << ", offset " << offset
+                  << "\n";
+        ok = false;
+      }
+      unsigned split = len / 3;
+      uint64_t crc = util::crc64Update(0, data, split);
+      crc = util::crc64Update(crc, data + split, len - split);
+      if (crc != expected) {
+        std::cerr << "crc64Update mismatch, length " << len << ", offset "
+                  << offset << "\n";
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+/// \brief Time repeated calculations of a crc64 over a buffer
+///
+/// \return The throughput in MiB/s
+template <typename F>
+static double timeCRC64(F f, const std::vector<uint8_t> &buf,
+                        unsigned iterations, uint64_t &sink) {
+  unsigned len = static_cast<unsigned>(buf.size());
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    sink += f(buf.data(), len);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double secs = std::chrono::duration<double>(end - start).count();
+  double mib = static_cast<double>(len) * iterations / (1024.0 * 1024.0);
+  return secs > 0 ? mib / secs : 0;
+}
+
+/// \brief Time both implementations over buffers of a given size
+static void benchCRC64(std::mt19937 &rng, unsigned len, unsigned iterations,
+                       uint64_t &sink) {
+  std::uniform_int_distribution<unsigned> byte_dist(0, 255);
+  std::vector<uint8_t> buf(len);
+  for (auto &b : buf) {
+    b = static_cast<uint8_t>(byte_dist(rng));
+  }
+
+  double ref = timeCRC64(referenceCRC64, buf, iterations, sink);
+  double sliced = timeCRC64(util::crc64, buf, iterations, sink);
+
+  std::cout << len << " bytes x " << iterations << ": bitwise " << ref
+            << " MiB/s, slicing-by-8 " << sliced << " MiB/s";
+  if (ref > 0) {
+    std::cout << " (" << sliced / ref << "x)";
+  }
+  std::cout << "\n";
+}
+
+int main(void) {
+  std::mt19937 rng(0x4d414745);
+
+  if (!checkCRC64(rng)) {
+    std::cerr << "crc64 implementations do not match\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "crc64 implementations match\n";
+
+  // The sink keeps the calculations from being optimized away
+  uint64_t sink = 0;
+  benchCRC64(rng, 40, 200000, sink);
+  benchCRC64(rng, 1024 * 1024, 20, sink);
+  std::cout << "(checksum " << std::hex << sink << ")\n";
+  return EXIT_SUCCESS;
+}
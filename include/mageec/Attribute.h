@@ -33,8 +33,10 @@
 #define MAGEEC_ATTRIBUTE_H
 
 #include "Types.h"
+#include "Util.h"
 
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <iostream>
 #include <string>
@@ -74,10 +76,48 @@ public:
   /// \return The value of the Attribute as a serialized blob of bytes
   virtual std::vector<uint8_t> toBlob() const = 0;
 
+  /// \brief Get the size of the serialized value of the attribute in bytes
+  virtual size_t getBlobSize() const = 0;
+
+  /// \brief Append the serialized value of the attribute to a buffer
+  virtual void appendBlob(std::vector<uint8_t> &buf) const = 0;
+
+  /// \brief Continue a crc64 over the serialized value of the attribute,
+  /// without serializing it.
+  ///
+  /// \param crc  The crc64 of the data preceding the value
+  ///
+  /// \return The crc64 of the preceding data followed by the value
+  virtual uint64_t updateCRC64(uint64_t crc) const = 0;
+
+  /// \brief Compare the serialized value of the attribute against the
+  /// serialized value of another, without serializing either.
+  ///
+  /// The sizes of the serialized values are compared first, then their
+  /// bytes in order.
+  ///
+  /// \return -1 if this < other, 0 if this == other, 1 if this > other
+  virtual int compareBlob(const AttributeBase &other) const = 0;
+
   /// \brief Print out an attribute to the provided stream
   virtual void print(std::ostream &os) const = 0;
 
 protected:
+  /// \brief Compare the serialized values of two attributes, by serializing
+  /// both. Used when the other attribute is of a different type.
+  static int compareSerialized(const AttributeBase &lhs,
+                               const AttributeBase &rhs) {
+    std::vector<uint8_t> lhs_blob = lhs.toBlob();
+    std::vector<uint8_t> rhs_blob = rhs.toBlob();
+    if (lhs_blob.size() != rhs_blob.size())
+      return lhs_blob.size() < rhs_blob.size() ? -1 : 1;
+    if (lhs_blob < rhs_blob)
+      return -1;
+    else if (lhs_blob > rhs_blob)
+      return 1;
+    return 0;
+  }
+
   /// \brief Create an Attribute with the specified type identifier,
   /// attribute identifier and name
   ///
@@ -136,17 +176,36 @@ public:
   ///
   /// \return The value of the Attribute as a serialized blob of bytes
   std::vector<uint8_t> toBlob(void) const override {
-    static_assert(std::is_integral<value_type>::value,
-                  "Only integral types handled for now");
-
     std::vector<uint8_t> blob;
     blob.reserve(sizeof(value_type));
+    appendBlob(blob);
+    return blob;
+  }
+
+  size_t getBlobSize(void) const override { return sizeof(value_type); }
+
+  void appendBlob(std::vector<uint8_t> &buf) const override {
+    static_assert(std::is_integral<value_type>::value,
+                  "Only integral types handled for now");
 
     const uint8_t *value = reinterpret_cast<const uint8_t *>(&m_value);
-    for (unsigned i = 0; i < sizeof(value_type); ++i) {
-      blob.push_back(value[i]);
+    buf.insert(buf.end(), value, value + sizeof(value_type));
+  }
+
+  uint64_t updateCRC64(uint64_t crc) const override {
+    return util::crc64Update(crc, reinterpret_cast<const uint8_t *>(&m_value),
+                             sizeof(value_type));
+  }
+
+  int compareBlob(const AttributeBase<TypeIDType> &other) const override {
+    // Attributes with the same type identifier hold the same type of value,
+    // so the serialized values are just the bytes of the values.
+    if (other.getType() != type) {
+      return AttributeBase<TypeIDType>::compareSerialized(*this, other);
     }
-    return blob;
+    const auto &rhs = static_cast<const Attribute &>(other);
+    int res = std::memcmp(&m_value, &rhs.m_value, sizeof(value_type));
+    return (res > 0) - (res < 0);
   }
 
   /// \brief Create an attribute of this type given the provided attribute
@@ -218,17 +277,67 @@ public:
 
   std::vector<uint8_t> toBlob(void) const override {
     std::vector<uint8_t> blob;
+    blob.reserve(getBlobSize());
+    appendBlob(blob);
+    return blob;
+  }
+
+  size_t getBlobSize(void) const override {
+    size_t size = m_value.size() ? m_value.size() - 1 : 0;
+    for (const auto &pass : m_value) {
+      size += pass.size();
+    }
+    return size;
+  }
 
+  void appendBlob(std::vector<uint8_t> &buf) const override {
     // Separate each pass in the sequence with a comma
     for (unsigned i = 0; i < m_value.size(); i++) {
       if (i != 0) {
-        blob.push_back(',');
+        buf.push_back(',');
       }
       for (auto c : m_value[i]) {
-        blob.push_back(static_cast<uint8_t>(c));
+        buf.push_back(static_cast<uint8_t>(c));
       }
     }
-    return blob;
+  }
+
+  uint64_t updateCRC64(uint64_t crc) const override {
+    static const uint8_t separator = ',';
+    for (unsigned i = 0; i < m_value.size(); i++) {
+      if (i != 0) {
+        crc = util::crc64Update(crc, &separator, 1);
+      }
+      crc = util::crc64Update(
+          crc, reinterpret_cast<const uint8_t *>(m_value[i].data()),
+          static_cast<unsigned>(m_value[i].size()));
+    }
+    return crc;
+  }
+
+  int compareBlob(const AttributeBase<ParameterType> &other) const override {
+    if (other.getType() != ParameterType::kPassSeq) {
+      return compareSerialized(*this, other);
+    }
+    const auto &rhs = static_cast<const Attribute &>(other);
+    size_t lhs_size = getBlobSize();
+    size_t rhs_size = rhs.getBlobSize();
+    if (lhs_size != rhs_size) {
+      return lhs_size < rhs_size ? -1 : 1;
+    }
+
+    // Walk both serialized values a byte at a time, treating the end of
+    // each pass but the last as a comma.
+    BlobCursor lhs_cursor(m_value);
+    BlobCursor rhs_cursor(rhs.m_value);
+    for (size_t i = 0; i < lhs_size; ++i) {
+      uint8_t lhs_byte = lhs_cursor.next();
+      uint8_t rhs_byte = rhs_cursor.next();
+      if (lhs_byte != rhs_byte) {
+        return lhs_byte < rhs_byte ? -1 : 1;
+      }
+    }
+    return 0;
   }
 
   static std::unique_ptr<Attribute>
@@ -263,6 +372,29 @@ public:
   }
 
 private:
+  /// \brief Cursor over the bytes of the serialized value of a sequence of
+  /// passes
+  class BlobCursor {
+  public:
+    explicit BlobCursor(const value_type &passes)
+        : m_passes(passes), m_pass(0), m_char(0) {}
+
+    /// \brief Get the next byte. Must not be called past the end.
+    uint8_t next(void) {
+      if (m_char == m_passes[m_pass].size()) {
+        ++m_pass;
+        m_char = 0;
+        return ',';
+      }
+      return static_cast<uint8_t>(m_passes[m_pass][m_char++]);
+    }
+
+  private:
+    const value_type &m_passes;
+    size_t m_pass;
+    size_t m_char;
+  };
+
   const value_type m_value;
 };
 
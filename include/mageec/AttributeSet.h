@@ -88,14 +88,36 @@ public:
 
   /// \brief Produce a 64-bit hash representing the attributes which make up
   /// this set.
+  ///
+  /// The hash is the crc64 of the identifier and serialized value of each
+  /// attribute in turn, but is calculated without serializing anything.
   uint64_t hash() const {
+    uint64_t crc = 0;
+    for (const auto &I : *this) {
+      unsigned id = I->getID();
+      const uint8_t id_bytes[2] = {static_cast<uint8_t>(id),
+                                   static_cast<uint8_t>(id >> 8)};
+      crc = util::crc64Update(crc, id_bytes, 2);
+      crc = I->updateCRC64(crc);
+    }
+    return crc;
+  }
+
+  /// \brief Produce a digest which identifies the contents of this set.
+  ///
+  /// The digest is taken over a canonical serialization of the set, and is
+  /// strong enough that two sets may be assumed equal if their digests are
+  /// equal.
+  std::vector<uint8_t> digest() const {
     std::vector<uint8_t> blob;
-    for (auto I : *this) {
-      std::vector<uint8_t> attr_blob = I->toBlob();
+    for (const auto &I : *this) {
       util::write16LE(blob, I->getID());
-      blob.insert(blob.end(), attr_blob.begin(), attr_blob.end());
+      util::write16LE(blob, static_cast<unsigned>(I->getType()));
+      util::write32LE(blob, static_cast<uint32_t>(I->getBlobSize()));
+      I->appendBlob(blob);
     }
-    return util::crc64(blob.data(), static_cast<unsigned>(blob.size()));
+    std::array<uint8_t, 32> res = util::sha256(blob.data(), blob.size());
+    return std::vector<uint8_t>(res.begin(), res.end());
   }
 
   bool operator<(const AttributeSet &other) const {
@@ -156,22 +178,13 @@ private:
       ++rhs_iter;
     }
 
-    // Now check attributes one by one. For now, we do the expensive thing and
-    // check the serialized blobs
+    // Now check attributes one by one, by their serialized values
     lhs_iter = begin();
     rhs_iter = other.begin();
     while (lhs_iter != end()) {
-      std::vector<uint8_t> lhs_blob = (*lhs_iter)->toBlob();
-      std::vector<uint8_t> rhs_blob = (*rhs_iter)->toBlob();
-      if (lhs_blob.size() < rhs_blob.size())
-        return -1;
-      else if (lhs_blob.size() > rhs_blob.size())
-        return 1;
-
-      if (lhs_blob < rhs_blob)
-        return -1;
-      else if (lhs_blob > rhs_blob)
-        return 1;
+      int res = (*lhs_iter)->compareBlob(**rhs_iter);
+      if (res != 0)
+        return res;
 
       ++lhs_iter;
       ++rhs_iter;
@@ -37,17 +37,46 @@
 #include "sqlite3.h"
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #define MAGEEC_DATABASE_VERSION_MAJOR 1
-#define MAGEEC_DATABASE_VERSION_MINOR 0
+#define MAGEEC_DATABASE_VERSION_MINOR 2
 #define MAGEEC_DATABASE_VERSION_PATCH 0
 
 namespace mageec {
 
 class IMachineLearner;
 
+/// \struct DatabaseOptions
+///
+/// \brief Options controlling how a connection to a database is configured
+///
+/// By default a database uses a rollback journal held in memory, which is
+/// fastest for a single process. A write-ahead log instead lets readers
+/// proceed while another process writes, and makes each short write
+/// transaction cheaper, which suits many compiler processes recording into
+/// the same database at once.
+struct DatabaseOptions {
+  /// Use a write-ahead log. This is a persistent property of the database
+  /// file, so connections which do not request it keep using the log once
+  /// it has been enabled.
+  bool with_wal = false;
+
+  /// Size of the page cache of the connection in KiB, or 0 to use the
+  /// sqlite default
+  unsigned cache_size_kib = 0;
+
+  /// Maximum number of bytes of the database file to memory map, or 0 to
+  /// disable memory mapping
+  uint64_t mmap_size = 0;
+
+  /// Number of pages the write-ahead log may grow to before a committing
+  /// connection checkpoints it
+  unsigned wal_autocheckpoint = 1000;
+};
+
 /// \class Database
 ///
 /// \brief Main class for accessing the MAGEEC database
@@ -70,10 +99,12 @@ public:
   /// \param db_path  Path to the database to be loaded.
   /// \param mls  Map of the machine learner interfaces available to the
   /// database
+  /// \param options  Options used to configure the connection
   /// \return The database if it could be loaded, nullptr otherwise.
   static std::unique_ptr<Database>
   loadDatabase(std::string db_path,
-               std::map<std::string, IMachineLearner *> mls);
+               std::map<std::string, IMachineLearner *> mls,
+               const DatabaseOptions &options = DatabaseOptions());
 
   /// \brief Create a database from the provided path
   ///
@@ -82,11 +113,13 @@ public:
   /// \param db_path  Path to the database to be created.
   /// \param mls  Map of the machine learner interfaces available to the
   /// database
+  /// \param options  Options used to configure the connection
   ///
   /// \return The database if it could be created, nullptr otherwise.
   static std::unique_ptr<Database>
   createDatabase(std::string db_path,
-                 std::map<std::string, IMachineLearner *> mls);
+                 std::map<std::string, IMachineLearner *> mls,
+                 const DatabaseOptions &options = DatabaseOptions());
 
   /// \brief Load or create a database from the provided path
   ///
@@ -97,11 +130,13 @@ public:
   /// \param db_path  Path to the database to be created or loaded
   /// \param mls  Map of the machine learner interfaces available to the
   /// database
+  /// \param options  Options used to configure the connection
   ///
   /// \return The database if it could be created or loaded, nullptr
   /// otherwise.
   static std::unique_ptr<Database>
-  getDatabase(std::string db_path, std::map<std::string, IMachineLearner *> mls);
+  getDatabase(std::string db_path, std::map<std::string, IMachineLearner *> mls,
+              const DatabaseOptions &options = DatabaseOptions());
 
 private:
   /// \brief Construct a database from the provided database path.
@@ -113,8 +148,9 @@ private:
   /// \param mls  Map of the machine learner interfaces available to the
   /// database.
   /// \param create  True if the database should be constructed.
+  /// \param options  Options used to configure the connection
   Database(sqlite3 &db, std::map<std::string, IMachineLearner *> mls,
-           bool create);
+           bool create, const DatabaseOptions &options);
 
 public:
   Database(void) = delete;
@@ -136,6 +172,14 @@ public:
   /// \return True if the database is compatible
   bool isCompatible(void);
 
+  /// \brief Upgrade the database to the current version
+  ///
+  /// Only databases with the same major version, and the same or an older
+  /// minor version, can be upgraded.
+  ///
+  /// \return True if the database was upgraded, and is now compatible
+  bool upgrade(void);
+
   /// \brief Append a provided database to the current database
   ///
   /// This merges the two database, preserving all primary and foreign
@@ -172,6 +216,7 @@ private:
   void setMetadata(MetadataField field, std::string value);
 
 public:
+  class BulkWriter;
 
 //===------------------- Feature extractor interface-----------------------===//
 
@@ -182,6 +227,16 @@ public:
   /// \return The identifier of the new feature set in the database
   FeatureSetID newFeatureSet(FeatureSet features);
 
+  /// \brief Add many sets of features to the database in a single
+  /// transaction
+  ///
+  /// \param feature_sets  The sets of features to be added
+  ///
+  /// \return The identifier of each feature set in the database, in the
+  /// same order as the provided feature sets
+  std::vector<FeatureSetID>
+  newFeatureSets(const std::vector<FeatureSet> &feature_sets);
+
   /// \brief Retrieve the provided set of features
   ///
   /// \param feature_set_id  The id of the set of features to be extracted
@@ -251,6 +306,9 @@ private:
   /// Handle to the underlying sqlite3 database
   sqlite3 *m_db;
 
+  /// Whether the database is using a write-ahead log
+  bool m_with_wal;
+
   /// Mapping of machine learner string identifiers to machine learners
   std::map<std::string, IMachineLearner *> m_mls;
 
@@ -261,6 +319,18 @@ private:
   /// \param db  The database to be initialized
   static void init_db(sqlite3 &db);
 
+  /// \brief Create the indexes over the tables of the database
+  ///
+  /// \param db  The database to create the indexes in
+  static void createIndexes(sqlite3 &db);
+
+  /// \brief Add the digests of existing feature and parameter sets, as part
+  /// of upgrading a version 1.0 database
+  void addSetDigests(void);
+
+  /// \brief Set the journal mode and tuning pragmas of the connection
+  void configure(const DatabaseOptions &options);
+
   /// \brief Validate the contents of the database
   ///
   /// This is used to check that a database is valid and well formed, and to
@@ -272,6 +342,11 @@ private:
 ///
 /// \brief Interface to retrieve individual results from the database in
 /// sequence.
+///
+/// Only the best (lowest) result for each distinct feature set is
+/// retrieved, so the number of results is bounded by the number of feature
+/// sets rather than the number of compilations. The best results are
+/// selected by the database, and each feature set is read exactly once.
 class ResultIterator {
 public:
   /// \brief Constructor an iterator to iterate through results in the database
@@ -295,12 +370,20 @@ private:
   Database *m_db;
   std::unique_ptr<SQLQuery> m_query;
   std::unique_ptr<SQLQueryIterator> m_result_iter;
+
+  /// Queries used to retrieve the features and parameters of each result
+  std::unique_ptr<SQLQuery> m_select_features;
+  std::unique_ptr<SQLQuery> m_select_parameters;
 };
 
 /// \class SQLTransaction
 ///
 /// \brief Wrapper around an SQL transaction. This rolls back a transaction
 /// if it is destroyed before it has been explicitly committed.
+///
+/// A transaction started while another transaction is already open is
+/// nested within it as a savepoint, so its changes are only made durable
+/// once the outermost transaction commits.
 class SQLTransaction {
 public:
   /// Type of the transaction, this dictates when locks to the database
@@ -334,10 +417,141 @@ private:
   /// Flag marking whether the transaction has been successfully committed.
   bool m_is_committed;
 
+  /// Flag marking whether the transaction is nested in another transaction
+  bool m_is_nested;
+
   /// Handle to the underlying sqlite3 database connection
   sqlite3 *m_db;
 };
 
+/// \class Database::BulkWriter
+///
+/// \brief Interface to add many items to the database at once
+///
+/// The queries used to add each kind of item are prepared once, when the
+/// first item of that kind is added, and reused for every following item.
+/// Items are added in transactions which are committed once a batch of
+/// items has been written, rather than in a transaction per item.
+///
+/// The identifier of each item is available as soon as it is added, but
+/// the item is only visible to other connections once its batch has been
+/// committed. Any outstanding batch is committed when the writer is
+/// destroyed.
+class Database::BulkWriter {
+public:
+  /// \brief Description of a compilation to be added to the database
+  ///
+  /// The fields correspond to the parameters of Database::newCompilation.
+  struct NewCompilation {
+    std::string name;
+    std::string type;
+    FeatureSetID features;
+    FeatureClass features_class;
+    ParameterSetID parameters;
+    util::Option<std::string> command;
+    util::Option<CompilationID> parent;
+  };
+
+  /// \brief Create a writer to add items to a database
+  ///
+  /// \param db  The database to add items to
+  /// \param batch_size  Number of items written in each transaction. If 0,
+  /// all items are written in a single transaction.
+  explicit BulkWriter(Database &db, unsigned batch_size = 1024);
+  ~BulkWriter();
+
+  BulkWriter() = delete;
+  BulkWriter(const BulkWriter &other) = delete;
+  BulkWriter &operator=(const BulkWriter &other) = delete;
+
+  /// \brief Add a set of features, if an equal set is not already present
+  ///
+  /// \return The identifier of the feature set in the database
+  FeatureSetID addFeatureSet(const FeatureSet &features);
+
+  /// \brief Add many sets of features
+  ///
+  /// \return The identifier of each feature set, in the same order as the
+  /// provided feature sets
+  std::vector<FeatureSetID>
+  addFeatureSets(const std::vector<FeatureSet> &feature_sets);
+
+  /// \brief Add a set of parameters, if an equal set is not already present
+  ///
+  /// \return The identifier of the parameter set in the database
+  ParameterSetID addParameterSet(const ParameterSet &parameters);
+
+  /// \brief Add many sets of parameters
+  ///
+  /// \return The identifier of each parameter set, in the same order as the
+  /// provided parameter sets
+  std::vector<ParameterSetID>
+  addParameterSets(const std::vector<ParameterSet> &parameter_sets);
+
+  /// \brief Add a compilation of a program unit
+  ///
+  /// \return The identifier of the new compilation
+  CompilationID addCompilation(const NewCompilation &compilation);
+
+  /// \brief Add many compilations
+  ///
+  /// \return The identifier of each new compilation, in the same order as
+  /// the provided compilations
+  std::vector<CompilationID>
+  addCompilations(const std::vector<NewCompilation> &compilations);
+
+  /// \brief Add a result for a previously established compilation,
+  /// replacing any existing result for the same metric
+  ///
+  /// \return False if the compilation does not exist, in which case the
+  /// result is ignored
+  bool addResult(CompilationID compilation, const std::string &metric,
+                 double value);
+
+  /// \brief Add many results
+  ///
+  /// \return The number of results added. Results for compilations which
+  /// do not exist are ignored.
+  unsigned
+  addResults(const std::map<std::pair<CompilationID, std::string>, double>
+                 &results);
+
+  /// \brief Commit the outstanding batch of items
+  void commit(void);
+
+private:
+  /// \brief Open a transaction for the current batch if none is open
+  void beginWrite(void);
+
+  /// \brief Count an item as written, committing the batch when full
+  void endWrite(void);
+
+  /// Handle to the underlying sqlite3 database
+  sqlite3 *m_db;
+
+  /// Number of items written in each transaction, or 0 for no limit
+  unsigned m_batch_size;
+  /// Number of items written in the current transaction
+  unsigned m_num_pending;
+  /// Transaction for the current batch, if one is open
+  std::unique_ptr<SQLTransaction> m_transaction;
+
+  // Prepared queries, each created on first use
+  std::unique_ptr<SQLQuery> m_get_feature_set;
+  std::unique_ptr<SQLQuery> m_insert_feature_set;
+  std::unique_ptr<SQLQuery> m_insert_feature_type;
+  std::unique_ptr<SQLQuery> m_insert_feature;
+  std::unique_ptr<SQLQuery> m_insert_feature_debug;
+  std::unique_ptr<SQLQuery> m_get_parameter_set;
+  std::unique_ptr<SQLQuery> m_insert_parameter_set;
+  std::unique_ptr<SQLQuery> m_insert_parameter_type;
+  std::unique_ptr<SQLQuery> m_insert_parameter;
+  std::unique_ptr<SQLQuery> m_insert_parameter_debug;
+  std::unique_ptr<SQLQuery> m_insert_compilation;
+  std::unique_ptr<SQLQuery> m_insert_compilation_debug;
+  std::unique_ptr<SQLQuery> m_insert_result;
+};
+
 } // end of namespace mageec
 
 #endif // MAGEEC_DATABASE_H
@@ -96,6 +96,9 @@ class DecisionRequestBase {
 public:
   DecisionRequestBase() = delete;
 
+  // Requests may be owned through a pointer to this base class
+  virtual ~DecisionRequestBase() {}
+
   /// \brief Get the type of the decision request
   DecisionRequestType getType() const { return m_request_type; }
 
@@ -0,0 +1,99 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===----------------------- MAGEEC decision server -----------------------===//
+//
+// This provides a server which makes decisions using the machine learners
+// trained in a database, and the client used to request decisions from it.
+//
+// Making a decision in a new process means opening the database, loading
+// the trained machine learner and deserializing its model, which costs far
+// more than the decision itself. The server does this once, and keeps the
+// models and the feature sets it has been asked about in memory. Clients
+// connect to it over a UNIX domain socket, and send a feature set
+// identifier along with all of the decisions they need, which are answered
+// in a single reply.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_DECISION_SERVER_H
+#define MAGEEC_DECISION_SERVER_H
+
+#include "mageec/Database.h"
+#include "mageec/Decision.h"
+#include "mageec/Types.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mageec {
+
+/// \enum DecisionStatus
+///
+/// \brief Outcome of a request made to a decision server
+enum class DecisionStatus {
+  /// The decisions were made
+  kSuccess,
+  /// The server could not be reached, or did not give a valid reply
+  kNoServer,
+  /// The server has no machine learner trained for the requested name,
+  /// metric and class of features
+  kUnknownMachineLearner,
+  /// The requested feature set is not in the database
+  kUnknownFeatureSet,
+  /// The server could not understand the request
+  kBadRequest
+};
+
+/// \brief Serve decisions over a UNIX domain socket until interrupted
+///
+/// The machine learners trained in the database are loaded when the server
+/// starts. The server stops, and removes its socket, when the process
+/// receives SIGINT or SIGTERM.
+///
+/// \param db  The database holding the trained machine learners and the
+/// feature sets which decisions are requested for
+/// \param socket_path  Path of the socket to listen on
+///
+/// \return False if the server could not be started
+bool serveDecisions(Database &db, const std::string &socket_path);
+
+/// \brief Request decisions from a decision server
+///
+/// \param socket_path  Path of the socket the server listens on
+/// \param ml_name  Name of the machine learner to make the decisions
+/// \param metric  Metric which the machine learner was trained for
+/// \param feature_class  Class of features the machine learner was trained
+/// against
+/// \param feature_set  Identifier of the feature set to make decisions for
+/// \param requests  The decisions to be made
+/// \param decisions  Set to the decisions made, in the same order as the
+/// requests, if the request succeeds
+///
+/// \return Whether the decisions were made, or why they were not
+DecisionStatus
+requestDecisions(const std::string &socket_path, const std::string &ml_name,
+                 const std::string &metric, FeatureClass feature_class,
+                 FeatureSetID feature_set,
+                 const std::vector<std::unique_ptr<DecisionRequestBase>>
+                     &requests,
+                 std::vector<std::unique_ptr<DecisionBase>> &decisions);
+
+} // end of namespace mageec
+
+#endif // MAGEEC_DECISION_SERVER_H
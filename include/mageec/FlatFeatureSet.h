@@ -0,0 +1,133 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===------------------------ MAGEEC flat feature set ---------------------===//
+//
+// This provides a compact representation of a FeatureSet, for use where
+// many feature sets are held in memory at once, such as during training.
+//
+// Rather than a tree of individually allocated features, the features are
+// held in parallel arrays of identifiers, types and values, sorted by
+// identifier. Feature names are not held, as they are never read back from
+// the database.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_FLAT_FEATURE_SET_H
+#define MAGEEC_FLAT_FEATURE_SET_H
+
+#include "mageec/AttributeSet.h"
+#include "mageec/Types.h"
+#include "mageec/Util.h"
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace mageec {
+
+/// \class FlatFeatureSet
+///
+/// \brief A set of features held in sorted, contiguous arrays
+///
+/// The hash and ordering of a FlatFeatureSet are identical to those of the
+/// FeatureSet it was built from, so the two may be used interchangeably as
+/// keys.
+class FlatFeatureSet {
+public:
+  /// \brief Construct a new empty FlatFeatureSet
+  FlatFeatureSet() : m_ids(), m_types(), m_values() {}
+
+  /// \brief Construct a FlatFeatureSet holding the features of a FeatureSet
+  explicit FlatFeatureSet(const FeatureSet &features);
+
+  /// \brief Get the number of features in the set
+  unsigned size() const { return static_cast<unsigned>(m_ids.size()); }
+
+  /// \brief Get the identifier of the feature at an index
+  unsigned getID(unsigned index) const {
+    assert(index < size());
+    return m_ids[index];
+  }
+
+  /// \brief Get the type of the feature at an index
+  FeatureType getType(unsigned index) const {
+    assert(index < size());
+    return m_types[index];
+  }
+
+  /// \brief Get the value of the feature at an index
+  ///
+  /// Boolean features have the value 0 or 1.
+  int64_t getValue(unsigned index) const {
+    assert(index < size());
+    return m_values[index];
+  }
+
+  /// \brief Find the index of the feature with an identifier
+  ///
+  /// \return The index of the feature, or nothing if the set does not
+  /// contain a feature with the identifier.
+  util::Option<unsigned> find(unsigned id) const;
+
+  /// \brief Build a FeatureSet holding the same features as this set
+  FeatureSet toFeatureSet() const;
+
+  /// \brief Produce a 64-bit hash of the features in this set
+  ///
+  /// This is equal to the hash of the equivalent FeatureSet.
+  uint64_t hash() const;
+
+  bool operator<(const FlatFeatureSet &other) const {
+    return compare(other) < 0;
+  }
+  bool operator==(const FlatFeatureSet &other) const {
+    return compare(other) == 0;
+  }
+  bool operator!=(const FlatFeatureSet &other) const {
+    return compare(other) != 0;
+  }
+
+private:
+  /// Identifier of each feature, in ascending order
+  std::vector<unsigned> m_ids;
+  /// Type of each feature
+  std::vector<FeatureType> m_types;
+  /// Value of each feature. This is wide enough to hold the value of any
+  /// type of feature.
+  std::vector<int64_t> m_values;
+
+  /// \brief Compare the current FlatFeatureSet against another
+  ///
+  /// This orders sets in the same way as FeatureSet. First the sizes of the
+  /// sets are compared, then the identifiers of each consecutive feature,
+  /// then the serialized value of each feature.
+  ///
+  /// \return -1 if this < other, 0 if this == other, 1 if this > other
+  int compare(const FlatFeatureSet &other) const;
+
+  /// \brief Get the size of the serialized value of the feature at an index
+  unsigned getBlobSize(unsigned index) const;
+
+  /// \brief Get a pointer to the bytes of the value of a feature at an
+  /// index, laid out as they would be when serialized.
+  const uint8_t *getBlob(unsigned index) const;
+};
+
+} // end of namespace mageec
+
+#endif // MAGEEC_FLAT_FEATURE_SET_H
@@ -46,6 +46,7 @@ namespace mageec {
 
 class Database;
 class IMachineLearner;
+struct DatabaseOptions;
 
 /// \class Framework
 ///
@@ -110,6 +111,16 @@ public:
   /// \param create  Dictates whether the database should be loaded or created
   std::unique_ptr<Database> getDatabase(std::string db_path, bool create) const;
 
+  /// \brief Load the database at the provided path, configuring the
+  /// connection to it with the provided options
+  ///
+  /// \param db_path  Path to the database to be loaded or created
+  /// \param create  Dictates whether the database should be loaded or created
+  /// \param options  Options used to configure the connection, for example
+  /// to use a write-ahead log when many processes write to the database.
+  std::unique_ptr<Database> getDatabase(std::string db_path, bool create,
+                                        const DatabaseOptions &options) const;
+
   /// \brief Check whether a machine learner with the specified name has been
   /// registered with the framework.
   bool hasMachineLearner(std::string ml) const;
@@ -31,6 +31,7 @@
 #include "mageec/Result.h"
 #include "mageec/Util.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -38,6 +39,42 @@ namespace mageec {
 
 class DecisionRequestBase;
 
+/// \class IModel
+///
+/// \brief Abstract base for a machine learner's deserialized training data
+///
+/// A model is produced by a machine learner from a training blob, and holds
+/// that training data in whatever form the machine learner finds most
+/// efficient to make decisions from. This allows a blob to be deserialized
+/// once, and then used to make many decisions.
+class IModel {
+public:
+  virtual ~IModel(void) = 0;
+};
+
+inline IModel::~IModel() {}
+
+/// \class BlobModel
+///
+/// \brief Model which simply holds a copy of the training blob
+///
+/// This is the model used by machine learners which do not provide their
+/// own model type. Decisions made against this model are forwarded to the
+/// blob based interface of the machine learner.
+class BlobModel : public IModel {
+public:
+  BlobModel() = delete;
+  explicit BlobModel(const std::vector<uint8_t> &blob) : m_blob(blob) {}
+  ~BlobModel() override {}
+
+  /// \brief Get the training blob held by this model
+  const std::vector<uint8_t> &getBlob(void) const { return m_blob; }
+
+private:
+  /// Blob of training data for the machine learner
+  const std::vector<uint8_t> m_blob;
+};
+
 /// \class IMachineLearner
 ///
 /// \brief Abstract interface to a machine learner
@@ -109,6 +146,63 @@ public:
   makeDecision(const DecisionRequestBase &request, const FeatureSet &features,
                const std::vector<uint8_t> &blob) const = 0;
 
+  /// \brief Deserialize a blob of training data into a model which can be
+  /// used to make many decisions.
+  ///
+  /// Machine learners which override this must also override the model based
+  /// makeDecision method, as the default implementation of that method
+  /// expects a BlobModel.
+  ///
+  /// \param blob  A blob of training data appropriate to the machine learner.
+  ///
+  /// \return The model deserialized from the blob
+  virtual std::unique_ptr<IModel>
+  loadModel(const std::vector<uint8_t> &blob) const {
+    return std::unique_ptr<IModel>(new BlobModel(blob));
+  }
+
+  /// \brief Make a single decision based on a provided request, the features
+  /// of a program unit, and a model previously loaded by this machine
+  /// learner.
+  ///
+  /// \param request  The decision to be made
+  /// \param features  A set of features to be used by the machine learner to
+  /// make the decision.
+  /// \param model  A model produced by loadModel of this machine learner.
+  ///
+  /// \return The resultant decision, which is either the appropriate
+  /// corresponding decision for the input request, or the native decision if
+  /// a decision could not be made.
+  virtual std::unique_ptr<DecisionBase>
+  makeDecision(const DecisionRequestBase &request, const FeatureSet &features,
+               const IModel &model) const {
+    const auto &blob_model = static_cast<const BlobModel &>(model);
+    return makeDecision(request, features, blob_model.getBlob());
+  }
+
+  /// \brief Make a decision for each of a number of requests, based on the
+  /// same features and model.
+  ///
+  /// Machine learners may override this in order to share any processing of
+  /// the features between the requests. By default each decision is made
+  /// independently.
+  ///
+  /// \param requests  The decisions to be made
+  /// \param features  A set of features to be used by the machine learner to
+  /// make the decisions.
+  /// \param model  A model produced by loadModel of this machine learner.
+  ///
+  /// \return The resultant decisions, in the same order as the requests.
+  virtual std::vector<std::unique_ptr<DecisionBase>> makeDecisions(
+      const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+      const FeatureSet &features, const IModel &model) const {
+    std::vector<std::unique_ptr<DecisionBase>> decisions;
+    decisions.reserve(requests.size());
+    for (const auto &request : requests) {
+      decisions.push_back(makeDecision(*request, features, model));
+    }
+    return decisions;
+  }
 
   /// \brief Train the machine learner using a complete set of provided
   /// results.
@@ -121,7 +215,8 @@ public:
   /// \param parameter_descs  All of the parameter ids and their types used in
   /// the results data
   /// \param passes  All of the passes used in the results data
-  /// \param results  Iterator to the results data
+  /// \param results  Iterator to the results data. This provides only the
+  /// best result for each distinct set of features.
   ///
   /// \return A blob of training data.
   //
@@ -73,30 +73,64 @@ public:
   makeDecision(const DecisionRequestBase &request, const FeatureSet &features,
                const std::vector<uint8_t> &blob) const override;
 
+  std::unique_ptr<IModel>
+  loadModel(const std::vector<uint8_t> &blob) const override;
+
+  std::unique_ptr<DecisionBase>
+  makeDecision(const DecisionRequestBase &request, const FeatureSet &features,
+               const IModel &model) const override;
+
+  std::vector<std::unique_ptr<DecisionBase>> makeDecisions(
+      const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+      const FeatureSet &features, const IModel &model) const override;
+
   const std::vector<uint8_t> train(std::set<FeatureDesc> feature_descs,
                                    std::set<ParameterDesc> parameter_descs,
                                    std::set<std::string> passes,
                                    ResultIterator results) const override;
 
-private:
-  /// \struct Point
+protected:
+  /// \struct Model
   ///
-  /// \brief Represents a point in N-dimensional space, where N is the number
-  /// of distinct features.
+  /// \brief The feature ranges and points deserialized from a training blob
   ///
-  /// Each distinct feature is a separate axis in N-dimensional space. The
-  /// distance between two points is calculated by calculating the Euclidean
-  /// distance between the features in the feature sets.
+  /// Each distinct feature set seen during training is a point in
+  /// N-dimensional space, where N is the number of distinct features. The
+  /// distance between two points is the Euclidean distance between the
+  /// features which both feature sets have a value for.
   ///
   /// A point also has an associated set of parameters which is the best
   /// set of parameters for that feature set encountered during training. If
   /// a point is determined to be the closest to an input feature set, then
   /// this parameter set corresponds to the decisions which should be made
   /// for each parameter.
-  struct Point {
-    std::map<unsigned, double>  features;
-    std::map<unsigned, int64_t> parameters;
-  };
+  struct Model;
+
+  /// \brief Normalize a set of features into a query row with the same
+  /// layout as the feature points of a model
+  ///
+  /// Features which were not seen during training cannot contribute to the
+  /// distance to any point, so are dropped.
+  std::vector<double> normalizeFeatures(const Model &model,
+                                        const FeatureSet &features) const;
+
+  /// \brief Get the id of the parameter a decision is requested for
+  unsigned getParameterID(const DecisionRequestBase &request) const;
+
+  /// \brief Find the point in the model nearest to a set of features
+  ///
+  /// \return The index of the nearest point, or nothing if the model has no
+  /// points.
+  util::Option<unsigned> findNearestNeighbor(const Model &model,
+                                             const FeatureSet &features) const;
+
+  /// \brief Make a decision using the parameters associated with a point
+  ///
+  /// \return The decision, or the native decision if there is no point, or
+  /// the point has no value for the requested parameter.
+  std::unique_ptr<DecisionBase>
+  decide(const DecisionRequestBase &request, const Model &model,
+         util::Option<unsigned> nearest_neighbor) const;
 };
 
 } // end of namespace mageec
@@ -0,0 +1,169 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===-------------------- MAGEEC nearest neighbor model -------------------===//
+//
+// This defines the model shared by the nearest neighbor machine learners,
+// which holds the feature points seen during training and an index used to
+// search them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_1NN_MODEL_H
+#define MAGEEC_1NN_MODEL_H
+
+#include "mageec/ML/1NN.h"
+#include "mageec/ML/KNN.h"
+#include "mageec/Util.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mageec {
+
+/// \struct OneNN::Model
+///
+/// \brief The deserialized form of the training blob for the 1-NN machine
+/// learner.
+///
+/// The feature points are held in a dense row-major matrix, with a column for
+/// each feature seen during training in ascending order of feature id. A
+/// missing feature value is stored as NaN, which masks it out of distance
+/// calculations.
+struct OneNN::Model : public IModel {
+  ~Model() override {}
+
+  /// Ids of the features seen during training, one for each column
+  std::vector<unsigned> feature_ids;
+
+  /// Max and min of each feature column seen during training, used to
+  /// normalize the input features.
+  std::vector<std::pair<double, double>> feature_max_min;
+
+  /// Number of feature points, one for each distinct feature set seen during
+  /// training
+  unsigned n_points = 0;
+
+  /// Distance between the start of consecutive rows of the matrix. Rows are
+  /// padded with missing values so they can be processed in pairs.
+  unsigned stride = 0;
+
+  /// Normalized feature values of each point
+  std::vector<double> feature_values;
+
+  /// Ids of the parameters seen during training, one for each column
+  std::vector<unsigned> parameter_ids;
+
+  /// Value of each parameter in the best parameter set for each point
+  std::vector<int64_t> parameter_values;
+
+  /// Whether each point has a value for each parameter
+  std::vector<uint8_t> parameter_known;
+
+  /// \brief Size the feature and parameter matrices for a number of points
+  ///
+  /// Every feature and parameter value is initially missing.
+  void resize(unsigned points);
+
+  /// \brief Get the row of feature values for a point
+  const double *getRow(unsigned point) const {
+    return &feature_values[point * stride];
+  }
+
+  /// \brief Get the column holding a feature, if the feature was seen
+  /// during training
+  util::Option<unsigned> getFeatureColumn(unsigned feature_id) const;
+
+  /// \brief Get the column holding a parameter, if the parameter was seen
+  /// during training
+  util::Option<unsigned> getParameterColumn(unsigned param_id) const;
+
+  /// \struct IndexNode
+  ///
+  /// \brief A node of the KD-tree used to index the feature points
+  ///
+  /// An inner node splits its points on the value of a single feature. The
+  /// points which have no value for that feature are held in a separate
+  /// subtree, as the split says nothing about their distance from a query.
+  struct IndexNode {
+    /// Whether this is a leaf, holding points rather than subtrees
+    bool is_leaf;
+    /// Column of the feature which an inner node splits its points on
+    unsigned column;
+    /// Points whose value for the feature is below this are in the lower
+    /// subtree, all others are in the upper subtree.
+    double split;
+    /// Lower, upper and missing value subtrees of an inner node. kNoNode if
+    /// a subtree is empty.
+    unsigned children[3];
+    /// Range of index_points held by a leaf
+    unsigned begin;
+    unsigned end;
+  };
+
+  /// Marks an empty subtree of an index node
+  static const unsigned kNoNode = 0xFFFFFFFF;
+  /// Maximum number of points held by a leaf of the index
+  static const unsigned kMaxLeafPoints = 8;
+
+  /// Nodes of the index over the feature points. The root is the first node.
+  std::vector<IndexNode> index_nodes;
+  /// Indices of feature points, ordered so that the points of each leaf of
+  /// the index are contiguous.
+  std::vector<unsigned> index_points;
+
+  /// \brief Build the index over the feature points
+  void buildIndex(void);
+
+  /// \brief Append the index to a training blob
+  void writeIndex(std::vector<uint8_t> &blob) const;
+
+  /// \brief Read the index from a training blob
+  ///
+  /// \return true if the index was read, false if it was malformed.
+  bool readIndex(std::vector<uint8_t>::const_iterator &it,
+                 std::vector<uint8_t>::const_iterator end);
+
+  /// A feature point found by a search, and its distance from the query
+  typedef std::pair<double, unsigned> Neighbor;
+
+  /// \brief Find the feature points nearest to a normalized query row
+  ///
+  /// \param query Normalized feature values, laid out as a row of the matrix
+  /// \param k Maximum number of points to find
+  /// \param metric Metric used to measure the distance between points
+  /// \param weights Weight of each column in the distance, laid out as a
+  /// row of the matrix
+  ///
+  /// \return Up to k points in ascending order of distance from the query.
+  /// Ties are broken by the order of the points.
+  std::vector<Neighbor> findNearest(const std::vector<double> &query,
+                                    unsigned k, DistanceMetric metric,
+                                    const std::vector<double> &weights) const;
+
+private:
+  unsigned buildIndexNode(unsigned begin, unsigned end);
+
+  void searchIndex(unsigned node, const double *query, const double *weights,
+                   DistanceMetric metric, unsigned k,
+                   std::vector<Neighbor> &nearest) const;
+};
+
+} // end of namespace mageec
+
+#endif // MAGEEC_1NN_MODEL_H
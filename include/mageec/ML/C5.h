@@ -44,9 +44,16 @@ class DecisionRequestBase;
 /// \class C5Driver
 ///
 /// \brief Machine learner which drives an external C5.0 classifier
+///
+/// The state of the C5.0 classifier is local to the calling thread, so
+/// training and decisions may be made from several threads at once.
 class C5Driver : public IMachineLearner {
 public:
-  C5Driver();
+  /// \brief Create a C5.0 machine learner
+  ///
+  /// \param training_jobs Number of classifiers to train concurrently. 0
+  /// uses one thread per hardware thread.
+  explicit C5Driver(unsigned training_jobs = 1);
   ~C5Driver() override;
 
   std::string getName(void) const override { return "c50"; }
@@ -68,10 +75,33 @@ public:
   makeDecision(const DecisionRequestBase &request, const FeatureSet &features,
                const std::vector<uint8_t> &blob) const override;
 
+  std::unique_ptr<IModel>
+  loadModel(const std::vector<uint8_t> &blob) const override;
+
+  std::unique_ptr<DecisionBase>
+  makeDecision(const DecisionRequestBase &request, const FeatureSet &features,
+               const IModel &model) const override;
+
+  std::vector<std::unique_ptr<DecisionBase>> makeDecisions(
+      const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+      const FeatureSet &features, const IModel &model) const override;
+
   const std::vector<uint8_t> train(std::set<FeatureDesc> feature_descs,
                                    std::set<ParameterDesc> parameter_descs,
                                    std::set<std::string> passes,
                                    ResultIterator results) const override;
+
+  /// \brief Set the number of classifiers to train concurrently
+  ///
+  /// \param jobs The number of jobs. 0 uses one thread per hardware thread.
+  void setTrainingJobs(unsigned jobs) { m_training_jobs = jobs; }
+
+  /// \brief Get the number of classifiers trained concurrently
+  unsigned getTrainingJobs(void) const { return m_training_jobs; }
+
+private:
+  /// Number of classifiers trained concurrently by train()
+  unsigned m_training_jobs;
 };
 
 } // end of namespace mageec
@@ -0,0 +1,147 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===----------------------- MAGEEC k-NN Classifier -----------------------===//
+//
+// This implements a k-NN machine learner. This finds the k closest feature
+// sets in the training set to the input feature set, and then makes each
+// decision by a vote between the configurations of those feature sets.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_KNN_H
+#define MAGEEC_KNN_H
+
+#include "mageec/ML/1NN.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mageec {
+
+/// \enum DistanceMetric
+///
+/// \brief Metrics which may be used to measure the distance between two
+/// feature points
+enum class DistanceMetric {
+  /// Square root of the sum of the squared differences of each feature
+  kEuclidean,
+  /// Sum of the absolute differences of each feature
+  kManhattan,
+  /// One minus the cosine of the angle between the points
+  kCosine
+};
+
+/// \class KNN
+///
+/// \brief k-NN machine learner
+///
+/// This machine learner is trained in the same way as the 1-NN machine
+/// learner. It makes decisions by finding the k closest sets of features in
+/// the training set, and then voting between the best set of parameters
+/// used to compile each of those sets of features. Neighbors which have no
+/// value for a requested parameter do not vote.
+///
+/// The distance between feature sets may be measured by a number of metrics,
+/// and each feature may be given a weight in that distance.
+class KNN : public OneNN {
+public:
+  /// \brief Create a k-NN machine learner
+  ///
+  /// \param k Number of neighbors which vote on each decision
+  /// \param metric Metric used to measure the distance between feature sets
+  /// \param distance_weighted Whether votes are weighted by the inverse of
+  /// the distance of the neighbor, rather than being equal.
+  explicit KNN(unsigned k = 5,
+               DistanceMetric metric = DistanceMetric::kEuclidean,
+               bool distance_weighted = true);
+  ~KNN() override;
+
+  std::string getName(void) const override { return "knn"; }
+
+  std::unique_ptr<DecisionBase>
+  makeDecision(const DecisionRequestBase &request, const FeatureSet &features,
+               const IModel &model) const override;
+
+  std::vector<std::unique_ptr<DecisionBase>> makeDecisions(
+      const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+      const FeatureSet &features, const IModel &model) const override;
+
+  /// \brief Set the number of neighbors which vote on each decision
+  void setK(unsigned k) {
+    assert(k > 0 && "k-NN requires at least one neighbor");
+    m_k = k;
+  }
+  unsigned getK(void) const { return m_k; }
+
+  /// \brief Set the metric used to measure the distance between feature sets
+  void setMetric(DistanceMetric metric) { m_metric = metric; }
+  DistanceMetric getMetric(void) const { return m_metric; }
+
+  /// \brief Set whether votes are weighted by the distance of the neighbor
+  void setDistanceWeighted(bool distance_weighted) {
+    m_distance_weighted = distance_weighted;
+  }
+  bool getDistanceWeighted(void) const { return m_distance_weighted; }
+
+  /// \brief Set the weight of a feature in the distance between feature sets
+  ///
+  /// Features have a weight of 1 unless set otherwise. A weight of 0 ignores
+  /// the feature entirely.
+  ///
+  /// \param feature_id Id of the feature
+  /// \param weight Non-negative weight of the feature
+  void setFeatureWeight(unsigned feature_id, double weight) {
+    assert(weight >= 0.0 && "Feature weights must not be negative");
+    m_feature_weights[feature_id] = weight;
+  }
+
+private:
+  /// \brief Get the weight of each column of the feature points of a model
+  std::vector<double> getWeights(const Model &model) const;
+
+  /// \brief Find the points in the model nearest to a set of features
+  ///
+  /// \return Up to k pairs of the distance to and index of a point, in
+  /// ascending order of distance.
+  std::vector<std::pair<double, unsigned>>
+  findNearestNeighbors(const Model &model, const FeatureSet &features) const;
+
+  /// \brief Make a decision by a vote between the parameters of a set of
+  /// points
+  ///
+  /// \return The decision with the most votes, or the native decision if no
+  /// point has a value for the requested parameter.
+  std::unique_ptr<DecisionBase>
+  vote(const DecisionRequestBase &request, const Model &model,
+       const std::vector<std::pair<double, unsigned>> &neighbors) const;
+
+  /// Number of neighbors which vote on each decision
+  unsigned m_k;
+  /// Metric used to measure the distance between feature sets
+  DistanceMetric m_metric;
+  /// Whether votes are weighted by the distance of the neighbor
+  bool m_distance_weighted;
+  /// Weights of features in the distance, for features not weighted 1
+  std::map<unsigned, double> m_feature_weights;
+};
+
+} // end of namespace mageec
+
+#endif // MAGEEC_KNN_H
@@ -26,6 +26,7 @@
 #define MAGEEC_RESULT_H
 
 #include "mageec/AttributeSet.h"
+#include "mageec/FlatFeatureSet.h"
 #include "mageec/Types.h"
 #include "mageec/Util.h"
 
@@ -85,6 +86,41 @@ private:
   double m_value;
 };
 
+/// \class FlatResult
+///
+/// \brief A result with its features held in a FlatFeatureSet
+///
+/// Machine learners hold one of these for each distinct set of features
+/// seen during training, so it is kept as compact as possible.
+class FlatResult {
+public:
+  FlatResult() = delete;
+
+  /// \brief Construct a compact copy of a result
+  explicit FlatResult(const Result &result)
+      : m_features(result.getFeatures()),
+        m_parameters(result.getParameters()), m_value(result.getValue()) {}
+
+  /// \brief Get the features of the program unit
+  const FlatFeatureSet& getFeatures(void) const { return m_features; }
+
+  /// \brief Get the parameters of the compilation
+  const ParameterSet& getParameters(void) const { return m_parameters; }
+
+  /// \brief Get the value of the result as as double
+  double getValue(void) const { return m_value; }
+
+private:
+  /// Features for the program unit which produced the result value
+  FlatFeatureSet m_features;
+
+  /// Parameters which were used to compile the program unit
+  ParameterSet m_parameters;
+
+  /// Value of the result
+  double m_value;
+};
+
 } // end of namespace mageec
 
 #endif // MAGEEC_RESULT_H
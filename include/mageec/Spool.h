@@ -0,0 +1,144 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===------------------------ MAGEEC feature spool ------------------------===//
+//
+// This provides a spool of extracted feature sets. A feature extractor may
+// append feature sets to a spool file rather than adding them directly to
+// the database, so that it never waits on the database. The spool files are
+// then ingested into the database afterwards, all in a single transaction.
+//
+// Each process appends to its own spool file, with a single write per
+// batch of records, so a record torn by a process being killed part way
+// through a write can only be at the end of a file. Every record carries
+// its length and a checksum, so that such a record is detected when the
+// spool is read.
+//
+// A spool file is claimed for ingestion by renaming it, after which no
+// more records are appended to it. A process which appends after its file
+// has been claimed starts a new file. Once ingested, a file is removed if
+// it was read to its end, and otherwise is kept with a different extension
+// so that the records following a corrupt record are not lost.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_SPOOL_H
+#define MAGEEC_SPOOL_H
+
+#include "mageec/AttributeSet.h"
+#include "mageec/Types.h"
+#include "mageec/Util.h"
+
+#include <string>
+#include <vector>
+
+namespace mageec {
+
+/// \struct SpoolRecord
+///
+/// \brief A set of features extracted for a single program unit, along with
+/// where the identifier of the set should be emitted once it is in the
+/// database.
+struct SpoolRecord {
+  /// Path of the file which the identifier of the feature set is emitted to
+  std::string out_path;
+  /// Path of the source file containing the program unit
+  std::string src_path;
+  /// Type of the program unit, such as "module" or "function"
+  std::string type;
+  /// Name of the program unit
+  std::string name;
+  /// Class of the extracted features
+  FeatureClass feature_class;
+  /// The extracted features
+  FeatureSet features;
+};
+
+/// \brief Append records to the spool file of this process
+///
+/// The first records appended by a process create a new spool file, whose
+/// name is derived from the host name, process id and time, and which is
+/// never reused by another process. Later records are appended to the same
+/// file, unless it has been claimed for ingestion in the meantime, in which
+/// case another new file is created.
+///
+/// All of the records are appended with a single write, so should be
+/// batched by the caller where possible.
+///
+/// \param spool_dir  Directory holding the spool files
+/// \param spool_path  Path of the spool file last appended to by this
+/// process, or empty if there is none. Updated to the path of the file
+/// which the records are appended to.
+/// \param records  The records to be appended
+///
+/// \return True if the records were appended successfully
+bool appendSpoolRecords(const std::string &spool_dir, std::string &spool_path,
+                        const std::vector<SpoolRecord> &records);
+
+/// \brief Claim a spool file for ingestion
+///
+/// The file is renamed so that no more records are appended to it, and any
+/// append which is already in progress is waited for. A file which has
+/// already been claimed, and was left behind by an interrupted ingestion,
+/// may be claimed again.
+///
+/// \param spool_path  Path of the spool file
+///
+/// \return The path of the claimed file, or nothing if it could not be
+/// claimed, such as when it has been claimed by another process.
+util::Option<std::string> claimSpoolFile(const std::string &spool_path);
+
+/// \brief Set aside a claimed spool file which could not be read to its end
+///
+/// The file is renamed so that it is neither ingested again nor removed,
+/// and the records after the corrupt record can be recovered by hand.
+///
+/// \param spool_path  Path of the claimed spool file
+///
+/// \return True if the file was renamed
+bool setAsideSpoolFile(const std::string &spool_path);
+
+/// \brief Read all of the records from a spool file
+///
+/// If the file contains an incomplete or corrupt record, then a warning is
+/// emitted and all records before it are returned. An empty file, created
+/// by a process which had not yet written to it, has no records.
+///
+/// \param spool_path  Path of the spool file
+/// \param complete  Set to false if the file was not read to its end
+///
+/// \return The records in the order they were appended, or nothing if the
+/// file could not be read or is not a spool file.
+util::Option<std::vector<SpoolRecord>>
+readSpoolRecords(const std::string &spool_path, bool &complete);
+
+/// \brief Find the spool files for a path
+///
+/// Files in a directory which have been claimed or set aside are not
+/// included.
+///
+/// \param path  Either the path of a single spool file, or of a directory
+/// holding spool files
+///
+/// \return The paths of the spool files in sorted order, or nothing if the
+/// path could not be accessed.
+util::Option<std::vector<std::string>>
+findSpoolFiles(const std::string &path);
+
+} // end of namespace mageec
+
+#endif // MAGEEC_SPOOL_H
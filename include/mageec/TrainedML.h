@@ -35,10 +35,12 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace mageec {
 
 class IMachineLearner;
+class IModel;
 
 /// \class TrainedML
 ///
@@ -100,7 +102,9 @@ public:
   ///
   /// This forwards a request to the underlying machine learner to make a
   /// decision, based on the input parameters, as well as the training blob
-  /// stored in the database for this machine learner.
+  /// stored in the database for this machine learner. The blob is only
+  /// deserialized into a model on the first decision, and the model is then
+  /// reused for all subsequent decisions.
   ///
   /// \param request  The request made to the machine learner
   /// \param features  The features which the machine learner uses to make its
@@ -111,6 +115,23 @@ public:
   std::unique_ptr<DecisionBase> makeDecision(const DecisionRequestBase &request,
                                              const FeatureSet &features);
 
+  /// \brief Make a decision for each of the provided requests using the
+  /// machine learner interface
+  ///
+  /// This is equivalent to calling makeDecision for each request in turn,
+  /// however the machine learner may share work between the requests.
+  ///
+  /// \param requests  The requests made to the machine learner
+  /// \param features  The features which the machine learner uses to make its
+  /// decisions.
+  ///
+  /// \return The decisions made, in the same order as the requests. If for
+  /// any reason the machine learner cannot make a decision, the corresponding
+  /// decision will be the native decision.
+  std::vector<std::unique_ptr<DecisionBase>> makeDecisions(
+      const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+      const FeatureSet &features);
+
   /// \brief Print information about this trained machine learner to the
   /// provided output stream
   void print(std::ostream &os) const;
@@ -121,6 +142,10 @@ public:
   }
 
 private:
+  /// \brief Get the model for this machine learner, loading it from the
+  /// training blob if it has not been loaded already.
+  const IModel &getModel(void);
+
   /// Interface to the underlying machine learner.
   IMachineLearner &m_ml;
 
@@ -132,6 +157,10 @@ private:
 
   /// Blob of training data for this machine learner
   const std::vector<uint8_t> m_blob;
+
+  /// Model deserialized from the blob. This is shared between copies of this
+  /// trained machine learner, and is null until the first decision is made.
+  std::shared_ptr<const IModel> m_model;
 };
 
 } // end of namespace mageec
@@ -28,6 +28,9 @@
 
 #include <array>
 #include <cassert>
+#include <functional>
+#include <ostream>
+#include <string>
 #include <vector>
 
 namespace mageec {
@@ -189,6 +192,21 @@ unsigned read16LE(std::vector<uint8_t>::const_iterator &it);
 /// \brief Write a 16-bit little endian value to the end of a byte vector
 void write16LE(std::vector<uint8_t> &buf, unsigned value);
 
+/// \brief Read a 32-bit little endian value from a byte vector, advancing
+/// the iterator in the process.
+///
+/// It is assumed that the end of the iterator will not be encountered
+/// when reading the value.
+///
+/// \param it Iterator to read the 32-bit value from. This iterator will be
+/// advanced by 4 bytes during the read
+///
+/// \return The 32-bit value extracted from the buffer
+uint32_t read32LE(std::vector<uint8_t>::const_iterator &it);
+
+/// \brief Write a 32-bit little endian value to the end of a byte vector
+void write32LE(std::vector<uint8_t> &buf, uint32_t value);
+
 /// \brief Read a 64-bit little endian value from a byte vector, advancing
 /// the iterator in the process.
 ///
@@ -210,7 +228,30 @@ void write64LE(std::vector<uint8_t> &buf, uint64_t value);
 /// \param len Length of the buffer in bytes
 ///
 /// \return The crc64 for the buffer
-uint64_t crc64(uint8_t *message, unsigned len);
+uint64_t crc64(const uint8_t *message, unsigned len);
+
+/// \brief Continue a crc64 calculation over another blob of data
+///
+/// The crc64 of the concatenation of several blobs may be calculated by
+/// passing the result for each blob in to the call for the next.
+///
+/// \param crc  The crc64 of the preceding data, or 0 if there is none
+/// \param message Buffer containing the blob of data
+/// \param len Length of the buffer in bytes
+///
+/// \return The crc64 of the preceding data followed by the buffer
+uint64_t crc64Update(uint64_t crc, const uint8_t *message, unsigned len);
+
+/// \brief Calculate the SHA-256 digest of a blob of data
+///
+/// Unlike crc64, this is strong enough that distinct blobs can be assumed
+/// to have distinct digests.
+///
+/// \param message Buffer containing the blob of data
+/// \param len Length of the buffer in bytes
+///
+/// \return The 32 byte digest of the buffer
+std::array<uint8_t, 32> sha256(const uint8_t *message, size_t len);
 
 /// \brief Get the full, canonical path for a given file
 ///
@@ -220,6 +261,20 @@ std::string getFullPath(std::string filename);
 /// \brief Get the basename of a file for a given path
 std::string getBaseName(std::string filename);
 
+/// \brief Call a function once for each index in [0, count), spreading the
+/// calls over a pool of worker threads
+///
+/// Indices are handed out to the workers in ascending order, and the call
+/// returns once every index has been processed. The function must be safe to
+/// call concurrently for distinct indices.
+///
+/// \param count Number of indices to call the function for
+/// \param jobs Maximum number of threads to use. 0 uses one thread per
+/// hardware thread, 1 makes every call on the calling thread.
+/// \param fn Function to call with each index
+void parallelFor(unsigned count, unsigned jobs,
+                 const std::function<void(unsigned)> &fn);
+
 } // end of namespace util
 } // end of namespace mageec
 
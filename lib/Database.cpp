@@ -61,6 +61,14 @@ static const char *const create_feature_type_table =
     "feature_type INTEGER NOT NULL"
     ")";
 
+// The set tables are also added when upgrading a database, which other
+// processes may be doing at the same time.
+static const char *const create_feature_set_table =
+    "CREATE TABLE IF NOT EXISTS FeatureSet("
+    "feature_set_id INTEGER PRIMARY KEY, "
+    "digest         BLOB NOT NULL UNIQUE"
+    ")";
+
 static const char *const create_feature_set_feature_table =
     "CREATE TABLE FeatureSetFeature("
     "feature_set_id INTEGER NOT NULL, "
@@ -77,6 +85,12 @@ static const char *const create_parameter_type_table =
     "parameter_type INTEGER NOT NULL"
     ")";
 
+static const char *const create_parameter_set_table =
+    "CREATE TABLE IF NOT EXISTS ParameterSet("
+    "parameter_set_id INTEGER PRIMARY KEY, "
+    "digest           BLOB NOT NULL UNIQUE"
+    ")";
+
 static const char *const create_parameter_set_parameter_table =
     "CREATE TABLE ParameterSetParameter("
     "parameter_set_id INTEGER NOT NULL, "
@@ -143,11 +157,33 @@ static const char *const create_parameter_debug_table =
     "FOREIGN KEY(parameter_id) REFERENCES ParameterType(parameter_id)"
     ")";
 
+// index creation strings, for the access paths of training and garbage
+// collection
+static const char *const create_indexes[] = {
+    // Selection of the results of a feature class for training, in
+    // compilation order. Each result is then found through the unique
+    // constraint of the result table.
+    "CREATE INDEX IF NOT EXISTS CompilationFeatureClass "
+    "ON Compilation(feature_class_id, compilation_id, feature_set_id, "
+                   "parameter_set_id)",
+    // Selection of the values of parameters of a type
+    "CREATE INDEX IF NOT EXISTS ParameterTypeType "
+    "ON ParameterType(parameter_type, parameter_id)",
+    "CREATE INDEX IF NOT EXISTS ParameterSetParameterValue "
+    "ON ParameterSetParameter(parameter_id, value)",
+    // Garbage collection of unreferenced feature and parameter sets
+    "CREATE INDEX IF NOT EXISTS CompilationFeatureSet "
+    "ON Compilation(feature_set_id)",
+    "CREATE INDEX IF NOT EXISTS CompilationParameterSet "
+    "ON Compilation(parameter_set_id)",
+};
+
 //===-------------------- Database implementation -------------------------===//
 
 std::unique_ptr<Database>
 Database::createDatabase(std::string db_path,
-                         std::map<std::string, IMachineLearner *> mls) {
+                         std::map<std::string, IMachineLearner *> mls,
+                         const DatabaseOptions &options) {
   // Fail if the file already exists
   std::ifstream f(db_path.c_str());
   if (f.good()) {
@@ -164,12 +200,13 @@ Database::createDatabase(std::string db_path,
     sqlite3_close(db);
     return nullptr;
   }
-  return std::unique_ptr<Database>(new Database(*db, mls, true));
+  return std::unique_ptr<Database>(new Database(*db, mls, true, options));
 }
 
 std::unique_ptr<Database>
 Database::loadDatabase(std::string db_path,
-                       std::map<std::string, IMachineLearner *> mls) {
+                       std::map<std::string, IMachineLearner *> mls,
+                       const DatabaseOptions &options) {
   // Fail if the file does not already exist
   std::ifstream f(db_path.c_str());
   if (!f.good()) {
@@ -186,29 +223,30 @@ Database::loadDatabase(std::string db_path,
     sqlite3_close(db);
     return nullptr;
   }
-  return std::unique_ptr<Database>(new Database(*db, mls, false));
+  return std::unique_ptr<Database>(new Database(*db, mls, false, options));
 }
 
 std::unique_ptr<Database>
 Database::getDatabase(std::string db_path,
-                      std::map<std::string, IMachineLearner *> mls) {
+                      std::map<std::string, IMachineLearner *> mls,
+                      const DatabaseOptions &options) {
   // First try and load the database, if that fails try and create it
   std::unique_ptr<Database> db;
   MAGEEC_DEBUG("Loading database '" << db_path << "'");
-  db = loadDatabase(db_path, mls);
+  db = loadDatabase(db_path, mls, options);
   if (db) {
     MAGEEC_DEBUG("Database '" << db_path << "' loaded");
     return db;
   }
   MAGEEC_DEBUG("Cannot load database, creating new database...");
-  db = createDatabase(db_path, mls);
+  db = createDatabase(db_path, mls, options);
   MAGEEC_DEBUG("Database '" << db_path << "'created");
   return db;
 }
 
 Database::Database(sqlite3 &db, std::map<std::string, IMachineLearner *> mls,
-                   bool create)
-    : m_db(&db), m_mls(mls) {
+                   bool create, const DatabaseOptions &options)
+    : m_db(&db), m_with_wal(false), m_mls(mls) {
   // Set a busy timeout for all database transactions of 3 hours
   sqlite3_busy_timeout(m_db, 10000000);
 
@@ -217,25 +255,13 @@ Database::Database(sqlite3 &db, std::map<std::string, IMachineLearner *> mls,
   // foreign key checking will do done.
   SQLQuery(*m_db, "PRAGMA foreign_keys = ON").exec().assertDone();
 
-  // The MEMORY journaling mode stores the rollback journal in volatile RAM.
-  // This saves disk I/O but at the expense of database safety and integrity.
-  // If the application using SQLite crashes in the middle of a transaction
-  // when the MEMORY journaling mode is set, then the database file will very
-  // likely go corrupt.
-  //
-  // For now we use a memory rollback journal, as it improves performance when
-  // we have lots of small transactions and short-lived journals. This WILL
-  // corrupt the database if we crash mid transaction. If this proves to
-  // be a problem in future, then we may want to move to something like
-  // PERSIST instead, which is higher performance that the default (DELETE),
-  // and also preserves safety.
-  SQLQuery(*m_db, "PRAGMA journal_mode = MEMORY").exec().next().assertDone();
+  configure(options);
 
   if (create) {
     init_db(*m_db);
     validate();
   } else {
-    if (!isCompatible()) {
+    if (!isCompatible() && !upgrade()) {
       // TODO: trigger exception
       assert(0 && "Loaded incompatible database");
     }
@@ -244,6 +270,14 @@ Database::Database(sqlite3 &db, std::map<std::string, IMachineLearner *> mls,
 }
 
 Database::~Database(void) {
+  if (m_with_wal) {
+    // Move as much of the log into the database as can be done without
+    // waiting on any other connection. This keeps the log short when many
+    // short-lived processes write to the database, without stalling any of
+    // them.
+    sqlite3_wal_checkpoint_v2(m_db, nullptr, SQLITE_CHECKPOINT_PASSIVE,
+                              nullptr, nullptr);
+  }
   int res = sqlite3_close(m_db);
   if (res != SQLITE_OK) {
     MAGEEC_DEBUG("Unable to close mageec database:\n" << sqlite3_errmsg(m_db));
@@ -251,6 +285,71 @@ Database::~Database(void) {
   assert(res == SQLITE_OK && "Unable to close mageec database!");
 }
 
+void Database::configure(const DatabaseOptions &options) {
+  // A database which already uses a write-ahead log keeps using it, as
+  // switching back to a rollback journal would block on, or break, other
+  // processes using the log.
+  std::string journal_mode;
+  {
+    SQLQuery get_journal_mode(*m_db, "PRAGMA journal_mode");
+    auto res = get_journal_mode.exec();
+    assert(!res.done() && res.numColumns() == 1);
+    journal_mode = res.getText(0);
+  }
+
+  if (options.with_wal || journal_mode == "wal") {
+    SQLQuery set_journal_mode(*m_db, "PRAGMA journal_mode = WAL");
+    auto res = set_journal_mode.exec();
+    assert(!res.done() && res.numColumns() == 1);
+    m_with_wal = (res.getText(0) == "wal");
+    if (!m_with_wal) {
+      MAGEEC_WARN("Unable to enable the write-ahead log, using the '"
+                  << res.getText(0) << "' journal mode instead");
+    }
+  }
+
+  if (m_with_wal) {
+    // With a write-ahead log, NORMAL synchronization cannot corrupt the
+    // database, and only syncs the log when it is checkpointed rather than
+    // on every commit.
+    SQLQuery(*m_db, "PRAGMA synchronous = NORMAL").exec().assertDone();
+
+    // Commits checkpoint the log once it grows past this many pages. These
+    // checkpoints are passive, so they never wait on readers or writers. The
+    // log file is truncated after a checkpoint so it does not stay at its
+    // largest size.
+    SQLQuery(*m_db, "PRAGMA wal_autocheckpoint = " +
+                        std::to_string(options.wal_autocheckpoint))
+        .exec().next().assertDone();
+    SQLQuery(*m_db, "PRAGMA journal_size_limit = 67108864")
+        .exec().next().assertDone();
+  } else {
+    // The MEMORY journaling mode stores the rollback journal in volatile
+    // RAM. This saves disk I/O but at the expense of database safety and
+    // integrity. If the application using SQLite crashes in the middle of a
+    // transaction when the MEMORY journaling mode is set, then the database
+    // file will very likely go corrupt.
+    //
+    // For now we use a memory rollback journal, as it improves performance
+    // when we have lots of small transactions and short-lived journals. This
+    // WILL corrupt the database if we crash mid transaction. Databases which
+    // are written by many processes at once should use a write-ahead log
+    // instead.
+    SQLQuery(*m_db, "PRAGMA journal_mode = MEMORY").exec().next().assertDone();
+  }
+
+  if (options.cache_size_kib != 0) {
+    // A negative cache size is in KiB rather than pages
+    SQLQuery(*m_db, "PRAGMA cache_size = -" +
+                        std::to_string(options.cache_size_kib))
+        .exec().assertDone();
+  }
+  if (options.mmap_size != 0) {
+    SQLQuery(*m_db, "PRAGMA mmap_size = " + std::to_string(options.mmap_size))
+        .exec().next().assertDone();
+  }
+}
+
 void Database::init_db(sqlite3 &db) {
   // Create the entire database in a single transaction
   SQLTransaction transaction(&db);
@@ -261,10 +360,12 @@ void Database::init_db(sqlite3 &db) {
 
   // Create tables to hold features
   SQLQuery(db, create_feature_type_table).exec().assertDone();
+  SQLQuery(db, create_feature_set_table).exec().assertDone();
   SQLQuery(db, create_feature_set_feature_table).exec().assertDone();
 
   // Tables to hold parameters
   SQLQuery(db, create_parameter_type_table).exec().assertDone();
+  SQLQuery(db, create_parameter_set_table).exec().assertDone();
   SQLQuery(db, create_parameter_set_parameter_table).exec().assertDone();
 
   // Compilation
@@ -281,6 +382,9 @@ void Database::init_db(sqlite3 &db) {
   SQLQuery(db, create_feature_debug_table).exec().assertDone();
   SQLQuery(db, create_parameter_debug_table).exec().assertDone();
 
+  // Indexes
+  createIndexes(db);
+
   // Manually insert the version into the metadata table
   SQLQuery query =
       SQLQueryBuilder(db)
@@ -300,231 +404,411 @@ void Database::init_db(sqlite3 &db) {
   MAGEEC_DEBUG("Empty database created");
 }
 
-bool Database::appendDatabase(Database &other) {
-  assert(this->isCompatible());
-  assert(other.isCompatible());
+void Database::createIndexes(sqlite3 &db) {
+  MAGEEC_DEBUG("Creating database indexes");
+  for (const char *create_index : create_indexes) {
+    SQLQuery(db, create_index).exec().assertDone();
+  }
+}
 
-  // TODO: Merge metadata
-  // Nothing to merge at the moment
-  MAGEEC_DEBUG("Merging metadata");
+bool Database::upgrade(void) {
+  util::Version db_version = getVersion();
+  if (db_version.getMajor() != Database::version.getMajor() ||
+      db_version.getMinor() > Database::version.getMinor()) {
+    return false;
+  }
 
-  // Merge feature type tables
-  // TODO: This could be done more efficiently with "ATTACH"
-  MAGEEC_DEBUG("Merging feature types and debug");
-  SQLQuery select_feature_types(*other.m_db,
-      "SELECT feature_id, feature_type FROM FeatureType");
-  SQLQuery insert_feature_types =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO FeatureType(feature_id, feature_type) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ")";
-  for (auto res = select_feature_types.exec(); !res.done(); res = res.next()) {
-    assert(res.numColumns() == 2);
-    // Ignore duplicate feature_id rows
-    insert_feature_types.clearAllBindings();
-    insert_feature_types << res.getInteger(0);
-    insert_feature_types << res.getInteger(1);
-    insert_feature_types.exec().assertDone();
+  // Each step upgrades the database from one minor version to the next. All
+  // of the steps are applied in a single transaction, so an interrupted
+  // upgrade leaves the database at its original version.
+  SQLTransaction transaction(m_db, SQLTransaction::kExclusive);
+
+  // Another process opening the database may have upgraded it while this
+  // one waited for the lock.
+  db_version = getVersion();
+  if (db_version == Database::version) {
+    transaction.commit();
+    return true;
   }
-  // Merge feature debug tables
-  SQLQuery select_feature_debug(*other.m_db,
-      "SELECT feature_id, name FROM FeatureDebug");
-  SQLQuery insert_feature_debug =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO FeatureDebug(feature_id, name) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kText << ")";
-  for (auto res = select_feature_debug.exec(); !res.done(); res = res.next()) {
-    assert(res.numColumns() == 2);
-    insert_feature_debug.clearAllBindings();
-    insert_feature_debug << res.getInteger(0);
-    insert_feature_debug << res.getText(1);
-    insert_feature_debug.exec().assertDone();
+  MAGEEC_STATUS("Upgrading database from version "
+                << std::string(db_version) << " to "
+                << std::string(Database::version));
+
+  if (db_version.getMinor() < 1) {
+    // Version 1.0 identified feature and parameter sets by their crc64 hash
+    // alone.
+    addSetDigests();
   }
-  // Merge parameter type tables
-  MAGEEC_DEBUG("Merging parameter types and debug");
-  SQLQuery select_param_types(*other.m_db,
-      "SELECT parameter_id, parameter_type FROM ParameterType");
-  SQLQuery insert_param_types =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO ParameterType(parameter_id, parameter_type) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ")";
-  for (auto res = select_param_types.exec(); !res.done(); res = res.next()) {
-    assert(res.numColumns() == 2);
-    insert_param_types.clearAllBindings();
-    insert_param_types << res.getInteger(0);
-    insert_param_types << res.getInteger(1);
-    insert_param_types.exec().assertDone();
+  if (db_version.getMinor() < 2) {
+    // Version 1.1 had no indexes beyond those of its unique constraints.
+    createIndexes(*m_db);
   }
-  // Merge parameter debug tables
-  SQLQuery select_param_debug(*other.m_db,
-      "SELECT parameter_id, name FROM ParameterDebug");
-  SQLQuery insert_param_debug =
+
+  SQLQuery update_version =
       SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO ParameterDebug(parameter_id, name) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kText << ")";
-  for (auto res = select_param_debug.exec(); !res.done(); res = res.next()) {
-    assert(res.numColumns() == 2);
-    insert_param_debug.clearAllBindings();
-    insert_param_debug << res.getInteger(0);
-    insert_param_debug << res.getText(1);
-    insert_param_debug.exec().assertDone();
-  }
+      << "UPDATE Metadata SET value = " << SQLType::kText
+      << " WHERE field = " << SQLType::kInteger;
+  update_version << std::string(Database::version)
+                 << static_cast<int64_t>(MetadataField::kDatabaseVersion);
+  update_version.exec().assertDone();
+
+  transaction.commit();
+  return isCompatible();
+}
 
-  std::map<FeatureSetID,   FeatureSetID>   feature_set_id_remapping;
-  std::map<ParameterSetID, ParameterSetID> parameter_set_id_remapping;
-  std::map<CompilationID,  CompilationID>  compilation_id_remapping;
+void Database::addSetDigests(void) {
+  // Add the digest tables, keeping the existing identifiers so that
+  // compilations still refer to the same sets. Every set referenced by a
+  // compilation is given a digest, including empty sets, which have no
+  // features or parameters.
+  SQLQuery(*m_db, create_feature_set_table).exec().assertDone();
+  SQLQuery(*m_db, create_parameter_set_table).exec().assertDone();
 
-  // For each feature set, get the feature set id and the features from the
-  // database to be merged. Add to the new feature set, and store the
-  // remapping.
-  MAGEEC_DEBUG("Merging features");
-  SQLQuery select_feature_set_id(*other.m_db,
-      "SELECT feature_set_id FROM FeatureSetFeature");
+  SQLQuery insert_feature_set =
+      SQLQueryBuilder(*m_db)
+      << "INSERT OR IGNORE INTO FeatureSet(feature_set_id, digest) "
+         "VALUES (" << SQLType::kInteger << ", " << SQLType::kBlob << ")";
   std::vector<FeatureSetID> feature_set_ids;
-  for (auto res = select_feature_set_id.exec(); !res.done(); res = res.next()) {
+  SQLQuery select_feature_set_ids(*m_db,
+      "SELECT feature_set_id FROM FeatureSetFeature "
+      "UNION SELECT feature_set_id FROM Compilation");
+  for (auto res = select_feature_set_ids.exec(); !res.done();
+       res = res.next()) {
     assert(res.numColumns() == 1);
     feature_set_ids.push_back(static_cast<FeatureSetID>(res.getInteger(0)));
   }
   for (auto id : feature_set_ids) {
-    FeatureSet features = other.getFeatureSetFeatures(id);
-    FeatureSetID new_id = this->newFeatureSet(features);
-    feature_set_id_remapping.emplace(id, new_id);
+    insert_feature_set.clearAllBindings();
+    insert_feature_set << static_cast<int64_t>(id)
+                       << getFeatureSetFeatures(id).digest();
+    insert_feature_set.exec().assertDone();
   }
 
-  // For each parameter set, get the parameter set id and the parametes from the
-  // database to be merged. Add to the new parameter set, and store the
-  // remapping.
-  MAGEEC_DEBUG("Merging parameters");
-  SQLQuery select_param_set_id(*other.m_db,
-      "SELECT parameter_set_id FROM ParameterSetParameter");
+  SQLQuery insert_parameter_set =
+      SQLQueryBuilder(*m_db)
+      << "INSERT OR IGNORE INTO ParameterSet(parameter_set_id, digest) "
+         "VALUES (" << SQLType::kInteger << ", " << SQLType::kBlob << ")";
   std::vector<ParameterSetID> parameter_set_ids;
-  for (auto res = select_param_set_id.exec(); !res.done(); res = res.next()) {
+  SQLQuery select_parameter_set_ids(*m_db,
+      "SELECT parameter_set_id FROM ParameterSetParameter "
+      "UNION SELECT parameter_set_id FROM Compilation "
+      "WHERE parameter_set_id IS NOT NULL");
+  for (auto res = select_parameter_set_ids.exec(); !res.done();
+       res = res.next()) {
     assert(res.numColumns() == 1);
-    parameter_set_ids.push_back(static_cast<ParameterSetID>(res.getInteger(0)));
+    parameter_set_ids.push_back(
+        static_cast<ParameterSetID>(res.getInteger(0)));
   }
   for (auto id : parameter_set_ids) {
-    auto parameters = other.getParameters(id);
-    auto new_id = this->newParameterSet(parameters);
-    parameter_set_id_remapping.emplace(id, new_id);
+    insert_parameter_set.clearAllBindings();
+    insert_parameter_set << static_cast<int64_t>(id)
+                         << getParameters(id).digest();
+    insert_parameter_set.exec().assertDone();
   }
+}
 
-  // For each compilation id, get the compilation id and compilation
-  // Update the feature set id and parameter set id insert into the
-  // database and store the compilation id remapping
-  MAGEEC_DEBUG("Merging compilations");
-  SQLQuery select_compilation(*other.m_db,
-      "SELECT Compilation.compilation_id, Compilation.feature_set_id, "
-             "Compilation.feature_class_id, "
-             "Compilation.parameter_set_id, "
-             "CompilationDebug.name, CompilationDebug.type, "
-             "CompilationDebug.command, CompilationDebug.parent_id "
-      "FROM Compilation, CompilationDebug "
-      "WHERE Compilation.compilation_id = CompilationDebug.compilation_id");
-
-  SQLQuery insert_compilation =
-      SQLQueryBuilder(*m_db)
-      << "INSERT INTO Compilation(feature_set_id, feature_class_id, "
-                                 "parameter_set_id) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ", "
-                    << SQLType::kInteger << ")";
-  SQLQuery insert_compilation_debug =
-      SQLQueryBuilder(*m_db)
-      << "INSERT INTO CompilationDebug(compilation_id, name, type, command, "
-                                      "parent_id) "
-         "VALUES (" << SQLType::kInteger << ", "
-                    << SQLType::kText << ", "
-                    << SQLType::kText << ", "
-                    << SQLType::kText << ", "
-                    << SQLType::kInteger << ")";
-  {
-    // Insert all compilations in one big transaction
-    SQLTransaction compilation_transaction(m_db);
-    for (auto res = select_compilation.exec(); !res.done(); res = res.next()) {
-      assert(res.numColumns() == 8);
-      auto compilation_id   = static_cast<CompilationID>(res.getInteger(0));
-      auto feature_set_id   = static_cast<FeatureSetID>(res.getInteger(1));
-      auto feature_class    = static_cast<FeatureClass>(res.getInteger(2));
-      auto parameter_set_id = static_cast<ParameterSetID>(res.getInteger(3));
-      auto name = res.getText(4);
-      auto type = res.getText(5);
-      util::Option<std::string> command;
-      if (!res.isNull(6))
-        command = res.getText(6);
-      util::Option<CompilationID> parent;
-      if (!res.isNull(7))
-        parent = static_cast<CompilationID>(res.getInteger(7));
-
-      // Update to point at the newly inserted features and parameters
-      auto new_feature_set_id   = feature_set_id_remapping[feature_set_id];
-      auto new_parameter_set_id = parameter_set_id_remapping[parameter_set_id];
-
-      insert_compilation.clearAllBindings();
-      insert_compilation << static_cast<int64_t>(new_feature_set_id);
-      insert_compilation << static_cast<int64_t>(feature_class);
-      insert_compilation << static_cast<int64_t>(new_parameter_set_id);
-      insert_compilation.exec().assertDone();
-
-      auto new_compilation_id =
-          static_cast<CompilationID>(sqlite3_last_insert_rowid(m_db));
-
-      insert_compilation_debug.clearAllBindings();
-      insert_compilation_debug << static_cast<int64_t>(new_compilation_id);
-      insert_compilation_debug << name;
-      insert_compilation_debug << type;
-      if (command)
-        insert_compilation_debug << command.get();
-      else
-        insert_compilation_debug << nullptr;
-      if (parent)
-        insert_compilation_debug << static_cast<int64_t>(parent.get());
-      else
-        insert_compilation_debug << nullptr;
-      insert_compilation_debug.exec().assertDone();
-
-      // Store the remapping between the compilation ids
-      compilation_id_remapping.emplace(compilation_id, new_compilation_id);
+/// \brief Build the query which selects the features of a feature set
+static SQLQuery buildSelectFeatures(sqlite3 &db) {
+  return SQLQueryBuilder(db)
+         << "SELECT FeatureSetFeature.feature_id, FeatureType.feature_type, "
+                   "FeatureSetFeature.value "
+            "FROM FeatureType, FeatureSetFeature "
+            "WHERE FeatureType.feature_id = FeatureSetFeature.feature_id "
+              "AND FeatureSetFeature.feature_set_id = " << SQLType::kInteger;
+}
+
+/// \brief Retrieve the features of a feature set
+///
+/// \param select_features Query built by buildSelectFeatures, which may be
+/// reused for many feature sets.
+static FeatureSet readFeatureSet(SQLQuery &select_features,
+                                 FeatureSetID feature_set) {
+  FeatureSet features;
+  select_features.clearAllBindings();
+  select_features << static_cast<int64_t>(feature_set);
+  for (auto feature_iter = select_features.exec(); !feature_iter.done();
+       feature_iter = feature_iter.next()) {
+    assert(feature_iter.numColumns() == 3);
+
+    unsigned feature_id =
+        static_cast<unsigned>(feature_iter.getInteger(0));
+    FeatureType feature_type =
+        static_cast<FeatureType>(feature_iter.getInteger(1));
+    auto feature_blob = feature_iter.getBlob(2);
+
+    // TODO: Also retrieve feature names
+    switch (feature_type) {
+    case FeatureType::kBool:
+      features.add(BoolFeature::fromBlob(feature_id, feature_blob, {}));
+      break;
+    case FeatureType::kInt:
+      features.add(IntFeature::fromBlob(feature_id, feature_blob, {}));
+      break;
     }
-    compilation_transaction.commit();
   }
+  return features;
+}
+
+/// \brief Build the query which selects the parameters of a parameter set
+static SQLQuery buildSelectParameters(sqlite3 &db) {
+  return SQLQueryBuilder(db)
+         << "SELECT ParameterSetParameter.parameter_id, "
+                   "ParameterType.parameter_type, "
+                   "ParameterSetParameter.value "
+            "FROM ParameterType, ParameterSetParameter "
+            "WHERE ParameterType.parameter_id = "
+                  "ParameterSetParameter.parameter_id "
+              "AND ParameterSetParameter.parameter_set_id = "
+         << SQLType::kInteger;
+}
+
+/// \brief Retrieve the parameters of a parameter set
+///
+/// \param select_parameters Query built by buildSelectParameters, which may
+/// be reused for many parameter sets.
+static ParameterSet readParameterSet(SQLQuery &select_parameters,
+                                     ParameterSetID param_set) {
+  ParameterSet parameters;
+  select_parameters.clearAllBindings();
+  select_parameters << static_cast<int64_t>(param_set);
+  for (auto param_iter = select_parameters.exec(); !param_iter.done();
+       param_iter = param_iter.next()) {
+    assert(param_iter.numColumns() == 3);
+
+    unsigned param_type_id = static_cast<unsigned>(param_iter.getInteger(0));
+    ParameterType param_type =
+        static_cast<ParameterType>(param_iter.getInteger(1));
+    auto param_blob = param_iter.getBlob(2);
 
+    // TODO: Also retrieve parameter names
+    switch (param_type) {
+    case ParameterType::kBool:
+      parameters.add(BoolParameter::fromBlob(param_type_id, param_blob, {}));
+      break;
+    case ParameterType::kRange:
+      parameters.add(RangeParameter::fromBlob(param_type_id, param_blob, {}));
+      break;
+    case ParameterType::kPassSeq:
+      parameters.add(PassSeqParameter::fromBlob(param_type_id, param_blob, {}));
+      break;
+    }
+  }
+  return parameters;
+}
 
+/// \brief Statements which merge the attached database 'other' into the main
+/// database, which do not depend upon any identifiers being remapped.
+static const char *const merge_types[] = {
+    "INSERT OR IGNORE INTO main.FeatureType(feature_id, feature_type) "
+    "SELECT feature_id, feature_type FROM other.FeatureType",
+    "INSERT OR IGNORE INTO main.FeatureDebug(feature_id, name) "
+    "SELECT feature_id, name FROM other.FeatureDebug",
+    "INSERT OR IGNORE INTO main.ParameterType(parameter_id, parameter_type) "
+    "SELECT parameter_id, parameter_type FROM other.ParameterType",
+    "INSERT OR IGNORE INTO main.ParameterDebug(parameter_id, name) "
+    "SELECT parameter_id, name FROM other.ParameterDebug",
+};
+
+/// \brief Statements which merge the feature and parameter sets of the
+/// attached database 'other' into the main database.
+///
+/// Sets are matched by their digest, so a set which is already present is
+/// not added again. The mapping from the identifier of each set in 'other'
+/// to its identifier in the main database is left in a temporary table.
+static const char *const merge_sets[] = {
+    "INSERT OR IGNORE INTO main.FeatureSet(digest) "
+    "SELECT digest FROM other.FeatureSet ORDER BY feature_set_id",
+    "CREATE TEMP TABLE FeatureSetRemap("
+    "old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL)",
+    "INSERT INTO temp.FeatureSetRemap(old_id, new_id) "
+    "SELECT other.FeatureSet.feature_set_id, main.FeatureSet.feature_set_id "
+    "FROM other.FeatureSet, main.FeatureSet "
+    "WHERE main.FeatureSet.digest = other.FeatureSet.digest",
+    "INSERT OR IGNORE INTO main.ParameterSet(digest) "
+    "SELECT digest FROM other.ParameterSet ORDER BY parameter_set_id",
+    "CREATE TEMP TABLE ParameterSetRemap("
+    "old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL)",
+    "INSERT INTO temp.ParameterSetRemap(old_id, new_id) "
+    "SELECT other.ParameterSet.parameter_set_id, "
+           "main.ParameterSet.parameter_set_id "
+    "FROM other.ParameterSet, main.ParameterSet "
+    "WHERE main.ParameterSet.digest = other.ParameterSet.digest",
+};
+
+/// \brief Get the largest value of an identifier column, or 0 if the table is
+/// empty
+static int64_t getMaxID(sqlite3 &db, const char *column, const char *table) {
+  SQLQuery query(db, std::string("SELECT IFNULL(MAX(") + column + "), 0) "
+                     "FROM main." + table);
+  auto res = query.exec();
+  assert(!res.done() && res.numColumns() == 1);
+  int64_t max_id = res.getInteger(0);
+  res.next().assertDone();
+  return max_id;
+}
 
-  // Extract, update and reinsert the results data
-  MAGEEC_DEBUG("Merging results");
-  SQLQuery select_results(*other.m_db,
-      "SELECT compilation_id, metric, result FROM Result");
-  std::map<std::pair<CompilationID, std::string>, double> new_results;
-  for (auto res = select_results.exec(); !res.done(); res = res.next()) {
-    assert(res.numColumns() == 3);
-    auto compilation_id = static_cast<CompilationID>(res.getInteger(0));
-    auto metric = res.getText(1);
-    auto result = static_cast<double>(res.getReal(2));
+bool Database::appendDatabase(Database &other) {
+  assert(this->isCompatible());
+  assert(other.isCompatible());
 
-    // Remap the compilation id
-    auto new_compilation_id = compilation_id_remapping[compilation_id];
-    new_results.emplace(std::make_pair(new_compilation_id, metric), result);
+  // The other database is attached to this connection, so that it can be
+  // merged with set based statements rather than an item at a time.
+  const char *other_path = sqlite3_db_filename(other.m_db, "main");
+  if (!other_path || other_path[0] == '\0') {
+    MAGEEC_ERR("Cannot append a database which is not held in a file");
+    return false;
   }
-  addResults(new_results);
-
-  // Copy across the machine learner training blob, ignore blobs which
-  // already exist
-  MAGEEC_DEBUG("Merging machine learners");
-  SQLQuery select_ml(*other.m_db,
-      "SELECT ml_id, feature_class_id, metric, ml_blob FROM MachineLearner");
-  SQLQuery insert_ml =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO MachineLearner(ml_id, feature_class_id, "
-                                              "metric, ml_blob) "
-         "VALUES (" << SQLType::kText << ", " << SQLType::kInteger << ", "
-                    << SQLType::kText << ", " << SQLType::kBlob << ")";
-  for (auto res = select_ml.exec(); !res.done(); res = res.next()) {
-    assert(res.numColumns() == 4);
-    insert_ml.clearAllBindings();
-    insert_ml << res.getText(0);
-    insert_ml << res.getInteger(1);
-    insert_ml << res.getText(2);
-    insert_ml << res.getBlob(3);
-    insert_ml.exec().assertDone();
+  {
+    SQLQuery attach =
+        SQLQueryBuilder(*m_db) << "ATTACH DATABASE " << SQLType::kText
+                               << " AS other";
+    attach << std::string(other_path);
+    attach.exec().assertDone();
+  }
+
+  {
+    SQLTransaction transaction(m_db, SQLTransaction::kExclusive);
+
+    // TODO: Merge metadata
+    // Nothing to merge at the moment
+    MAGEEC_DEBUG("Merging metadata");
+
+    MAGEEC_DEBUG("Merging feature and parameter types and debug");
+    for (auto query_str : merge_types) {
+      SQLQuery(*m_db, query_str).exec().assertDone();
+    }
+
+    // Sets with an identifier above the current largest identifier are new,
+    // and so their features and parameters must be copied.
+    MAGEEC_DEBUG("Merging features and parameters");
+    int64_t max_feature_set_id =
+        getMaxID(*m_db, "feature_set_id", "FeatureSet");
+    int64_t max_param_set_id =
+        getMaxID(*m_db, "parameter_set_id", "ParameterSet");
+    for (auto query_str : merge_sets) {
+      SQLQuery(*m_db, query_str).exec().assertDone();
+    }
+
+    SQLQuery insert_features =
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO main.FeatureSetFeature(feature_set_id, feature_id, "
+                                              "value) "
+           "SELECT temp.FeatureSetRemap.new_id, "
+                  "other.FeatureSetFeature.feature_id, "
+                  "other.FeatureSetFeature.value "
+           "FROM other.FeatureSetFeature, temp.FeatureSetRemap "
+           "WHERE temp.FeatureSetRemap.old_id = "
+                 "other.FeatureSetFeature.feature_set_id "
+             "AND temp.FeatureSetRemap.new_id > " << SQLType::kInteger;
+    insert_features << max_feature_set_id;
+    insert_features.exec().assertDone();
+
+    SQLQuery insert_parameters =
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO main.ParameterSetParameter(parameter_set_id, "
+                                                  "parameter_id, value) "
+           "SELECT temp.ParameterSetRemap.new_id, "
+                  "other.ParameterSetParameter.parameter_id, "
+                  "other.ParameterSetParameter.value "
+           "FROM other.ParameterSetParameter, temp.ParameterSetRemap "
+           "WHERE temp.ParameterSetRemap.old_id = "
+                 "other.ParameterSetParameter.parameter_set_id "
+             "AND temp.ParameterSetRemap.new_id > " << SQLType::kInteger;
+    insert_parameters << max_param_set_id;
+    insert_parameters.exec().assertDone();
+
+    // Compilations are all new, and are given identifiers offset past the
+    // current largest identifier. This keeps the identifiers of compilations
+    // which reference each other, and of results, easy to remap.
+    MAGEEC_DEBUG("Merging compilations");
+    int64_t compilation_offset =
+        getMaxID(*m_db, "compilation_id", "Compilation");
+
+    SQLQuery insert_compilations =
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO main.Compilation(compilation_id, feature_set_id, "
+                                        "feature_class_id, parameter_set_id) "
+           "SELECT other.Compilation.compilation_id + " << SQLType::kInteger
+        << ", temp.FeatureSetRemap.new_id, "
+             "other.Compilation.feature_class_id, "
+             "temp.ParameterSetRemap.new_id "
+           "FROM other.Compilation "
+           "JOIN temp.FeatureSetRemap "
+             "ON temp.FeatureSetRemap.old_id = "
+                "other.Compilation.feature_set_id "
+           "LEFT JOIN temp.ParameterSetRemap "
+             "ON temp.ParameterSetRemap.old_id = "
+                "other.Compilation.parameter_set_id";
+    insert_compilations << compilation_offset;
+    insert_compilations.exec().assertDone();
+
+    // A compilation whose feature set has no digest cannot be remapped, and
+    // so is not merged, along with its debug information and results.
+    SQLQuery count_skipped(*m_db,
+        "SELECT COUNT(*) FROM other.Compilation "
+        "WHERE feature_set_id NOT IN "
+          "(SELECT old_id FROM temp.FeatureSetRemap)");
+    int64_t num_skipped;
+    {
+      auto res = count_skipped.exec();
+      assert(!res.done() && res.numColumns() == 1);
+      num_skipped = res.getInteger(0);
+      res.next().assertDone();
+    }
+    if (num_skipped != 0) {
+      MAGEEC_WARN(num_skipped << " compilations were not merged, as their "
+                  "feature sets are missing from the appended database");
+    }
+
+    SQLQuery insert_compilation_debug =
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO main.CompilationDebug(compilation_id, name, type, "
+                                             "command, parent_id) "
+           "SELECT compilation_id + " << SQLType::kInteger << ", "
+                  "name, type, command, "
+                  "(SELECT compilation_id FROM main.Compilation "
+                   "WHERE compilation_id = parent_id + " << SQLType::kInteger
+        << ") "
+           "FROM other.CompilationDebug "
+           "WHERE EXISTS (SELECT 1 FROM main.Compilation "
+                         "WHERE main.Compilation.compilation_id = "
+                               "other.CompilationDebug.compilation_id + "
+        << SQLType::kInteger << ")";
+    insert_compilation_debug << compilation_offset << compilation_offset
+                             << compilation_offset;
+    insert_compilation_debug.exec().assertDone();
+
+    MAGEEC_DEBUG("Merging results");
+    SQLQuery insert_results =
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR REPLACE INTO main.Result(compilation_id, metric, "
+                                              "result) "
+           "SELECT compilation_id + " << SQLType::kInteger << ", "
+                  "metric, result "
+           "FROM other.Result "
+           "WHERE EXISTS (SELECT 1 FROM main.Compilation "
+                         "WHERE main.Compilation.compilation_id = "
+                               "other.Result.compilation_id + "
+        << SQLType::kInteger << ")";
+    insert_results << compilation_offset << compilation_offset;
+    insert_results.exec().assertDone();
+
+    // Copy across the machine learner training blob, ignore blobs which
+    // already exist
+    MAGEEC_DEBUG("Merging machine learners");
+    SQLQuery(*m_db,
+        "INSERT OR IGNORE INTO main.MachineLearner(ml_id, feature_class_id, "
+                                                  "metric, ml_blob) "
+        "SELECT ml_id, feature_class_id, metric, ml_blob "
+        "FROM other.MachineLearner").exec().assertDone();
+
+    SQLQuery(*m_db, "DROP TABLE temp.FeatureSetRemap").exec().assertDone();
+    SQLQuery(*m_db, "DROP TABLE temp.ParameterSetRemap").exec().assertDone();
+    transaction.commit();
   }
+
+  // Every query referencing the attached database must be finalized first
+  SQLQuery(*m_db, "DETACH DATABASE other").exec().assertDone();
   return true;
 }
 
@@ -603,12 +887,20 @@ void Database::garbageCollect() {
       "DELETE FROM FeatureSetFeature WHERE feature_set_id NOT IN "
              "(SELECT DISTINCT feature_set_id FROM Compilation)");
   gc_features.exec().assertDone();
+  SQLQuery gc_feature_sets(*m_db,
+      "DELETE FROM FeatureSet WHERE feature_set_id NOT IN "
+             "(SELECT DISTINCT feature_set_id FROM Compilation)");
+  gc_feature_sets.exec().assertDone();
 
   MAGEEC_DEBUG("Deleting unused parameters")
   SQLQuery gc_parameters(*m_db,
       "DELETE FROM ParameterSetParameter WHERE parameter_set_id NOT IN "
              "(SELECT DISTINCT parameter_set_id FROM Compilation)");
   gc_parameters.exec().assertDone();
+  SQLQuery gc_parameter_sets(*m_db,
+      "DELETE FROM ParameterSet WHERE parameter_set_id NOT IN "
+             "(SELECT DISTINCT parameter_set_id FROM Compilation)");
+  gc_parameter_sets.exec().assertDone();
 
   transaction.commit();
 }
@@ -646,180 +938,24 @@ void Database::setMetadata(MetadataField field, std::string value) {
 //===------------------- Feature extractor interface-----------------------===//
 
 FeatureSetID Database::newFeatureSet(FeatureSet features) {
-  SQLQuery get_feature_set =
-      SQLQueryBuilder(*m_db)
-      << "SELECT feature_set_id FROM FeatureSetFeature "
-         "WHERE feature_set_id = " << SQLType::kInteger;
-
-  // FIXME: This should check that the types are identical if a conflict
-  // arises
-  SQLQuery insert_feature_type =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO FeatureType(feature_id, feature_type) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ")";
-
-  SQLQuery insert_feature =
-      SQLQueryBuilder(*m_db)
-      << "INSERT INTO FeatureSetFeature(feature_set_id, feature_id, value) "
-      << "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ", "
-                    << SQLType::kBlob << ")";
-
-  // FIXME: This should check that the keys are identical if a conflict
-  // arises.
-  SQLQuery insert_feature_debug =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO FeatureDebug(feature_id, name) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kText << ")";
-
-  // The hash of the feature set forms its identifier in the database
-  FeatureSetID feature_set_id = static_cast<FeatureSetID>(features.hash());
-
-  // Do a first check to see if the same feature set already exists. If so
-  // we don't have to do any expensive probing
-  //
-  // If it doesn't exist, then we have to gain an exlusive lock to the database,
-  // do a linear probe for the next available id, and then insert the new
-  // feature set if it doesn't exist. This is really expensive.
-  get_feature_set << static_cast<int64_t>(feature_set_id);
-  bool feature_set_id_found = false;
-
-  if (!get_feature_set.exec().done()) {
-    // There is already a feature set with that id. Do a full check to
-    // see if it is equal
-    if (features == getFeatureSetFeatures(feature_set_id))
-      feature_set_id_found = true;
-  }
-
-  if (!feature_set_id_found) {
-    // The quick test did not find an equal feature set, so we now need
-    // to probe to either find an equal set, or find somewhere to insert
-    // the new feature set.
-    //
-    // The probe + insert must be done atomically without any other process
-    // writing to the database in the meantime, so we require an exclusive
-    // lock to the database.
-    SQLTransaction transaction(m_db, SQLTransaction::kExclusive);
+  BulkWriter writer(*this);
+  return writer.addFeatureSet(features);
+}
 
-    while (!feature_set_id_found) {
-      get_feature_set.clearAllBindings();
-      get_feature_set << static_cast<int64_t>(feature_set_id);
-      auto feature_iter = get_feature_set.exec();
-
-      if (feature_iter.done()) {
-        // The feature set does not already exist, and we have found a free
-        // identifier for it. Do the insertion now
-        for (auto I : features) {
-          // clear feature bindings for all queries
-          insert_feature_type.clearAllBindings();
-          insert_feature.clearAllBindings();
-          insert_feature_debug.clearAllBindings();
-
-          // Add feature type first if not present
-          insert_feature_type << static_cast<int64_t>(I->getID())
-                              << static_cast<int64_t>(I->getType());
-          insert_feature_type.exec().assertDone();
-
-          // feature insertion
-          insert_feature << static_cast<int64_t>(feature_set_id) 
-                         << static_cast<int64_t>(I->getID())
-                         << I->toBlob();
-          insert_feature.exec().assertDone();
-
-          // debug table
-          insert_feature_debug << static_cast<int64_t>(I->getID())
-                               << I->getName();
-          insert_feature_debug.exec().assertDone();
-        }
-        feature_set_id_found = true;
-      } else {
-        // Check if the feature set with the given id is equal. If it is
-        // we're done, otherwise continuing probing
-        if (features == getFeatureSetFeatures(feature_set_id)) {
-          feature_set_id_found = true;
-        } else {
-          mageec::ID tmp = static_cast<mageec::ID>(feature_set_id);
-          feature_set_id = static_cast<FeatureSetID>(tmp + 1);
-        }
-      }
-    }
-    transaction.commit();
-  }
-  return feature_set_id;
+std::vector<FeatureSetID>
+Database::newFeatureSets(const std::vector<FeatureSet> &feature_sets) {
+  BulkWriter writer(*this, 0);
+  return writer.addFeatureSets(feature_sets);
 }
 
 FeatureSet Database::getFeatureSetFeatures(FeatureSetID feature_set) {
-  // Get all of the features in a feature set
-  SQLQuery select_features =
-      SQLQueryBuilder(*m_db)
-      << "SELECT FeatureSetFeature.feature_id, FeatureType.feature_type, "
-                "FeatureSetFeature.value "
-         "FROM FeatureType, FeatureSetFeature "
-         "WHERE FeatureType.feature_id = FeatureSetFeature.feature_id "
-           "AND FeatureSetFeature.feature_set_id = " << SQLType::kInteger;
-
-  // Retrieve the features
-  FeatureSet features;
-  select_features << static_cast<int64_t>(feature_set);
-  for (auto feature_iter = select_features.exec(); !feature_iter.done();
-       feature_iter = feature_iter.next()) {
-    assert(feature_iter.numColumns() == 3);
-
-    unsigned feature_id =
-        static_cast<unsigned>(feature_iter.getInteger(0));
-    FeatureType feature_type =
-        static_cast<FeatureType>(feature_iter.getInteger(1));
-    auto feature_blob = feature_iter.getBlob(2);
-
-    // TODO: Also retrieve feature names
-    switch (feature_type) {
-    case FeatureType::kBool:
-      features.add(BoolFeature::fromBlob(feature_id, feature_blob, {}));
-      break;
-    case FeatureType::kInt:
-      features.add(IntFeature::fromBlob(feature_id, feature_blob, {}));
-      break;
-    }
-  }
-  return features;
+  SQLQuery select_features = buildSelectFeatures(*m_db);
+  return readFeatureSet(select_features, feature_set);
 }
 
 ParameterSet Database::getParameters(ParameterSetID param_set) {
-  // Get all of the parameters in a parameter set
-  SQLQuery select_parameters =
-      SQLQueryBuilder(*m_db)
-      << "SELECT ParameterSetParameter.parameter_id, "
-                "ParameterType.parameter_type, "
-                "ParameterSetParameter.value "
-         "FROM ParameterType, ParameterSetParameter "
-         "WHERE ParameterType.parameter_id = ParameterSetParameter.parameter_id "
-           "AND ParameterSetParameter.parameter_set_id = " << SQLType::kInteger;
-
-  // Retrieve parameters
-  ParameterSet parameters;
-  select_parameters << static_cast<int64_t>(param_set);
-  for (auto param_iter = select_parameters.exec(); !param_iter.done();
-       param_iter = param_iter.next()) {
-    assert(param_iter.numColumns() == 3);
-
-    unsigned param_type_id = static_cast<unsigned>(param_iter.getInteger(0));
-    ParameterType param_type =
-        static_cast<ParameterType>(param_iter.getInteger(1));
-    auto param_blob = param_iter.getBlob(2);
-
-    // TODO: Also retrieve parameter names
-    switch (param_type) {
-    case ParameterType::kBool:
-      parameters.add(BoolParameter::fromBlob(param_type_id, param_blob, {}));
-      break;
-    case ParameterType::kRange:
-      parameters.add(RangeParameter::fromBlob(param_type_id, param_blob, {}));
-      break;
-    case ParameterType::kPassSeq:
-      parameters.add(PassSeqParameter::fromBlob(param_type_id, param_blob, {}));
-      break;
-    }
-  }
-  return parameters;
+  SQLQuery select_parameters = buildSelectParameters(*m_db);
+  return readParameterSet(select_parameters, param_set);
 }
 
 //===----------------------- Compiler interface ---------------------------===//
@@ -830,206 +966,23 @@ CompilationID Database::newCompilation(std::string name, std::string type,
                                        ParameterSetID parameters,
                                        util::Option<std::string> command,
                                        util::Option<CompilationID> parent) {
-  SQLQuery insert_into_compilation =
-      SQLQueryBuilder(*m_db)
-      << "INSERT INTO Compilation(feature_set_id, feature_class_id, "
-                                 "parameter_set_id) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ", "
-                    << SQLType::kInteger << ")";
-
-  SQLQuery insert_compilation_debug =
-      SQLQueryBuilder(*m_db)
-      << "INSERT INTO CompilationDebug(compilation_id, name, type, command, "
-                                      "parent_id) "
-         "VALUES(" << SQLType::kInteger << ", "
-                   << SQLType::kText << ", "
-                   << SQLType::kText << ", "
-                   << SQLType::kText << ", "
-                   << SQLType::kInteger << ")";
-
-  // add in a single transaction
-  SQLTransaction transaction(m_db);
-
-  // Add the compilation
-  insert_into_compilation << static_cast<int64_t>(features)
-                          << static_cast<int64_t>(features_class)
-                          << static_cast<int64_t>(parameters);
-  insert_into_compilation.exec().assertDone();
-
-  // The rowid of the insert is the compilation_id, retrieve it
-  int64_t row_id = sqlite3_last_insert_rowid(m_db);
-  CompilationID compilation_id = static_cast<CompilationID>(row_id);
-  assert(row_id != 0 && "compilation_id overflow");
-
-  // Add debug information
-  insert_compilation_debug << static_cast<int64_t>(compilation_id) << name
-                           << type;
-
-  if (command) {
-    insert_compilation_debug << command.get();
-  } else {
-    insert_compilation_debug << nullptr;
-  }
-  if (parent) {
-    insert_compilation_debug << static_cast<int64_t>(parent.get());
-  } else {
-    insert_compilation_debug << nullptr;
-  }
-  insert_compilation_debug.exec().assertDone();
-
-  transaction.commit();
-  return compilation_id;
+  BulkWriter writer(*this);
+  return writer.addCompilation({name, type, features, features_class,
+                                parameters, command, parent});
 }
 
 ParameterSetID Database::newParameterSet(ParameterSet parameters) {
-  SQLQuery get_parameter_set =
-      SQLQueryBuilder(*m_db)
-      << "SELECT parameter_set_id FROM ParameterSetParameter "
-         "WHERE parameter_set_id = " << SQLType::kInteger;
-
-  // FIXME: This should check that the values are identical if a conflict arises
-  SQLQuery insert_parameter_type =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO ParameterType(parameter_id, parameter_type) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ")";
-
-  SQLQuery insert_parameter =
-      SQLQueryBuilder(*m_db)
-      << "INSERT INTO ParameterSetParameter(parameter_set_id, parameter_id, value) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger << ", "
-                    << SQLType::kBlob << ")";
-
-  // FIXME: This should check that the keys are identical if a conflict
-  // arises.
-  SQLQuery insert_parameter_debug =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR IGNORE INTO ParameterDebug(parameter_id, name) "
-         "VALUES (" << SQLType::kInteger << ", " << SQLType::kText << ")";
-
-  // The hash of the parameter set forms its identifier in the database
-  ParameterSetID param_set_id = static_cast<ParameterSetID>(parameters.hash());
-
-  // Do a first check to see if the same parameter set already exists. If so
-  // we don't have to do any expensive probing
-  //
-  // If it doesn't exist, then we have to gain an exlusive lock to the database,
-  // do a linear probe for the first available id, and then insert the new
-  // parameter set. This is really expensive.
-  get_parameter_set << static_cast<int64_t>(param_set_id);
-  bool param_set_id_found = false;
-
-  if (!get_parameter_set.exec().done()) {
-    // There is already a parameter set with that id. Do a full check to
-    // see if it is equal
-    if (parameters == getParameters(param_set_id))
-      param_set_id_found = true;
-  }
-
-  if (!param_set_id_found) {
-    // The quick test did not find an equal parameter set, so we now need
-    // to probe to either find an equal set, or find somewhere to insert
-    // the new parameter set.
-    //
-    // The probe + insert must be done atomically without any other process
-    // writing to the database in the meantime, so we require an exclusive
-    // lock to the database.
-    SQLTransaction transaction(m_db, SQLTransaction::kExclusive);
-
-    while (!param_set_id_found) {
-      get_parameter_set.clearAllBindings();
-      get_parameter_set << static_cast<int64_t>(param_set_id);
-      auto param_iter = get_parameter_set.exec();
-
-      if (param_iter.done()) {
-        // The parameter set does not already exist, and we have found a free
-        // identifier for it. Do the insertion now
-        for (auto I : parameters) {
-          // clear parameters bindings for all queries
-          insert_parameter_type.clearAllBindings();
-          insert_parameter.clearAllBindings();
-          insert_parameter_debug.clearAllBindings();
-
-          // add parameter type first if not present
-          insert_parameter_type << static_cast<int64_t>(I->getID())
-                                << static_cast<int64_t>(I->getType());
-          insert_parameter_type.exec().assertDone();
-
-          // parameter insertion
-          insert_parameter << static_cast<int64_t>(param_set_id)
-                           << static_cast<int64_t>(I->getID())
-                           << I->toBlob();
-          insert_parameter.exec().assertDone();
-
-          // debug table
-          insert_parameter_debug << static_cast<int64_t>(I->getID())
-                                 << I->getName();
-          insert_parameter_debug.exec().assertDone();
-        }
-        param_set_id_found = true;
-      } else {
-        // Check if the parameter set with the given id is equal. If it is
-        // we're done, otherwise continuing probing
-        if (parameters == getParameters(param_set_id)) {
-          param_set_id_found = true;
-        } else {
-          mageec::ID tmp = static_cast<mageec::ID>(param_set_id);
-          param_set_id = static_cast<ParameterSetID>(tmp + 1);
-        }
-      }
-    }
-    transaction.commit();
-  }
-  return param_set_id;
+  BulkWriter writer(*this);
+  return writer.addParameterSet(parameters);
 }
 
 //===------------------------ Results interface ---------------------------===//
 
 void Database::
 addResults(std::map<std::pair<CompilationID, std::string>, double> results) {
-  // It is possible for the user to provide a compilation_id and metric which
-  // already has a result in the database. In this case, we replace the
-  // original value.
-  SQLQuery insert_result =
-      SQLQueryBuilder(*m_db)
-      << "INSERT OR REPLACE INTO Result(compilation_id, metric, result) "
-         "VALUES(" << SQLType::kInteger << ", " << SQLType::kText << ", "
-                   << SQLType::kReal << ")";
-
-  SQLQuery get_compilation_ids(
-      *m_db, "SELECT compilation_id FROM Compilation");
-
-  // Get all compilation ids first, so that we don't try and insert a
-  // result for a compilation which doesn't exist
-  std::set<int64_t> compilation_ids;
-  for (auto compilation_id_iter = get_compilation_ids.exec();
-       !compilation_id_iter.done();
-       compilation_id_iter = compilation_id_iter.next()) {
-    assert(compilation_id_iter.numColumns() == 1);
-    uint64_t id = compilation_id_iter.getInteger(0);
-    compilation_ids.insert(id);
-  }
-
   // All results in a single transaction
-  SQLTransaction transaction(m_db);
-
-  for (const auto &res : results) {
-    auto id = res.first.first;
-    auto metric = res.first.second;
-    auto value = res.second;
-
-    // Check that this is a result for a valid compilation id, else we will
-    // violate a foreign key constraint when adding it to the database
-    if (compilation_ids.count(static_cast<int64_t>(id)) != 1) {
-      MAGEEC_DEBUG("Result for an invalid compilation id... Ignoring...");
-      continue;
-    }
-
-    insert_result.clearAllBindings();
-    insert_result << static_cast<int64_t>(id) << metric
-                  << value;
-    insert_result.exec().assertDone();
-  }
-  transaction.commit();
+  BulkWriter writer(*this, 0);
+  writer.addResults(results);
 }
 
 //===----------------------- Training interface ---------------------------===//
@@ -1127,19 +1080,36 @@ ResultIterator::ResultIterator(Database &db, sqlite3 &raw_db,
                                FeatureClass feature_class,
                                std::string metric)
     : m_db(&db) {
-  // Get each compilation and its accompanying results
+  // Get the best result for each feature set. The best value for each
+  // feature set is found first, and then the compilations achieving that
+  // value. Where several compilations tie, the earliest is used, so
+  // compilations are ordered such that it comes first for its feature set.
   SQLQueryBuilder select_compilation_result =
       SQLQueryBuilder(raw_db)
       << "SELECT Compilation.feature_set_id, Compilation.parameter_set_id, "
                 "Result.result "
-         "FROM Compilation, Result "
+         "FROM Compilation, Result, "
+              "(SELECT Compilation.feature_set_id AS feature_set_id, "
+                      "MIN(Result.result) AS result "
+               "FROM Compilation, Result "
+               "WHERE Compilation.compilation_id = Result.compilation_id "
+                 "AND Compilation.feature_class_id = " << SQLType::kInteger
+                 << " AND Result.metric = " << SQLType::kText << " "
+               "GROUP BY Compilation.feature_set_id) AS Best "
          "WHERE Compilation.compilation_id = Result.compilation_id "
            "AND Compilation.feature_class_id = " << SQLType::kInteger << " "
            "AND Result.metric = " << SQLType::kText << " "
-         "ORDER BY Compilation.compilation_id";
+           "AND Compilation.feature_set_id = Best.feature_set_id "
+           "AND Result.result = Best.result "
+         "ORDER BY Compilation.feature_set_id, Compilation.compilation_id";
   m_query.reset(new SQLQuery(select_compilation_result));
-  *m_query << static_cast<int64_t>(feature_class);
-  *m_query << metric;;
+  *m_query << static_cast<int64_t>(feature_class) << metric;
+  *m_query << static_cast<int64_t>(feature_class) << metric;
+
+  // The features and parameters of each result are retrieved with the same
+  // two queries, rather than preparing new queries for every result.
+  m_select_features.reset(new SQLQuery(buildSelectFeatures(raw_db)));
+  m_select_parameters.reset(new SQLQuery(buildSelectParameters(raw_db)));
 
   m_result_iter.reset(new SQLQueryIterator(m_query->exec()));
 }
@@ -1147,7 +1117,9 @@ ResultIterator::ResultIterator(Database &db, sqlite3 &raw_db,
 ResultIterator::ResultIterator(ResultIterator &&other)
     : m_db(other.m_db),
       m_query(std::move(other.m_query)),
-      m_result_iter(std::move(other.m_result_iter)) {
+      m_result_iter(std::move(other.m_result_iter)),
+      m_select_features(std::move(other.m_select_features)),
+      m_select_parameters(std::move(other.m_select_parameters)) {
   other.m_db = nullptr;
 }
 
@@ -1155,6 +1127,8 @@ ResultIterator &ResultIterator::operator=(ResultIterator &&other) {
   m_db = other.m_db;
   m_query = std::move(other.m_query);
   m_result_iter = std::move(other.m_result_iter);
+  m_select_features = std::move(other.m_select_features);
+  m_select_parameters = std::move(other.m_select_parameters);
 
   other.m_db = nullptr;
   return *this;
@@ -1166,16 +1140,15 @@ util::Option<Result> ResultIterator::operator*() {
 
   assert(m_result_iter->numColumns() == 3);
 
-  FeatureSet features;
   ParameterSet parameters;
 
   auto feature_set = static_cast<FeatureSetID>(m_result_iter->getInteger(0));
-  features = m_db->getFeatureSetFeatures(feature_set);
+  FeatureSet features = readFeatureSet(*m_select_features, feature_set);
   assert(features.size() != 0);
 
   if (!m_result_iter->isNull(1)) {
     auto param_set = static_cast<ParameterSetID>(m_result_iter->getInteger(1));
-    parameters = m_db->getParameters(param_set);
+    parameters = readParameterSet(*m_select_parameters, param_set);
     assert(parameters.size() != 0);
   }
 
@@ -1186,16 +1159,26 @@ util::Option<Result> ResultIterator::operator*() {
 ResultIterator ResultIterator::next() {
   if (m_result_iter->done()) {
     return std::move(*this);
-  } else {
-    *m_result_iter = m_result_iter->next();
-    return std::move(*this);
   }
+
+  // Skip any other compilations which tie for the best result of the
+  // current feature set.
+  int64_t feature_set = m_result_iter->getInteger(0);
+  do {
+    *m_result_iter = m_result_iter->next();
+  } while (!m_result_iter->done() &&
+           m_result_iter->getInteger(0) == feature_set);
+  return std::move(*this);
 }
 
 SQLTransaction::SQLTransaction(sqlite3 *db, TransactionType type)
-    : m_is_committed(false), m_db(db) {
+    : m_is_committed(false), m_is_nested(sqlite3_get_autocommit(db) == 0),
+      m_db(db) {
   const char *query_str;
-  if (type == kImmediate) {
+  if (m_is_nested) {
+    // The locks are already dictated by the enclosing transaction
+    query_str = "SAVEPOINT mageec_transaction";
+  } else if (type == kImmediate) {
     query_str = "BEGIN IMMEDIATE TRANSACTION";
   } else if (type == kExclusive) {
     query_str = "BEGIN EXCLUSIVE TRANSACTION";
@@ -1210,13 +1193,23 @@ SQLTransaction::SQLTransaction(sqlite3 *db, TransactionType type)
 
 SQLTransaction::~SQLTransaction() {
   if (m_is_init && !m_is_committed) {
-    SQLQuery rollback_transaction(*m_db, "ROLLBACK");
-    rollback_transaction.exec().assertDone();
+    if (m_is_nested) {
+      SQLQuery rollback_savepoint(*m_db,
+                                  "ROLLBACK TO SAVEPOINT mageec_transaction");
+      rollback_savepoint.exec().assertDone();
+      SQLQuery release_savepoint(*m_db,
+                                 "RELEASE SAVEPOINT mageec_transaction");
+      release_savepoint.exec().assertDone();
+    } else {
+      SQLQuery rollback_transaction(*m_db, "ROLLBACK");
+      rollback_transaction.exec().assertDone();
+    }
   }
 }
 
 SQLTransaction::SQLTransaction(SQLTransaction &&other)
     : m_is_committed(std::move(other.m_is_committed)),
+      m_is_nested(std::move(other.m_is_nested)),
       m_db(std::move(other.m_db)) {
   assert(other.m_is_init && "Cannot move from a transaction which has already "
                             "been moved");
@@ -1230,6 +1223,7 @@ operator=(SQLTransaction &&other) {
                             "been moved");
 
   m_is_committed = std::move(other.m_is_committed);
+  m_is_nested = std::move(other.m_is_nested);
   m_db = std::move(other.m_db);
 
   other.m_is_init = false;
@@ -1241,9 +1235,341 @@ void SQLTransaction::commit() {
   assert(m_is_init && "Transaction has been moved");
   assert(!m_is_committed && "Transaction has already been committed");
 
-  SQLQuery commit_transaction(*m_db, "COMMIT");
+  const char *query_str = "COMMIT";
+  if (m_is_nested) {
+    query_str = "RELEASE SAVEPOINT mageec_transaction";
+  }
+  SQLQuery commit_transaction(*m_db, query_str);
   commit_transaction.exec().assertDone();
   m_is_committed = true;
 }
 
+//===--------------------------- Bulk writer ------------------------------===//
+
+Database::BulkWriter::BulkWriter(Database &db, unsigned batch_size)
+    : m_db(db.m_db), m_batch_size(batch_size), m_num_pending(0),
+      m_transaction() {}
+
+Database::BulkWriter::~BulkWriter() {
+  if (m_transaction) {
+    commit();
+  }
+}
+
+void Database::BulkWriter::beginWrite() {
+  // Take the write lock up front, so that lookups made within the batch see
+  // every item added by other processes before the batch began.
+  if (!m_transaction) {
+    m_transaction.reset(
+        new SQLTransaction(m_db, SQLTransaction::kImmediate));
+  }
+}
+
+void Database::BulkWriter::endWrite() {
+  assert(m_transaction && "Item written outside of a transaction");
+  ++m_num_pending;
+  if (m_batch_size != 0 && m_num_pending >= m_batch_size) {
+    commit();
+  }
+}
+
+void Database::BulkWriter::commit() {
+  if (m_transaction) {
+    m_transaction->commit();
+    m_transaction.reset();
+  }
+  m_num_pending = 0;
+}
+
+FeatureSetID Database::BulkWriter::addFeatureSet(const FeatureSet &features) {
+  if (!m_get_feature_set) {
+    m_get_feature_set.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "SELECT feature_set_id FROM FeatureSet "
+           "WHERE digest = " << SQLType::kBlob));
+    m_insert_feature_set.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR IGNORE INTO FeatureSet(digest) "
+           "VALUES (" << SQLType::kBlob << ")"));
+    // FIXME: This should check that the types are identical if a conflict
+    // arises
+    m_insert_feature_type.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR IGNORE INTO FeatureType(feature_id, feature_type) "
+           "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger
+        << ")"));
+    m_insert_feature.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO FeatureSetFeature(feature_set_id, feature_id, value) "
+           "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger
+        << ", " << SQLType::kBlob << ")"));
+    // FIXME: This should check that the keys are identical if a conflict
+    // arises.
+    m_insert_feature_debug.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR IGNORE INTO FeatureDebug(feature_id, name) "
+           "VALUES (" << SQLType::kInteger << ", " << SQLType::kText << ")"));
+  }
+
+  // Feature sets are identified by the digest of their contents, so an
+  // existing equal feature set can be found with a single lookup.
+  std::vector<uint8_t> digest = features.digest();
+  m_get_feature_set->clearAllBindings();
+  *m_get_feature_set << digest;
+  {
+    auto feature_set_iter = m_get_feature_set->exec();
+    if (!feature_set_iter.done()) {
+      assert(feature_set_iter.numColumns() == 1);
+      return static_cast<FeatureSetID>(feature_set_iter.getInteger(0));
+    }
+  }
+
+  // Otherwise claim a new identifier for the digest. If no batch was open,
+  // another process may have added the same feature set since the lookup,
+  // in which case the insert is ignored and its identifier is used instead.
+  beginWrite();
+  m_insert_feature_set->clearAllBindings();
+  *m_insert_feature_set << digest;
+  m_insert_feature_set->exec().assertDone();
+  if (sqlite3_changes(m_db) == 0) {
+    auto feature_set_iter = m_get_feature_set->exec();
+    assert(!feature_set_iter.done() && feature_set_iter.numColumns() == 1);
+    return static_cast<FeatureSetID>(feature_set_iter.getInteger(0));
+  }
+  FeatureSetID feature_set_id =
+      static_cast<FeatureSetID>(sqlite3_last_insert_rowid(m_db));
+
+  for (auto I : features) {
+    // clear feature bindings for all queries
+    m_insert_feature_type->clearAllBindings();
+    m_insert_feature->clearAllBindings();
+    m_insert_feature_debug->clearAllBindings();
+
+    // Add feature type first if not present
+    *m_insert_feature_type << static_cast<int64_t>(I->getID())
+                           << static_cast<int64_t>(I->getType());
+    m_insert_feature_type->exec().assertDone();
+
+    // feature insertion
+    *m_insert_feature << static_cast<int64_t>(feature_set_id)
+                      << static_cast<int64_t>(I->getID())
+                      << I->toBlob();
+    m_insert_feature->exec().assertDone();
+
+    // debug table
+    *m_insert_feature_debug << static_cast<int64_t>(I->getID())
+                            << I->getName();
+    m_insert_feature_debug->exec().assertDone();
+  }
+  endWrite();
+  return feature_set_id;
+}
+
+std::vector<FeatureSetID> Database::BulkWriter::
+addFeatureSets(const std::vector<FeatureSet> &feature_sets) {
+  std::vector<FeatureSetID> feature_set_ids;
+  feature_set_ids.reserve(feature_sets.size());
+  for (const auto &features : feature_sets) {
+    feature_set_ids.push_back(addFeatureSet(features));
+  }
+  return feature_set_ids;
+}
+
+ParameterSetID
+Database::BulkWriter::addParameterSet(const ParameterSet &parameters) {
+  if (!m_get_parameter_set) {
+    m_get_parameter_set.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "SELECT parameter_set_id FROM ParameterSet "
+           "WHERE digest = " << SQLType::kBlob));
+    m_insert_parameter_set.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR IGNORE INTO ParameterSet(digest) "
+           "VALUES (" << SQLType::kBlob << ")"));
+    // FIXME: This should check that the values are identical if a conflict
+    // arises
+    m_insert_parameter_type.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR IGNORE INTO ParameterType(parameter_id, parameter_type) "
+           "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger
+        << ")"));
+    m_insert_parameter.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO ParameterSetParameter(parameter_set_id, "
+                                             "parameter_id, value) "
+           "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger
+        << ", " << SQLType::kBlob << ")"));
+    // FIXME: This should check that the keys are identical if a conflict
+    // arises.
+    m_insert_parameter_debug.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR IGNORE INTO ParameterDebug(parameter_id, name) "
+           "VALUES (" << SQLType::kInteger << ", " << SQLType::kText << ")"));
+  }
+
+  // Parameter sets are identified by the digest of their contents, in the
+  // same way as feature sets.
+  std::vector<uint8_t> digest = parameters.digest();
+  m_get_parameter_set->clearAllBindings();
+  *m_get_parameter_set << digest;
+  {
+    auto param_set_iter = m_get_parameter_set->exec();
+    if (!param_set_iter.done()) {
+      assert(param_set_iter.numColumns() == 1);
+      return static_cast<ParameterSetID>(param_set_iter.getInteger(0));
+    }
+  }
+
+  beginWrite();
+  m_insert_parameter_set->clearAllBindings();
+  *m_insert_parameter_set << digest;
+  m_insert_parameter_set->exec().assertDone();
+  if (sqlite3_changes(m_db) == 0) {
+    auto param_set_iter = m_get_parameter_set->exec();
+    assert(!param_set_iter.done() && param_set_iter.numColumns() == 1);
+    return static_cast<ParameterSetID>(param_set_iter.getInteger(0));
+  }
+  ParameterSetID param_set_id =
+      static_cast<ParameterSetID>(sqlite3_last_insert_rowid(m_db));
+
+  for (auto I : parameters) {
+    // clear parameters bindings for all queries
+    m_insert_parameter_type->clearAllBindings();
+    m_insert_parameter->clearAllBindings();
+    m_insert_parameter_debug->clearAllBindings();
+
+    // add parameter type first if not present
+    *m_insert_parameter_type << static_cast<int64_t>(I->getID())
+                             << static_cast<int64_t>(I->getType());
+    m_insert_parameter_type->exec().assertDone();
+
+    // parameter insertion
+    *m_insert_parameter << static_cast<int64_t>(param_set_id)
+                        << static_cast<int64_t>(I->getID())
+                        << I->toBlob();
+    m_insert_parameter->exec().assertDone();
+
+    // debug table
+    *m_insert_parameter_debug << static_cast<int64_t>(I->getID())
+                              << I->getName();
+    m_insert_parameter_debug->exec().assertDone();
+  }
+  endWrite();
+  return param_set_id;
+}
+
+std::vector<ParameterSetID> Database::BulkWriter::
+addParameterSets(const std::vector<ParameterSet> &parameter_sets) {
+  std::vector<ParameterSetID> param_set_ids;
+  param_set_ids.reserve(parameter_sets.size());
+  for (const auto &parameters : parameter_sets) {
+    param_set_ids.push_back(addParameterSet(parameters));
+  }
+  return param_set_ids;
+}
+
+CompilationID
+Database::BulkWriter::addCompilation(const NewCompilation &compilation) {
+  if (!m_insert_compilation) {
+    m_insert_compilation.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO Compilation(feature_set_id, feature_class_id, "
+                                   "parameter_set_id) "
+           "VALUES (" << SQLType::kInteger << ", " << SQLType::kInteger
+        << ", " << SQLType::kInteger << ")"));
+    m_insert_compilation_debug.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT INTO CompilationDebug(compilation_id, name, type, "
+                                        "command, parent_id) "
+           "VALUES(" << SQLType::kInteger << ", "
+                     << SQLType::kText << ", "
+                     << SQLType::kText << ", "
+                     << SQLType::kText << ", "
+                     << SQLType::kInteger << ")"));
+  }
+
+  beginWrite();
+
+  // Add the compilation
+  m_insert_compilation->clearAllBindings();
+  *m_insert_compilation << static_cast<int64_t>(compilation.features)
+                        << static_cast<int64_t>(compilation.features_class)
+                        << static_cast<int64_t>(compilation.parameters);
+  m_insert_compilation->exec().assertDone();
+
+  // The rowid of the insert is the compilation_id, retrieve it
+  int64_t row_id = sqlite3_last_insert_rowid(m_db);
+  CompilationID compilation_id = static_cast<CompilationID>(row_id);
+  assert(row_id != 0 && "compilation_id overflow");
+
+  // Add debug information
+  m_insert_compilation_debug->clearAllBindings();
+  *m_insert_compilation_debug << static_cast<int64_t>(compilation_id)
+                              << compilation.name << compilation.type;
+  if (compilation.command) {
+    *m_insert_compilation_debug << compilation.command.get();
+  } else {
+    *m_insert_compilation_debug << nullptr;
+  }
+  if (compilation.parent) {
+    *m_insert_compilation_debug
+        << static_cast<int64_t>(compilation.parent.get());
+  } else {
+    *m_insert_compilation_debug << nullptr;
+  }
+  m_insert_compilation_debug->exec().assertDone();
+
+  endWrite();
+  return compilation_id;
+}
+
+std::vector<CompilationID> Database::BulkWriter::
+addCompilations(const std::vector<NewCompilation> &compilations) {
+  std::vector<CompilationID> compilation_ids;
+  compilation_ids.reserve(compilations.size());
+  for (const auto &compilation : compilations) {
+    compilation_ids.push_back(addCompilation(compilation));
+  }
+  return compilation_ids;
+}
+
+bool Database::BulkWriter::addResult(CompilationID compilation,
+                                     const std::string &metric,
+                                     double value) {
+  // It is possible for the user to provide a compilation_id and metric which
+  // already has a result in the database. In this case, we replace the
+  // original value. A result for a compilation which doesn't exist would
+  // violate a foreign key constraint, so is not inserted.
+  if (!m_insert_result) {
+    m_insert_result.reset(new SQLQuery(
+        SQLQueryBuilder(*m_db)
+        << "INSERT OR REPLACE INTO Result(compilation_id, metric, result) "
+           "SELECT compilation_id, " << SQLType::kText << ", "
+                                     << SQLType::kReal << " "
+           "FROM Compilation WHERE compilation_id = " << SQLType::kInteger));
+  }
+
+  beginWrite();
+  m_insert_result->clearAllBindings();
+  *m_insert_result << metric << value << static_cast<int64_t>(compilation);
+  m_insert_result->exec().assertDone();
+  if (sqlite3_changes(m_db) == 0) {
+    MAGEEC_DEBUG("Result for an invalid compilation id... Ignoring...");
+    return false;
+  }
+  endWrite();
+  return true;
+}
+
+unsigned Database::BulkWriter::addResults(
+    const std::map<std::pair<CompilationID, std::string>, double> &results) {
+  unsigned num_added = 0;
+  for (const auto &res : results) {
+    if (addResult(res.first.first, res.first.second, res.second)) {
+      ++num_added;
+    }
+  }
+  return num_added;
+}
+
 } // end of namespace mageec
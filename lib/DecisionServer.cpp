@@ -0,0 +1,795 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===----------------------- MAGEEC decision server -----------------------===//
+//
+// This implements the decision server and its client. Each connection
+// carries a single request and its reply. Both are sent as a u32 length
+// followed by a payload of that length, with all integers in little endian
+// order. The payload of a request is laid out as follows:
+//
+//   u8[4]  magic number
+//   u16    protocol version
+//   str    machine learner name
+//   str    metric
+//   u8     feature class
+//   u64    feature set id
+//   u16    number of decision requests
+//   for each request:
+//     u8   request type
+//     u32  parameter id, for bool, range and pass sequence requests
+//     str  pass name, for pass gate requests
+//
+// The payload of a reply is laid out as follows:
+//
+//   u8     status
+//   u16    number of decisions, which is 0 unless the status is success
+//   for each decision:
+//     u8   decision type
+//     u8   value, for bool decisions
+//     u64  value, for range decisions
+//     u16  number of passes, then a str for each, for pass sequence
+//          decisions
+//
+// where each str is a u16 length followed by that many bytes.
+//
+// The server waits on all of its connections at once, and never blocks
+// reading from or writing to any of them, so a client which stalls part way
+// through a request does not hold up any other client. Decisions are still
+// made one at a time, as the machine learners are not safe to use
+// concurrently.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mageec/DecisionServer.h"
+#include "mageec/AttributeSet.h"
+#include "mageec/Database.h"
+#include "mageec/Decision.h"
+#include "mageec/TrainedML.h"
+#include "mageec/Types.h"
+#include "mageec/Util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace mageec {
+
+/// Magic number at the start of every request
+static const uint8_t request_magic[4] = {'M', 'G', 'D', 'S'};
+
+/// Version of the protocol spoken between the client and server
+static const unsigned protocol_version = 1;
+
+/// Largest message which will be accepted, in bytes
+static const uint32_t max_message_size = 1 << 24;
+
+/// Time after which the server abandons a connection which has not
+/// completed, in milliseconds. A stalled connection only holds up itself,
+/// so this just bounds how long its resources are held.
+static const int64_t server_timeout = 5000;
+
+/// Time after which the client abandons a request, in seconds. This is
+/// long, as the server may need to load a model before it can reply.
+static const int client_timeout = 60;
+
+/// Size of each read from a connection
+static const size_t receive_chunk_size = 4096;
+
+/// How often the server checks whether it has been asked to stop, in
+/// milliseconds
+static const int stop_poll_interval = 1000;
+
+/// Set by the signal handler when the server should stop
+static volatile sig_atomic_t stop_serving = 0;
+
+static void handleStopSignal(int sig) {
+  (void)sig;
+  stop_serving = 1;
+}
+
+/// \brief Write a string, prefixed by its 16-bit length, to a buffer
+static void writeString(std::vector<uint8_t> &buf, const std::string &str) {
+  assert(str.size() <= UINT16_MAX && "String too long for decision message");
+  util::write16LE(buf, static_cast<unsigned>(str.size()));
+  buf.insert(buf.end(), str.begin(), str.end());
+}
+
+/// \brief Read a string, prefixed by its 16-bit length, from a payload
+///
+/// \return False if the string would extend beyond the end of the payload
+static bool readString(std::vector<uint8_t>::const_iterator &it,
+                       std::vector<uint8_t>::const_iterator end,
+                       std::string &str) {
+  if (std::distance(it, end) < 2) {
+    return false;
+  }
+  unsigned len = util::read16LE(it);
+  if (static_cast<unsigned>(std::distance(it, end)) < len) {
+    return false;
+  }
+  str.assign(it, it + len);
+  it += len;
+  return true;
+}
+
+/// \brief Check that at least a number of bytes remain in a payload
+static bool hasBytes(std::vector<uint8_t>::const_iterator it,
+                     std::vector<uint8_t>::const_iterator end, size_t bytes) {
+  return static_cast<size_t>(std::distance(it, end)) >= bytes;
+}
+
+/// \brief Send a message, prefixed by its 32-bit length
+///
+/// \return False if the message could not be sent in full
+static bool sendMessage(int fd, const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> buf;
+  util::write32LE(buf, static_cast<uint32_t>(payload.size()));
+  buf.insert(buf.end(), payload.begin(), payload.end());
+
+  size_t sent = 0;
+  while (sent < buf.size()) {
+    ssize_t res = send(fd, buf.data() + sent, buf.size() - sent, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    sent += static_cast<size_t>(res);
+  }
+  return true;
+}
+
+/// \brief Receive exactly a number of bytes
+static bool receiveBytes(int fd, uint8_t *buf, size_t len) {
+  size_t received = 0;
+  while (received < len) {
+    ssize_t res = recv(fd, buf + received, len - received, 0);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (res == 0) {
+      return false;
+    }
+    received += static_cast<size_t>(res);
+  }
+  return true;
+}
+
+/// \brief Receive a message, prefixed by its 32-bit length
+///
+/// \return False if a complete message could not be received
+static bool receiveMessage(int fd, std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> len_buf(4);
+  if (!receiveBytes(fd, len_buf.data(), len_buf.size())) {
+    return false;
+  }
+  auto it = len_buf.cbegin();
+  uint32_t len = util::read32LE(it);
+  if (len > max_message_size) {
+    return false;
+  }
+  payload.resize(len);
+  return receiveBytes(fd, payload.data(), len);
+}
+
+/// \brief Get the time from a monotonic clock, in milliseconds
+static int64_t getMonotonicTime() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+/// \brief Set how long a socket waits to send or receive before failing
+static void setSocketTimeout(int fd, int seconds) {
+  struct timeval tv;
+  tv.tv_sec = seconds;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/// \brief Fill in the address of a UNIX domain socket
+///
+/// \return False if the path is too long for a socket address
+static bool getSocketAddress(const std::string &socket_path,
+                             struct sockaddr_un &addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    MAGEEC_ERR("Socket path '" << socket_path << "' is too long");
+    return false;
+  }
+  std::strcpy(addr.sun_path, socket_path.c_str());
+  return true;
+}
+
+/// \brief Connect to a UNIX domain socket
+///
+/// \return The connected socket, or -1 if it could not be connected
+static int connectSocket(const struct sockaddr_un &addr) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<const struct sockaddr *>(&addr),
+              sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/// \brief Serialize a decision to the end of a reply
+static void writeDecision(std::vector<uint8_t> &buf,
+                          const DecisionBase &decision) {
+  buf.push_back(static_cast<uint8_t>(decision.getType()));
+  switch (decision.getType()) {
+  case DecisionType::kNative:
+    break;
+  case DecisionType::kBool:
+    buf.push_back(static_cast<const BoolDecision &>(decision).getValue());
+    break;
+  case DecisionType::kRange:
+    util::write64LE(buf, static_cast<uint64_t>(
+        static_cast<const RangeDecision &>(decision).getValue()));
+    break;
+  case DecisionType::kPassSeq: {
+    const PassSeq &passes =
+        static_cast<const PassSeqDecision &>(decision).getValue();
+    assert(passes.size() <= UINT16_MAX && "Too many passes for reply");
+    util::write16LE(buf, static_cast<unsigned>(passes.size()));
+    for (const auto &pass : passes) {
+      writeString(buf, pass);
+    }
+    break;
+  }
+  }
+}
+
+/// \brief Deserialize a decision from a reply
+///
+/// \return The decision, or nullptr if the reply is malformed
+static std::unique_ptr<DecisionBase>
+readDecision(std::vector<uint8_t>::const_iterator &it,
+             std::vector<uint8_t>::const_iterator end) {
+  if (!hasBytes(it, end, 1)) {
+    return nullptr;
+  }
+  unsigned decision_type = *it++;
+  switch (static_cast<DecisionType>(decision_type)) {
+  case DecisionType::kNative:
+    return std::unique_ptr<DecisionBase>(new NativeDecision());
+  case DecisionType::kBool:
+    if (!hasBytes(it, end, 1)) {
+      return nullptr;
+    }
+    return std::unique_ptr<DecisionBase>(new BoolDecision(*it++ != 0));
+  case DecisionType::kRange:
+    if (!hasBytes(it, end, 8)) {
+      return nullptr;
+    }
+    return std::unique_ptr<DecisionBase>(
+        new RangeDecision(static_cast<int64_t>(util::read64LE(it))));
+  case DecisionType::kPassSeq: {
+    if (!hasBytes(it, end, 2)) {
+      return nullptr;
+    }
+    unsigned num_passes = util::read16LE(it);
+    PassSeq passes;
+    for (unsigned i = 0; i < num_passes; ++i) {
+      std::string pass;
+      if (!readString(it, end, pass)) {
+        return nullptr;
+      }
+      passes.push_back(pass);
+    }
+    return std::unique_ptr<DecisionBase>(new PassSeqDecision(passes));
+  }
+  }
+  return nullptr;
+}
+
+/// \brief Serialize a decision request to the end of a request
+static void writeRequest(std::vector<uint8_t> &buf,
+                         const DecisionRequestBase &request) {
+  buf.push_back(static_cast<uint8_t>(request.getType()));
+  switch (request.getType()) {
+  case DecisionRequestType::kBool:
+    util::write32LE(
+        buf, static_cast<const BoolDecisionRequest &>(request).getID());
+    break;
+  case DecisionRequestType::kRange:
+    util::write32LE(
+        buf, static_cast<const RangeDecisionRequest &>(request).getID());
+    break;
+  case DecisionRequestType::kPassSeq:
+    util::write32LE(
+        buf, static_cast<const PassSeqDecisionRequest &>(request).getID());
+    break;
+  case DecisionRequestType::kPassGate:
+    writeString(buf,
+                static_cast<const PassGateDecisionRequest &>(request).getID());
+    break;
+  }
+}
+
+/// \brief Deserialize a decision request from a request
+///
+/// \return The decision request, or nullptr if the request is malformed
+static std::unique_ptr<DecisionRequestBase>
+readRequest(std::vector<uint8_t>::const_iterator &it,
+            std::vector<uint8_t>::const_iterator end) {
+  if (!hasBytes(it, end, 1)) {
+    return nullptr;
+  }
+  unsigned request_type = *it++;
+  switch (static_cast<DecisionRequestType>(request_type)) {
+  case DecisionRequestType::kBool:
+    if (!hasBytes(it, end, 4)) {
+      return nullptr;
+    }
+    return std::unique_ptr<DecisionRequestBase>(
+        new BoolDecisionRequest(util::read32LE(it)));
+  case DecisionRequestType::kRange:
+    if (!hasBytes(it, end, 4)) {
+      return nullptr;
+    }
+    return std::unique_ptr<DecisionRequestBase>(
+        new RangeDecisionRequest(util::read32LE(it)));
+  case DecisionRequestType::kPassSeq:
+    if (!hasBytes(it, end, 4)) {
+      return nullptr;
+    }
+    return std::unique_ptr<DecisionRequestBase>(
+        new PassSeqDecisionRequest(util::read32LE(it)));
+  case DecisionRequestType::kPassGate: {
+    std::string pass;
+    if (!readString(it, end, pass)) {
+      return nullptr;
+    }
+    return std::unique_ptr<DecisionRequestBase>(
+        new PassGateDecisionRequest(pass));
+  }
+  }
+  return nullptr;
+}
+
+/// \struct Connection
+///
+/// \brief A connection to the server, which carries a single request and
+/// its reply
+struct Connection {
+  /// The bytes of the request received so far
+  std::vector<uint8_t> request;
+  /// The reply, once the request has been handled
+  std::vector<uint8_t> reply;
+  /// Number of bytes of the reply which have been sent
+  size_t reply_sent;
+  /// Time at which the connection is abandoned if it has not completed
+  int64_t deadline;
+};
+
+/// \brief Receive whatever part of a request is available on a connection,
+/// without blocking
+///
+/// \return False if the connection has failed, or was closed before the
+/// request was complete
+static bool receiveAvailable(int fd, Connection &conn) {
+  while (true) {
+    size_t old_size = conn.request.size();
+    conn.request.resize(old_size + receive_chunk_size);
+    ssize_t res = recv(fd, conn.request.data() + old_size, receive_chunk_size,
+                       0);
+    conn.request.resize(old_size + (res > 0 ? static_cast<size_t>(res) : 0));
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (res == 0) {
+      return false;
+    }
+    if (conn.request.size() > 4 + max_message_size) {
+      return false;
+    }
+  }
+}
+
+/// \brief Get the payload of a request, if it has been received in full
+///
+/// \param complete  Set to false if the request is not yet complete
+///
+/// \return False if the request is too large to be accepted
+static bool getRequestPayload(const Connection &conn, bool &complete,
+                              std::vector<uint8_t> &payload) {
+  complete = false;
+  if (conn.request.size() < 4) {
+    return true;
+  }
+  auto it = conn.request.cbegin();
+  uint32_t len = util::read32LE(it);
+  if (len > max_message_size) {
+    return false;
+  }
+  if (conn.request.size() - 4 < len) {
+    return true;
+  }
+  payload.assign(it, it + len);
+  complete = true;
+  return true;
+}
+
+/// \brief Send whatever part of a reply can be sent on a connection,
+/// without blocking
+///
+/// \return False if the connection has failed
+static bool sendAvailable(int fd, Connection &conn) {
+  while (conn.reply_sent < conn.reply.size()) {
+    ssize_t res = send(fd, conn.reply.data() + conn.reply_sent,
+                       conn.reply.size() - conn.reply_sent,
+                       MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    conn.reply_sent += static_cast<size_t>(res);
+  }
+  return true;
+}
+
+/// \class DecisionServer
+///
+/// \brief State held by the server between requests
+class DecisionServer {
+public:
+  explicit DecisionServer(Database &db)
+      : m_db(db), m_trained_mls(db.getTrainedMachineLearners()),
+        m_feature_sets() {}
+
+  /// \brief Get the number of trained machine learners being served
+  size_t getNumTrainedMLs() const { return m_trained_mls.size(); }
+
+  /// \brief Handle a single request, producing the payload of its reply
+  std::vector<uint8_t> handleRequest(const std::vector<uint8_t> &payload);
+
+private:
+  /// \brief Get the features of a feature set, loading them from the
+  /// database if they have not been loaded already
+  ///
+  /// \return The features, which are empty if the feature set does not
+  /// exist
+  const FeatureSet &getFeatureSet(FeatureSetID feature_set_id);
+
+  Database &m_db;
+
+  /// The trained machine learners in the database. Each loads its model on
+  /// its first decision and keeps it for every later decision.
+  std::vector<TrainedML> m_trained_mls;
+
+  /// Features of each feature set a decision has been requested for. Feature
+  /// sets never change once added to the database, so these never become
+  /// stale.
+  std::map<FeatureSetID, FeatureSet> m_feature_sets;
+};
+
+const FeatureSet &DecisionServer::getFeatureSet(FeatureSetID feature_set_id) {
+  auto it = m_feature_sets.find(feature_set_id);
+  if (it != m_feature_sets.end()) {
+    return it->second;
+  }
+  FeatureSet features = m_db.getFeatureSetFeatures(feature_set_id);
+  if (features.size() == 0) {
+    // The feature set may be added later, so do not remember its absence
+    static const FeatureSet empty_features;
+    return empty_features;
+  }
+  return m_feature_sets.emplace(feature_set_id, features).first->second;
+}
+
+std::vector<uint8_t>
+DecisionServer::handleRequest(const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> reply;
+  auto replyStatus = [&reply](DecisionStatus status) {
+    reply.clear();
+    reply.push_back(static_cast<uint8_t>(status));
+    util::write16LE(reply, 0);
+    return reply;
+  };
+
+  auto it = payload.cbegin();
+  auto end = payload.cend();
+  if (!hasBytes(it, end, sizeof(request_magic) + 2) ||
+      !std::equal(std::begin(request_magic), std::end(request_magic), it)) {
+    return replyStatus(DecisionStatus::kBadRequest);
+  }
+  it += sizeof(request_magic);
+  if (util::read16LE(it) != protocol_version) {
+    return replyStatus(DecisionStatus::kBadRequest);
+  }
+
+  std::string ml_name;
+  std::string metric;
+  if (!readString(it, end, ml_name) || !readString(it, end, metric) ||
+      !hasBytes(it, end, 1 + 8 + 2)) {
+    return replyStatus(DecisionStatus::kBadRequest);
+  }
+  FeatureClass feature_class = static_cast<FeatureClass>(*it++);
+  FeatureSetID feature_set_id = static_cast<FeatureSetID>(util::read64LE(it));
+
+  unsigned num_requests = util::read16LE(it);
+  std::vector<std::unique_ptr<DecisionRequestBase>> requests;
+  for (unsigned i = 0; i < num_requests; ++i) {
+    std::unique_ptr<DecisionRequestBase> request = readRequest(it, end);
+    if (!request) {
+      return replyStatus(DecisionStatus::kBadRequest);
+    }
+    requests.push_back(std::move(request));
+  }
+  if (it != end) {
+    return replyStatus(DecisionStatus::kBadRequest);
+  }
+
+  TrainedML *trained_ml = nullptr;
+  for (auto &candidate : m_trained_mls) {
+    if (candidate.getName() == ml_name && candidate.getMetric() == metric &&
+        candidate.getFeatureClass() == feature_class) {
+      trained_ml = &candidate;
+      break;
+    }
+  }
+  if (!trained_ml) {
+    MAGEEC_DEBUG("No machine learner '" << ml_name << "' trained for metric '"
+                 << metric << "'");
+    return replyStatus(DecisionStatus::kUnknownMachineLearner);
+  }
+
+  const FeatureSet &features = getFeatureSet(feature_set_id);
+  if (features.size() == 0) {
+    MAGEEC_DEBUG("No feature set with id "
+                 << static_cast<uint64_t>(feature_set_id));
+    return replyStatus(DecisionStatus::kUnknownFeatureSet);
+  }
+
+  MAGEEC_DEBUG("Making " << requests.size() << " decisions for feature set "
+               << static_cast<uint64_t>(feature_set_id));
+  auto decisions = trained_ml->makeDecisions(requests, features);
+  assert(decisions.size() == requests.size());
+
+  reply.push_back(static_cast<uint8_t>(DecisionStatus::kSuccess));
+  util::write16LE(reply, static_cast<unsigned>(decisions.size()));
+  for (const auto &decision : decisions) {
+    writeDecision(reply, *decision);
+  }
+  return reply;
+}
+
+bool serveDecisions(Database &db, const std::string &socket_path) {
+  struct sockaddr_un addr;
+  if (!getSocketAddress(socket_path, addr)) {
+    return false;
+  }
+
+  // Replace the socket left behind by a server which is no longer running,
+  // but never replace anything else.
+  struct stat st;
+  if (lstat(socket_path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      MAGEEC_ERR("'" << socket_path << "' exists and is not a socket");
+      return false;
+    }
+    int fd = connectSocket(addr);
+    if (fd >= 0) {
+      close(fd);
+      MAGEEC_ERR("A server is already listening on '" << socket_path << "'");
+      return false;
+    }
+    unlink(socket_path.c_str());
+  }
+
+  DecisionServer server(db);
+  if (server.getNumTrainedMLs() == 0) {
+    MAGEEC_WARN("The database has no trained machine learners, every request "
+                "will be refused");
+  }
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                         0);
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<const struct sockaddr *>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(listen_fd, SOMAXCONN) != 0) {
+    MAGEEC_ERR("Could not listen on '" << socket_path << "': "
+               << strerror(errno));
+    if (listen_fd >= 0) {
+      close(listen_fd);
+    }
+    return false;
+  }
+
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = handleStopSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  MAGEEC_STATUS("Serving decisions from " << server.getNumTrainedMLs()
+                << " trained machine learners on '" << socket_path << "'");
+
+  // Open connections, by their socket
+  std::map<int, Connection> connections;
+  std::vector<struct pollfd> polls;
+  while (!stop_serving) {
+    // Wait for a new connection, or for any open connection to be ready,
+    // waking in time to abandon the first connection to reach its deadline.
+    int64_t now = getMonotonicTime();
+    int64_t timeout = stop_poll_interval;
+    polls.clear();
+    polls.push_back({listen_fd, POLLIN, 0});
+    for (const auto &conn : connections) {
+      short events = conn.second.reply.empty() ? POLLIN : POLLOUT;
+      polls.push_back({conn.first, events, 0});
+      timeout = std::min(timeout, std::max<int64_t>(
+                                      conn.second.deadline - now, 0));
+    }
+    if (poll(polls.data(), polls.size(), static_cast<int>(timeout)) < 0) {
+      continue;
+    }
+    now = getMonotonicTime();
+
+    if (polls[0].revents & POLLIN) {
+      int fd;
+      while ((fd = accept4(listen_fd, nullptr, nullptr,
+                           SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+        connections[fd] = Connection{{}, {}, 0, now + server_timeout};
+      }
+    }
+
+    for (unsigned i = 1; i < polls.size(); ++i) {
+      int fd = polls[i].fd;
+      Connection &conn = connections[fd];
+      bool keep = true;
+
+      if (conn.reply.empty() && polls[i].revents != 0) {
+        bool complete = false;
+        std::vector<uint8_t> payload;
+        keep = receiveAvailable(fd, conn) &&
+               getRequestPayload(conn, complete, payload);
+        if (keep && complete) {
+          std::vector<uint8_t> reply = server.handleRequest(payload);
+          util::write32LE(conn.reply, static_cast<uint32_t>(reply.size()));
+          conn.reply.insert(conn.reply.end(), reply.begin(), reply.end());
+        }
+      }
+      if (keep && !conn.reply.empty()) {
+        keep = sendAvailable(fd, conn) && conn.reply_sent < conn.reply.size();
+      }
+      if (keep && now >= conn.deadline) {
+        MAGEEC_DEBUG("Abandoning connection which did not complete in time");
+        keep = false;
+      }
+      if (!keep) {
+        close(fd);
+        connections.erase(fd);
+      }
+    }
+  }
+
+  MAGEEC_STATUS("Stopping decision server");
+  for (const auto &conn : connections) {
+    close(conn.first);
+  }
+  close(listen_fd);
+  unlink(socket_path.c_str());
+  return true;
+}
+
+DecisionStatus
+requestDecisions(const std::string &socket_path, const std::string &ml_name,
+                 const std::string &metric, FeatureClass feature_class,
+                 FeatureSetID feature_set,
+                 const std::vector<std::unique_ptr<DecisionRequestBase>>
+                     &requests,
+                 std::vector<std::unique_ptr<DecisionBase>> &decisions) {
+  struct sockaddr_un addr;
+  if (!getSocketAddress(socket_path, addr)) {
+    return DecisionStatus::kNoServer;
+  }
+
+  std::vector<uint8_t> payload;
+  payload.insert(payload.end(), std::begin(request_magic),
+                 std::end(request_magic));
+  util::write16LE(payload, protocol_version);
+  writeString(payload, ml_name);
+  writeString(payload, metric);
+  payload.push_back(static_cast<uint8_t>(feature_class));
+  util::write64LE(payload, static_cast<uint64_t>(feature_set));
+  assert(requests.size() <= UINT16_MAX && "Too many decision requests");
+  util::write16LE(payload, static_cast<unsigned>(requests.size()));
+  for (const auto &request : requests) {
+    writeRequest(payload, *request);
+  }
+
+  int fd = connectSocket(addr);
+  if (fd < 0) {
+    MAGEEC_DEBUG("Could not connect to decision server '" << socket_path
+                 << "': " << strerror(errno));
+    return DecisionStatus::kNoServer;
+  }
+  setSocketTimeout(fd, client_timeout);
+
+  std::vector<uint8_t> reply;
+  bool received = sendMessage(fd, payload) && receiveMessage(fd, reply);
+  close(fd);
+  if (!received || reply.size() < 3) {
+    return DecisionStatus::kNoServer;
+  }
+
+  auto it = reply.cbegin();
+  auto end = reply.cend();
+  unsigned status = *it++;
+  if (status > static_cast<unsigned>(DecisionStatus::kBadRequest)) {
+    return DecisionStatus::kNoServer;
+  }
+  if (static_cast<DecisionStatus>(status) != DecisionStatus::kSuccess) {
+    return static_cast<DecisionStatus>(status);
+  }
+
+  unsigned num_decisions = util::read16LE(it);
+  if (num_decisions != requests.size()) {
+    return DecisionStatus::kNoServer;
+  }
+  std::vector<std::unique_ptr<DecisionBase>> reply_decisions;
+  for (unsigned i = 0; i < num_decisions; ++i) {
+    std::unique_ptr<DecisionBase> decision = readDecision(it, end);
+    if (!decision) {
+      return DecisionStatus::kNoServer;
+    }
+    reply_decisions.push_back(std::move(decision));
+  }
+  if (it != end) {
+    return DecisionStatus::kNoServer;
+  }
+  decisions = std::move(reply_decisions);
+  return DecisionStatus::kSuccess;
+}
+
+} // end of namespace mageec
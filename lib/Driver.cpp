@@ -24,15 +24,22 @@
 //===----------------------------------------------------------------------===//
 
 #include "mageec/Database.h"
+#include "mageec/DecisionServer.h"
 #include "mageec/Framework.h"
 #include "mageec/ML/C5.h"
 #include "mageec/ML/1NN.h"
+#include "mageec/ML/KNN.h"
+#include "mageec/Spool.h"
 #include "mageec/Util.h"
 
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <map>
 #include <memory>
 #include <set>
 #include <sstream>
+#include <vector>
 
 namespace mageec {
 
@@ -51,7 +58,11 @@ enum class DriverMode {
   /// Mode to add results from a file
   kAddResults,
   /// Mode to garbage collect stale entries in the file
-  kGarbageCollect
+  kGarbageCollect,
+  /// Mode to ingest feature sets spooled by a feature extractor
+  kIngest,
+  /// Mode to serve decisions from the trained machine learners
+  kServe
 };
 
 } // end of namespace mageec
@@ -93,12 +104,22 @@ static void printHelp()
 "\n"
 "mode:\n"
 "  --create                Create a new empty database.\n"
+"  --append <arg>...       Append the contents of one or more databases to\n"
+"                          the database\n"
 "  --train                 Train an existing database, using machine\n"
 "                          learners provided via the --ml flag\n"
 "  --garbage-collect       Delete anything from the database which is not\n"
 "                          associated with a result\n"
 "  --add-results <arg>     Add results from the provided file into the\n"
 "                          database\n"
+"  --serve <arg>           Serve decisions from the machine learners trained\n"
+"                          in the database on the provided UNIX domain\n"
+"                          socket, until interrupted\n"
+"  --ingest <arg>          Add the feature sets from a spool file, or a\n"
+"                          directory of spool files, into the database. The\n"
+"                          spool files are deleted once ingested, unless\n"
+"                          they hold a corrupt record, in which case they\n"
+"                          are kept with a .bad extension\n"
 "\n"
 "options:\n"
 "  --help                  Print this help information\n"
@@ -116,11 +137,19 @@ static void printHelp()
 // FIXME: ml-config
 "  --metric <arg>          Adds a new metric which the provided machine\n"
 "                          learners should be trained with\n"
+"  --jobs <arg>            Number of classifiers to train concurrently, or 0\n"
+"                          to use one per hardware thread (default: 1)\n"
+"  --wal                   Create the database with a write-ahead log, so\n"
+"                          that many compiler processes can record to it at\n"
+"                          once\n"
 "\n"
 "examples:\n"
 "  mageec --help --version\n"
 "  mageec foo.db --create\n"
+"  mageec foo.db --append node1.db node2.db\n"
 "  mageec bar.db --train --ml path/to/ml_plugin.so\n"
+"  mageec bar.db --ingest path/to/spool_dir\n"
+"  mageec bar.db --serve /tmp/mageec.sock\n"
 "  mageec baz.db --train --ml deadbeef-ca75-4096-a935-15cabba9e5\n";
 }
 
@@ -223,10 +252,14 @@ static void printMLInterfaces(Framework &framework) {
 ///
 /// \param framework Framework instance to create the database
 /// \param db_path Path of the database to be created
+/// \param with_wal Whether the database should use a write-ahead log
 ///
 /// \return true on success, false if the database could not be created.
-static bool createDatabase(Framework &framework, const std::string &db_path) {
-  std::unique_ptr<Database> db = framework.getDatabase(db_path, true);
+static bool createDatabase(Framework &framework, const std::string &db_path,
+                           bool with_wal) {
+  DatabaseOptions options;
+  options.with_wal = with_wal;
+  std::unique_ptr<Database> db = framework.getDatabase(db_path, true, options);
   if (!db) {
     MAGEEC_ERR("Error creating new database. The database may already exist, "
                "or you may not have sufficient permissions to create the "
@@ -236,16 +269,16 @@ static bool createDatabase(Framework &framework, const std::string &db_path) {
   return true;
 }
 
-/// \brief Append one database to another
+/// \brief Append databases to another
 ///
 /// \param framework Framework instance to load the databases
 /// \param db_path Database to be appended to
-/// \param append_db_path Database to append
+/// \param append_db_paths Databases to append, in order
 ///
-/// \return true on success, false if the database could not be appended
-static bool appendDatabase(Framework &framework,
-                           const std::string &db_path,
-                           const std::string &append_db_path) {
+/// \return true on success, false if a database could not be appended
+static bool appendDatabases(Framework &framework,
+                            const std::string &db_path,
+                            const std::vector<std::string> &append_db_paths) {
   std::unique_ptr<Database> db = framework.getDatabase(db_path, false);
   if (!db) {
     MAGEEC_ERR("Error loading database '" + db_path + "'. The database may not "
@@ -253,15 +286,21 @@ static bool appendDatabase(Framework &framework,
                "read/write to it");
     return false;
   }
-  std::unique_ptr<Database> append_db = framework.getDatabase(append_db_path,
-                                                              false);
-  if (!append_db) {
-    MAGEEC_ERR("Error loading database for appending '" + append_db_path + "'. "
-               "The database may not exist, or you may not have sufficient "
-               "permissions to read/write to it");
-    return false;
+  for (const auto &append_db_path : append_db_paths) {
+    std::unique_ptr<Database> append_db =
+        framework.getDatabase(append_db_path, false);
+    if (!append_db) {
+      MAGEEC_ERR("Error loading database for appending '" + append_db_path +
+                 "'. The database may not exist, or you may not have "
+                 "sufficient permissions to read/write to it");
+      return false;
+    }
+    MAGEEC_DEBUG("Appending database '" << append_db_path << "'");
+    if (!db->appendDatabase(*append_db)) {
+      return false;
+    }
   }
-  return db->appendDatabase(*append_db);
+  return true;
 }
 
 /// \brief Train a database
@@ -491,24 +530,160 @@ static bool garbageCollect(Framework &framework, const std::string &db_path) {
   return true;
 }
 
+/// \brief Add spooled feature sets to a database
+///
+/// All of the feature sets are added in a single transaction. The
+/// identifiers of the feature sets are then emitted to the output files
+/// named in the spool, in the same form as when the feature extractor adds
+/// the feature sets to the database itself.
+///
+/// \param framework Framework instance to load the database
+/// \param db_path Path to the database to add the feature sets to
+/// \param spool_path Path of a spool file, or a directory of spool files
+///
+/// \return true on successful addition of the feature sets, false otherwise
+static bool ingestSpool(Framework &framework, const std::string &db_path,
+                        const std::string &spool_path) {
+  std::unique_ptr<Database> db = framework.getDatabase(db_path, false);
+  if (!db) {
+    MAGEEC_ERR("Error retrieving database. The database may not exist, "
+               "or you may not have sufficient permissions to read it");
+    return false;
+  }
+
+  auto spool_files = findSpoolFiles(spool_path);
+  if (!spool_files) {
+    MAGEEC_ERR("Error finding spool files");
+    return false;
+  }
+
+  // Each file is claimed before it is read, so that records appended by
+  // compilers which are still running go to a new file, rather than being
+  // lost when this file is removed.
+  std::vector<SpoolRecord> records;
+  std::vector<std::string> complete_files;
+  std::vector<std::string> bad_files;
+  bool all_read = true;
+  for (const auto &spool_file : spool_files.get()) {
+    auto claimed_file = claimSpoolFile(spool_file);
+    if (!claimed_file) {
+      continue;
+    }
+    bool complete;
+    auto file_records = readSpoolRecords(claimed_file.get(), complete);
+    if (!file_records) {
+      MAGEEC_ERR("Error reading spool file '" << claimed_file.get() << "'");
+      setAsideSpoolFile(claimed_file.get());
+      all_read = false;
+      continue;
+    }
+    for (const auto &record : file_records.get()) {
+      records.push_back(record);
+    }
+    if (complete) {
+      complete_files.push_back(claimed_file.get());
+    } else {
+      bad_files.push_back(claimed_file.get());
+    }
+  }
+
+  if (records.size() == 0) {
+    MAGEEC_WARN("No feature sets found in the provided spool, nothing will "
+                "be added to the database");
+  }
+
+  MAGEEC_DEBUG("Adding " << records.size() << " spooled feature sets to the "
+               "database");
+  std::vector<FeatureSet> feature_sets;
+  feature_sets.reserve(records.size());
+  for (const auto &record : records) {
+    feature_sets.push_back(record.features);
+  }
+  std::vector<FeatureSetID> feature_set_ids = db->newFeatureSets(feature_sets);
+  assert(feature_set_ids.size() == records.size());
+
+  std::map<std::string, std::unique_ptr<std::ofstream>> out_files;
+  for (unsigned i = 0; i < records.size(); ++i) {
+    const SpoolRecord &record = records[i];
+    auto &out_file = out_files[record.out_path];
+    if (!out_file) {
+      out_file.reset(new std::ofstream(record.out_path, std::ofstream::app));
+    }
+    *out_file << record.src_path << ',' << record.type << ','
+              << record.name << ",features,"
+              << static_cast<uint64_t>(feature_set_ids[i])
+              << ",feature_class,"
+              << static_cast<uint64_t>(record.feature_class) << '\n';
+  }
+  for (auto &out_file : out_files) {
+    out_file.second->close();
+    if (!*out_file.second) {
+      MAGEEC_ERR("Error writing feature set identifiers to '"
+                 << out_file.first << "'");
+      return false;
+    }
+  }
+
+  // The feature sets are now recorded, so remove the spool files so that
+  // they are not ingested again. Files which were not read to their end
+  // are kept, as they may hold records after the corrupt record.
+  for (const auto &spool_file : complete_files) {
+    if (std::remove(spool_file.c_str()) != 0) {
+      MAGEEC_WARN("Could not remove ingested spool file '" << spool_file
+                  << "'");
+    }
+  }
+  for (const auto &spool_file : bad_files) {
+    setAsideSpoolFile(spool_file);
+  }
+  return all_read;
+}
+
+/// \brief Serve decisions from the machine learners trained in a database
+///
+/// \param framework Framework instance to load the database
+/// \param db_path Path to the database holding the trained machine learners
+/// \param socket_path Path of the UNIX domain socket to serve decisions on
+///
+/// \return true if the server ran and was stopped, false if it could not be
+/// started
+static bool serveDatabase(Framework &framework, const std::string &db_path,
+                          const std::string &socket_path) {
+  std::unique_ptr<Database> db = framework.getDatabase(db_path, false);
+  if (!db) {
+    MAGEEC_ERR("Error retrieving database. The database may not exist, "
+               "or you may not have sufficient permissions to read it");
+    return false;
+  }
+  return serveDecisions(*db, socket_path);
+}
+
 /// \brief Entry point for the MAGEEC driver
 int main(int argc, const char *argv[]) {
   DriverMode mode = DriverMode::kNone;
 
   // The database to be created or trained
   util::Option<std::string> db_str;
-  // The second database to be appended when in 'append' mode
-  util::Option<std::string> append_db_str;
+  // The databases to be appended when in 'append' mode
+  std::vector<std::string> append_db_strs;
   // Metrics to train the machine learners
   std::set<std::string> metric_strs;
   // Machine learners to train
   std::set<std::string> ml_strs;
   // The path to the results to be inserted into the database
   util::Option<std::string> results_path;
+  // The path to the spool to be ingested into the database
+  util::Option<std::string> spool_path;
+  // The path of the socket to serve decisions on
+  util::Option<std::string> socket_path;
+  // Number of classifiers to train concurrently
+  unsigned training_jobs = 1;
 
   bool with_db      = false;
   bool with_metric  = false;
   bool with_ml      = false;
+  bool with_jobs    = false;
+  bool with_wal     = false;
 
   bool with_db_version          = false;
   bool with_debug               = false;
@@ -538,12 +713,15 @@ int main(int argc, const char *argv[]) {
         mode = DriverMode::kCreate;
         continue;
       } else if (arg == "--append") {
-        ++i;
-        if (i >= argc) {
+        // Every following argument up to the next option is a database
+        while (i + 1 < argc && argv[i + 1][0] != '-') {
+          ++i;
+          append_db_strs.push_back(std::string(argv[i]));
+        }
+        if (append_db_strs.size() == 0) {
           MAGEEC_ERR("No second database provided for '--append' mode");
           return -1;
         }
-        append_db_str = std::string(argv[i]);
         mode = DriverMode::kAppend;
         continue;
       } else if (arg == "--add-results") {
@@ -555,6 +733,24 @@ int main(int argc, const char *argv[]) {
         results_path = std::string(argv[i]);
         mode = DriverMode::kAddResults;
         continue;
+      } else if (arg == "--ingest") {
+        ++i;
+        if (i >= argc) {
+          MAGEEC_ERR("No spool provided for '--ingest' mode");
+          return -1;
+        }
+        spool_path = std::string(argv[i]);
+        mode = DriverMode::kIngest;
+        continue;
+      } else if (arg == "--serve") {
+        ++i;
+        if (i >= argc) {
+          MAGEEC_ERR("No socket provided for '--serve' mode");
+          return -1;
+        }
+        socket_path = std::string(argv[i]);
+        mode = DriverMode::kServe;
+        continue;
       } else if (arg == "--train") {
         mode = DriverMode::kTrain;
         continue;
@@ -579,6 +775,8 @@ int main(int argc, const char *argv[]) {
       with_print_mls = true;
     } else if (arg == "--database-version") {
       with_db_version = true;
+    } else if (arg == "--wal") {
+      with_wal = true;
     }
 
     else if (arg == "--metric") {
@@ -597,12 +795,32 @@ int main(int argc, const char *argv[]) {
       }
       ml_strs.insert(std::string(argv[i]));
       with_ml = true;
+    } else if (arg == "--jobs") {
+      ++i;
+      if (i >= argc) {
+        MAGEEC_ERR("No '--jobs' value provided");
+        return -1;
+      }
+      char *end;
+      unsigned long jobs = std::strtoul(argv[i], &end, 10);
+      if (*argv[i] == '\0' || *end != '\0' || jobs > 1024) {
+        MAGEEC_ERR("Invalid '--jobs' value: '" << argv[i] << "'");
+        return -1;
+      }
+      training_jobs = static_cast<unsigned>(jobs);
+      with_jobs = true;
     } else if (arg == "--add-results") {
       MAGEEC_ERR("'--add-results' must be the second argument");
       return -1;
     } else if (arg == "--append") {
       MAGEEC_ERR("'--append' must be the second argument");
       return -1;
+    } else if (arg == "--ingest") {
+      MAGEEC_ERR("'--ingest' must be the second argument");
+      return -1;
+    } else if (arg == "--serve") {
+      MAGEEC_ERR("'--serve' must be the second argument");
+      return -1;
     } else {
       MAGEEC_ERR("Unrecognized argument: '" << arg << "'");
       return -1;
@@ -629,13 +847,30 @@ int main(int argc, const char *argv[]) {
       (mode == DriverMode::kCreate) ||
       (mode == DriverMode::kAppend) ||
       (mode == DriverMode::kAddResults) ||
-      (mode == DriverMode::kGarbageCollect)) {
+      (mode == DriverMode::kGarbageCollect) ||
+      (mode == DriverMode::kIngest)) {
     if (with_metric) {
       MAGEEC_WARN("--metric arguments will be ignored for the specified mode");
     }
     if (with_ml) {
       MAGEEC_WARN("--ml arguments will be ignored for the specified mode");
     }
+    if (with_jobs) {
+      MAGEEC_WARN("--jobs argument will be ignored for the specified mode");
+    }
+  }
+  // Machine learners provided in 'serve' mode are loaded so that their
+  // trained entries in the database can be served.
+  if (mode == DriverMode::kServe) {
+    if (with_metric) {
+      MAGEEC_WARN("--metric arguments will be ignored for the specified mode");
+    }
+    if (with_jobs) {
+      MAGEEC_WARN("--jobs argument will be ignored for the specified mode");
+    }
+  }
+  if (mode != DriverMode::kCreate && with_wal) {
+    MAGEEC_WARN("--wal argument will be ignored for the specified mode");
   }
 
   // Initialize the framework, and register some built in machine learners
@@ -644,13 +879,17 @@ int main(int argc, const char *argv[]) {
 
   // C5 classifier
   MAGEEC_DEBUG("Registering C5.0 machine learner interface");
-  std::unique_ptr<IMachineLearner> c5_ml(new C5Driver());
+  std::unique_ptr<IMachineLearner> c5_ml(new C5Driver(training_jobs));
   framework.registerMachineLearner(std::move(c5_ml));
 
   MAGEEC_DEBUG("Register 1-NN machine learner interface");
   std::unique_ptr<IMachineLearner> nn_ml(new OneNN());
   framework.registerMachineLearner(std::move(nn_ml));
 
+  MAGEEC_DEBUG("Register k-NN machine learner interface");
+  std::unique_ptr<IMachineLearner> knn_ml(new KNN());
+  framework.registerMachineLearner(std::move(knn_ml));
+
   // Get the machine learners provided on the command line
   std::set<std::string> mls;
   if (with_ml) {
@@ -687,12 +926,12 @@ int main(int argc, const char *argv[]) {
   case DriverMode::kNone:
     return 0;
   case DriverMode::kCreate:
-    if (!createDatabase(framework, db_str.get())) {
+    if (!createDatabase(framework, db_str.get(), with_wal)) {
       return -1;
     }
     return 0;
   case DriverMode::kAppend:
-    if (!appendDatabase(framework, db_str.get(), append_db_str.get())) {
+    if (!appendDatabases(framework, db_str.get(), append_db_strs)) {
       return -1;
     }
     return 0;
@@ -711,6 +950,16 @@ int main(int argc, const char *argv[]) {
       return -1;
     }
     return 0;
+  case DriverMode::kIngest:
+    if (!ingestSpool(framework, db_str.get(), spool_path.get())) {
+      return -1;
+    }
+    return 0;
+  case DriverMode::kServe:
+    if (!serveDatabase(framework, db_str.get(), socket_path.get())) {
+      return -1;
+    }
+    return 0;
   }
   return 0;
 }
@@ -0,0 +1,156 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===------------------------ MAGEEC flat feature set ---------------------===//
+//
+// This implements the compact FlatFeatureSet representation of a feature
+// set, along with its conversion to and from a FeatureSet.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mageec/FlatFeatureSet.h"
+#include "mageec/Attribute.h"
+#include "mageec/AttributeSet.h"
+#include "mageec/Types.h"
+#include "mageec/Util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace mageec {
+
+/// Serialized values of a boolean feature, indexed by the value
+static const uint8_t bool_blobs[2] = {0, 1};
+
+FlatFeatureSet::FlatFeatureSet(const FeatureSet &features)
+    : m_ids(), m_types(), m_values() {
+  m_ids.reserve(features.size());
+  m_types.reserve(features.size());
+  m_values.reserve(features.size());
+
+  // FeatureSet iterates in ascending order of identifier, so the arrays are
+  // built already sorted.
+  for (const auto &feature : features) {
+    m_ids.push_back(feature->getID());
+    m_types.push_back(feature->getType());
+
+    switch (feature->getType()) {
+    case FeatureType::kBool:
+      m_values.push_back(
+          static_cast<const BoolFeature *>(feature.get())->getValue());
+      break;
+    case FeatureType::kInt:
+      m_values.push_back(
+          static_cast<const IntFeature *>(feature.get())->getValue());
+      break;
+    }
+  }
+}
+
+util::Option<unsigned> FlatFeatureSet::find(unsigned id) const {
+  auto it = std::lower_bound(m_ids.cbegin(), m_ids.cend(), id);
+  if (it == m_ids.cend() || *it != id) {
+    return nullptr;
+  }
+  return static_cast<unsigned>(it - m_ids.cbegin());
+}
+
+FeatureSet FlatFeatureSet::toFeatureSet() const {
+  FeatureSet features;
+  for (unsigned i = 0; i < size(); ++i) {
+    switch (m_types[i]) {
+    case FeatureType::kBool:
+      features.add(std::make_shared<BoolFeature>(m_ids[i], m_values[i] != 0,
+                                                 std::string()));
+      break;
+    case FeatureType::kInt:
+      features.add(
+          std::make_shared<IntFeature>(m_ids[i], m_values[i], std::string()));
+      break;
+    }
+  }
+  return features;
+}
+
+uint64_t FlatFeatureSet::hash() const {
+  uint64_t crc = 0;
+  for (unsigned i = 0; i < size(); ++i) {
+    const uint8_t id_bytes[2] = {static_cast<uint8_t>(m_ids[i]),
+                                 static_cast<uint8_t>(m_ids[i] >> 8)};
+    crc = util::crc64Update(crc, id_bytes, 2);
+    crc = util::crc64Update(crc, getBlob(i), getBlobSize(i));
+  }
+  return crc;
+}
+
+int FlatFeatureSet::compare(const FlatFeatureSet &other) const {
+  if (size() < other.size())
+    return -1;
+  else if (size() > other.size())
+    return 1;
+
+  // Before checking the values of features, check the feature identifiers
+  for (unsigned i = 0; i < size(); ++i) {
+    if (m_ids[i] < other.m_ids[i])
+      return -1;
+    else if (m_ids[i] > other.m_ids[i])
+      return 1;
+  }
+
+  // Now check features one by one, by their serialized values
+  for (unsigned i = 0; i < size(); ++i) {
+    unsigned lhs_size = getBlobSize(i);
+    unsigned rhs_size = other.getBlobSize(i);
+    if (lhs_size != rhs_size)
+      return lhs_size < rhs_size ? -1 : 1;
+
+    int res = std::memcmp(getBlob(i), other.getBlob(i), lhs_size);
+    if (res != 0)
+      return (res > 0) - (res < 0);
+  }
+  return 0;
+}
+
+unsigned FlatFeatureSet::getBlobSize(unsigned index) const {
+  switch (m_types[index]) {
+  case FeatureType::kBool:
+    return sizeof(BoolFeature::value_type);
+  case FeatureType::kInt:
+    return sizeof(IntFeature::value_type);
+  }
+  assert(0 && "Unhandled feature type");
+  return 0;
+}
+
+const uint8_t *FlatFeatureSet::getBlob(unsigned index) const {
+  switch (m_types[index]) {
+  case FeatureType::kBool:
+    return &bool_blobs[m_values[index] != 0];
+  case FeatureType::kInt:
+    // The value is held as an int64_t, so its bytes are exactly those of the
+    // serialized IntFeature.
+    return reinterpret_cast<const uint8_t *>(&m_values[index]);
+  }
+  assert(0 && "Unhandled feature type");
+  return nullptr;
+}
+
+} // end of namespace mageec
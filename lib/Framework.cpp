@@ -78,6 +78,12 @@ bool Framework::registerMachineLearner(std::unique_ptr<IMachineLearner> ml) {
 
 std::unique_ptr<Database> Framework::getDatabase(std::string db_path,
                                                  bool create) const {
+  return getDatabase(db_path, create, DatabaseOptions());
+}
+
+std::unique_ptr<Database>
+Framework::getDatabase(std::string db_path, bool create,
+                       const DatabaseOptions &options) const {
   if (create) {
     MAGEEC_DEBUG("Creating new database '" << db_path << "'");
   } else {
@@ -85,9 +91,9 @@ std::unique_ptr<Database> Framework::getDatabase(std::string db_path,
   }
   std::unique_ptr<Database> db;
   if (create) {
-    db = Database::createDatabase(db_path, m_mls);
+    db = Database::createDatabase(db_path, m_mls, options);
   } else {
-    db = Database::loadDatabase(db_path, m_mls);
+    db = Database::loadDatabase(db_path, m_mls, options);
   }
   return db;
 }
@@ -25,20 +25,494 @@
 
 #include "mageec/Database.h"
 #include "mageec/ML/1NN.h"
+#include "mageec/ML/1NNModel.h"
 #include "mageec/ML.h"
 #include "mageec/Result.h"
 #include "mageec/Types.h"
 #include "mageec/Util.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <iterator>
 #include <map>
 #include <set>
 #include <string>
 #include <vector>
 #include <limits>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace mageec {
 
+const unsigned OneNN::Model::kNoNode;
+const unsigned OneNN::Model::kMaxLeafPoints;
+
+/// Magic number at the start of a training blob. Blobs from before the
+/// format was versioned have no magic number.
+static const uint8_t blob_magic[4] = {'M', 'G', 'N', 'N'};
+
+/// Version of the format of training blobs. Version 1 is the unversioned
+/// format, which holds counts in 16 bits, and so cannot hold more than
+/// 65535 feature points.
+static const unsigned blob_version = 2;
+
+/// \brief Calculate the weighted squared Euclidean distance between two rows
+/// of feature values
+///
+/// Only the features which have a value in both rows contribute to the
+/// distance. Rows are padded to an even length, so are processed in pairs of
+/// values where SSE2 is available.
+static double squaredDistance(const double *a, const double *b,
+                              const double *w, unsigned n) {
+#ifdef __SSE2__
+  __m128d sum = _mm_setzero_pd();
+  for (unsigned i = 0; i < n; i += 2) {
+    __m128d x = _mm_loadu_pd(a + i);
+    __m128d y = _mm_loadu_pd(b + i);
+    __m128d diff = _mm_sub_pd(x, y);
+    __m128d term = _mm_mul_pd(_mm_loadu_pd(w + i), _mm_mul_pd(diff, diff));
+    // Mask out the values where either row has a NaN
+    __m128d known = _mm_cmpord_pd(x, y);
+    sum = _mm_add_pd(sum, _mm_and_pd(known, term));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, sum);
+  return lanes[0] + lanes[1];
+#else
+  double sum = 0.0;
+  for (unsigned i = 0; i < n; ++i) {
+    double diff = a[i] - b[i];
+    if (!std::isnan(diff)) {
+      sum += w[i] * (diff * diff);
+    }
+  }
+  return sum;
+#endif
+}
+
+/// \brief Calculate the weighted Manhattan distance between two rows of
+/// feature values
+static double manhattanDistance(const double *a, const double *b,
+                                const double *w, unsigned n) {
+#ifdef __SSE2__
+  const __m128d sign = _mm_set1_pd(-0.0);
+  __m128d sum = _mm_setzero_pd();
+  for (unsigned i = 0; i < n; i += 2) {
+    __m128d x = _mm_loadu_pd(a + i);
+    __m128d y = _mm_loadu_pd(b + i);
+    __m128d diff = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+    __m128d term = _mm_mul_pd(_mm_loadu_pd(w + i), diff);
+    __m128d known = _mm_cmpord_pd(x, y);
+    sum = _mm_add_pd(sum, _mm_and_pd(known, term));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, sum);
+  return lanes[0] + lanes[1];
+#else
+  double sum = 0.0;
+  for (unsigned i = 0; i < n; ++i) {
+    double diff = a[i] - b[i];
+    if (!std::isnan(diff)) {
+      sum += w[i] * std::fabs(diff);
+    }
+  }
+  return sum;
+#endif
+}
+
+/// \brief Calculate the weighted cosine distance between two rows of feature
+/// values
+///
+/// This is one minus the cosine of the angle between the rows, considering
+/// only the features which have a value in both rows. If either row has no
+/// magnitude in those features then the rows are considered unrelated.
+static double cosineDistance(const double *a, const double *b,
+                             const double *w, unsigned n) {
+  double dot = 0.0;
+  double a_norm = 0.0;
+  double b_norm = 0.0;
+#ifdef __SSE2__
+  __m128d dot_sum = _mm_setzero_pd();
+  __m128d a_sum = _mm_setzero_pd();
+  __m128d b_sum = _mm_setzero_pd();
+  for (unsigned i = 0; i < n; i += 2) {
+    __m128d x = _mm_loadu_pd(a + i);
+    __m128d y = _mm_loadu_pd(b + i);
+    __m128d known = _mm_cmpord_pd(x, y);
+    x = _mm_and_pd(known, x);
+    y = _mm_and_pd(known, y);
+    __m128d wx = _mm_mul_pd(_mm_loadu_pd(w + i), x);
+    __m128d wy = _mm_mul_pd(_mm_loadu_pd(w + i), y);
+    dot_sum = _mm_add_pd(dot_sum, _mm_mul_pd(wx, y));
+    a_sum = _mm_add_pd(a_sum, _mm_mul_pd(wx, x));
+    b_sum = _mm_add_pd(b_sum, _mm_mul_pd(wy, y));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, dot_sum);
+  dot = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, a_sum);
+  a_norm = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, b_sum);
+  b_norm = lanes[0] + lanes[1];
+#else
+  for (unsigned i = 0; i < n; ++i) {
+    if (!std::isnan(a[i]) && !std::isnan(b[i])) {
+      dot += w[i] * a[i] * b[i];
+      a_norm += w[i] * a[i] * a[i];
+      b_norm += w[i] * b[i] * b[i];
+    }
+  }
+#endif
+  if (a_norm == 0.0 || b_norm == 0.0) {
+    return 1.0;
+  }
+  return 1.0 - dot / (std::sqrt(a_norm) * std::sqrt(b_norm));
+}
+
+/// \brief Calculate the distance between two rows of feature values under
+/// a metric
+///
+/// The Euclidean distance is left squared, which preserves the ordering of
+/// distances while saving a square root for every point considered.
+static double rowDistance(DistanceMetric metric, const double *a,
+                          const double *b, const double *w, unsigned n) {
+  switch (metric) {
+  case DistanceMetric::kEuclidean:
+    return squaredDistance(a, b, w, n);
+  case DistanceMetric::kManhattan:
+    return manhattanDistance(a, b, w, n);
+  case DistanceMetric::kCosine:
+    return cosineDistance(a, b, w, n);
+  }
+  assert(0 && "Unhandled distance metric");
+  return 0.0;
+}
+
+/// \brief Consider a point for inclusion in the nearest points found so far
+///
+/// \param nearest Max-heap of at most k of the nearest points found so far
+static void addNeighbor(std::vector<std::pair<double, unsigned>> &nearest,
+                        unsigned k, std::pair<double, unsigned> candidate) {
+  if (nearest.size() < k) {
+    nearest.push_back(candidate);
+    std::push_heap(nearest.begin(), nearest.end());
+  } else if (candidate < nearest.front()) {
+    std::pop_heap(nearest.begin(), nearest.end());
+    nearest.back() = candidate;
+    std::push_heap(nearest.begin(), nearest.end());
+  }
+}
+
+void OneNN::Model::resize(unsigned points) {
+  n_points = points;
+  stride = static_cast<unsigned>(feature_ids.size() + 1) & ~1u;
+  feature_values.assign(n_points * stride,
+                        std::numeric_limits<double>::quiet_NaN());
+  parameter_values.assign(n_points * parameter_ids.size(), 0);
+  parameter_known.assign(n_points * parameter_ids.size(), 0);
+}
+
+util::Option<unsigned>
+OneNN::Model::getFeatureColumn(unsigned feature_id) const {
+  auto it = std::lower_bound(feature_ids.cbegin(), feature_ids.cend(),
+                             feature_id);
+  if (it == feature_ids.cend() || *it != feature_id) {
+    return nullptr;
+  }
+  return static_cast<unsigned>(it - feature_ids.cbegin());
+}
+
+util::Option<unsigned>
+OneNN::Model::getParameterColumn(unsigned param_id) const {
+  auto it = std::lower_bound(parameter_ids.cbegin(), parameter_ids.cend(),
+                             param_id);
+  if (it == parameter_ids.cend() || *it != param_id) {
+    return nullptr;
+  }
+  return static_cast<unsigned>(it - parameter_ids.cbegin());
+}
+
+void OneNN::Model::buildIndex(void) {
+  index_nodes.clear();
+  index_points.resize(n_points);
+  for (unsigned i = 0; i < n_points; ++i) {
+    index_points[i] = i;
+  }
+  if (n_points != 0) {
+    buildIndexNode(0, n_points);
+  }
+}
+
+unsigned OneNN::Model::buildIndexNode(unsigned begin, unsigned end) {
+  unsigned node = static_cast<unsigned>(index_nodes.size());
+  index_nodes.push_back(IndexNode());
+  index_nodes[node].is_leaf = true;
+  index_nodes[node].begin = begin;
+  index_nodes[node].end = end;
+  if (end - begin <= kMaxLeafPoints) {
+    return node;
+  }
+
+  // Split on the feature whose values are most spread out
+  unsigned n_columns = static_cast<unsigned>(feature_ids.size());
+  std::vector<double> min(n_columns, std::numeric_limits<double>::infinity());
+  std::vector<double> max(n_columns, -std::numeric_limits<double>::infinity());
+  for (unsigned i = begin; i < end; ++i) {
+    const double *row = getRow(index_points[i]);
+    for (unsigned j = 0; j < n_columns; ++j) {
+      if (!std::isnan(row[j])) {
+        min[j] = std::min(min[j], row[j]);
+        max[j] = std::max(max[j], row[j]);
+      }
+    }
+  }
+  unsigned column = 0;
+  double spread = 0.0;
+  for (unsigned j = 0; j < n_columns; ++j) {
+    if (max[j] - min[j] > spread) {
+      column = j;
+      spread = max[j] - min[j];
+    }
+  }
+  // All of the points have the same value for every feature they have.
+  if (spread == 0.0) {
+    return node;
+  }
+
+  // Split at the median value, so long as that leaves points below it
+  std::vector<double> values;
+  for (unsigned i = begin; i < end; ++i) {
+    double value = getRow(index_points[i])[column];
+    if (!std::isnan(value)) {
+      values.push_back(value);
+    }
+  }
+  std::sort(values.begin(), values.end());
+  double split = values[values.size() / 2];
+  if (split == values.front()) {
+    split = *std::upper_bound(values.begin(), values.end(), split);
+  }
+
+  // Partition the points into those below the split, those above, and those
+  // with no value for the feature
+  std::vector<unsigned> parts[3];
+  for (unsigned i = begin; i < end; ++i) {
+    double value = getRow(index_points[i])[column];
+    if (std::isnan(value)) {
+      parts[2].push_back(index_points[i]);
+    } else if (value < split) {
+      parts[0].push_back(index_points[i]);
+    } else {
+      parts[1].push_back(index_points[i]);
+    }
+  }
+
+  unsigned children[3];
+  unsigned part_begin = begin;
+  for (unsigned i = 0; i < 3; ++i) {
+    std::copy(parts[i].begin(), parts[i].end(),
+              index_points.begin() + part_begin);
+    unsigned part_end = part_begin + static_cast<unsigned>(parts[i].size());
+    children[i] =
+        parts[i].empty() ? kNoNode : buildIndexNode(part_begin, part_end);
+    part_begin = part_end;
+  }
+
+  // index_nodes may have been reallocated while building the children
+  IndexNode &inner = index_nodes[node];
+  inner.is_leaf = false;
+  inner.column = column;
+  inner.split = split;
+  for (unsigned i = 0; i < 3; ++i) {
+    inner.children[i] = children[i];
+  }
+  return node;
+}
+
+void OneNN::Model::writeIndex(std::vector<uint8_t> &blob) const {
+  // Emit the number of nodes, followed by each node in turn, and then the
+  // ordering of the points referenced by the leaves.
+  // |   32   |
+  // |NumNodes|...
+  // |  8   |  32 | 32 |
+  // |IsLeaf|begin|end | (leaf node)
+  // |  8   |  16  | 64  |  32 |  32 |   32  |
+  // |IsLeaf|FeatID|split|lower|upper|missing| (inner node)
+  // |    32   |   32   |
+  // |NumPoints|PointIdx|...
+  util::write32LE(blob, static_cast<uint32_t>(index_nodes.size()));
+  for (const auto &node : index_nodes) {
+    blob.push_back(node.is_leaf ? 1 : 0);
+    if (node.is_leaf) {
+      util::write32LE(blob, node.begin);
+      util::write32LE(blob, node.end);
+    } else {
+      util::write16LE(blob, feature_ids[node.column]);
+      double split = node.split;
+      // FIXME: Make this safe and portable
+      util::write64LE(blob, *reinterpret_cast<uint64_t *>(&split));
+      for (unsigned i = 0; i < 3; ++i) {
+        util::write32LE(blob, node.children[i]);
+      }
+    }
+  }
+  util::write32LE(blob, static_cast<uint32_t>(index_points.size()));
+  for (auto point : index_points) {
+    util::write32LE(blob, point);
+  }
+}
+
+bool OneNN::Model::readIndex(std::vector<uint8_t>::const_iterator &it,
+                             std::vector<uint8_t>::const_iterator end) {
+  index_nodes.clear();
+  index_points.clear();
+
+  if (end - it < 4) {
+    return false;
+  }
+  unsigned n_nodes = util::read32LE(it);
+  for (unsigned i = 0; i < n_nodes; ++i) {
+    IndexNode node;
+    if (end - it < 9) {
+      return false;
+    }
+    node.is_leaf = *it++ != 0;
+    if (node.is_leaf) {
+      node.begin = util::read32LE(it);
+      node.end = util::read32LE(it);
+      if (node.begin > node.end || node.end > n_points) {
+        return false;
+      }
+    } else {
+      if (end - it < 22) {
+        return false;
+      }
+      util::Option<unsigned> column = getFeatureColumn(util::read16LE(it));
+      if (!column) {
+        return false;
+      }
+      node.column = column.get();
+      uint64_t split = util::read64LE(it);
+      // FIXME: Make this safe and portable
+      node.split = *reinterpret_cast<double *>(&split);
+      for (unsigned j = 0; j < 3; ++j) {
+        node.children[j] = util::read32LE(it);
+        if (node.children[j] != kNoNode && node.children[j] >= n_nodes) {
+          return false;
+        }
+      }
+    }
+    index_nodes.push_back(node);
+  }
+
+  if (end - it < 4) {
+    return false;
+  }
+  if (util::read32LE(it) != n_points || end - it < 4 * n_points) {
+    return false;
+  }
+  for (unsigned i = 0; i < n_points; ++i) {
+    unsigned point = util::read32LE(it);
+    if (point >= n_points) {
+      return false;
+    }
+    index_points.push_back(point);
+  }
+  return index_nodes.empty() == (n_points == 0);
+}
+
+std::vector<OneNN::Model::Neighbor>
+OneNN::Model::findNearest(const std::vector<double> &query, unsigned k,
+                          DistanceMetric metric,
+                          const std::vector<double> &weights) const {
+  assert(query.size() == stride);
+  assert(weights.size() == stride);
+
+  std::vector<Neighbor> nearest;
+  if (k == 0 || index_nodes.empty()) {
+    return nearest;
+  }
+  nearest.reserve(k);
+
+  if (metric == DistanceMetric::kCosine) {
+    // The cosine distance to a point is not bounded by its distance along a
+    // single feature, so the index cannot prune anything.
+    for (unsigned point = 0; point < n_points; ++point) {
+      double distance = rowDistance(metric, query.data(), getRow(point),
+                                    weights.data(), stride);
+      addNeighbor(nearest, k, Neighbor(distance, point));
+    }
+  } else {
+    searchIndex(0, query.data(), weights.data(), metric, k, nearest);
+  }
+
+  std::sort_heap(nearest.begin(), nearest.end());
+  if (metric == DistanceMetric::kEuclidean) {
+    for (auto &neighbor : nearest) {
+      neighbor.first = std::sqrt(neighbor.first);
+    }
+  }
+  return nearest;
+}
+
+void OneNN::Model::searchIndex(unsigned node, const double *query,
+                               const double *weights, DistanceMetric metric,
+                               unsigned k,
+                               std::vector<Neighbor> &nearest) const {
+  const IndexNode &curr = index_nodes[node];
+  if (curr.is_leaf) {
+    // Ties are broken by the order of the points, so that the result is the
+    // same as that of a linear search.
+    for (unsigned i = curr.begin; i < curr.end; ++i) {
+      unsigned point = index_points[i];
+      double distance =
+          rowDistance(metric, query, getRow(point), weights, stride);
+      addNeighbor(nearest, k, Neighbor(distance, point));
+    }
+    return;
+  }
+
+  unsigned lower = curr.children[0];
+  unsigned upper = curr.children[1];
+  unsigned missing = curr.children[2];
+
+  // If the query has no value for the split feature, then nothing can be
+  // pruned at this node.
+  double query_value = query[curr.column];
+  if (std::isnan(query_value)) {
+    for (unsigned child : {lower, upper, missing}) {
+      if (child != kNoNode) {
+        searchIndex(child, query, weights, metric, k, nearest);
+      }
+    }
+    return;
+  }
+
+  // Search the side of the split containing the query first. Points on the
+  // far side are at least the distance to the split away from the query.
+  double diff = query_value - curr.split;
+  unsigned near = diff < 0.0 ? lower : upper;
+  unsigned far = diff < 0.0 ? upper : lower;
+  if (near != kNoNode) {
+    searchIndex(near, query, weights, metric, k, nearest);
+  }
+  if (missing != kNoNode) {
+    searchIndex(missing, query, weights, metric, k, nearest);
+  }
+  if (far == kNoNode) {
+    return;
+  }
+  double bound = metric == DistanceMetric::kEuclidean
+                     ? weights[curr.column] * (diff * diff)
+                     : weights[curr.column] * std::fabs(diff);
+  if (nearest.size() < k || bound <= nearest.front().first) {
+    searchIndex(far, query, weights, metric, k, nearest);
+  }
+}
+
 OneNN::OneNN() : IMachineLearner() {}
 OneNN::~OneNN() {}
 
@@ -46,66 +520,156 @@ std::unique_ptr<DecisionBase>
 OneNN::makeDecision(const DecisionRequestBase &request,
                     const FeatureSet &features,
                     const std::vector<uint8_t> &blob) const {
+  return makeDecision(request, features, *loadModel(blob));
+}
+
+std::unique_ptr<IModel>
+OneNN::loadModel(const std::vector<uint8_t> &blob) const {
   // Deserialize from the blob
-  std::map<unsigned, std::pair<double, double>> feature_max_min;
-  std::vector<OneNN::Point> feature_points;
+  std::unique_ptr<OneNN::Model> model(new OneNN::Model());
   
   auto it = blob.cbegin();
 
+  // Read the magic number and version, if present
+  // |  32 |   16  |
+  // |Magic|Version|
+  unsigned version = 1;
+  if (blob.size() >= sizeof(blob_magic) &&
+      std::equal(std::begin(blob_magic), std::end(blob_magic), it)) {
+    it += sizeof(blob_magic);
+    version = util::read16LE(it);
+    assert(version == blob_version && "Unsupported 1-NN blob version");
+  }
+  // Counts are 32 bits wide, except in the unversioned format
+  auto readCount = [&it, version]() -> unsigned {
+    return version == 1 ? util::read16LE(it) : util::read32LE(it);
+  };
+
   // Read the number of features, followed by the feature ids, and the
   // min and max ranges for each feature
-  // |    16     |  16  | 64  | 64  |...
+  // |    32     |  16  | 64  | 64  |...
   // |NumFeatures|FeatID| max | min |...
-  unsigned n_features = util::read16LE(it);
+  unsigned n_features = readCount();
   for (unsigned i = 0; i < n_features; ++i) {
     unsigned feature_id = util::read16LE(it);
     uint64_t max = util::read64LE(it);
     uint64_t min = util::read64LE(it);
+    model->feature_ids.push_back(feature_id);
     // FIXME: Make this safe and portable
-    feature_max_min[feature_id] =
+    model->feature_max_min.push_back(
         std::pair<double, double>(*reinterpret_cast<double *>(&max),
-                                  *reinterpret_cast<double *>(&min));
+                                  *reinterpret_cast<double *>(&min)));
   }
+  assert(std::is_sorted(model->feature_ids.cbegin(),
+                        model->feature_ids.cend()));
+
   // Read the number of feature points, followed by each feature point in
   // turn.
-  // |   16    |    ??      |    ??      |
+  // |   32    |    ??      |    ??      |
   // |NumPoints|FeaturePoint|FeaturePoint|...
-  unsigned n_points = util::read16LE(it);
+  unsigned n_points = readCount();
+
+  // The parameters seen during training are not recorded up front, so the
+  // parameters of each point are held until they are all known.
+  std::vector<std::vector<std::pair<unsigned, int64_t>>> point_parameters;
+  std::set<unsigned> parameter_ids;
+  point_parameters.reserve(n_points);
+
+  model->resize(n_points);
   for (unsigned i = 0; i < n_points; ++i) {
     // Read each feature point. This consists of each feature value in turn,
     // followed by each parameter in turn
-    // |    16     |  16  | 64  |...|      16     |  16   | 64  |...
+    // |    32     |  16  | 64  |...|      32     |  16   | 64  |...
     // |NumFeatures|FeatID|value|...|NumParameters|ParamID|value|...
-    unsigned tmp_n_features = util::read16LE(it);
-    assert(tmp_n_features == n_features);
+    // A point has no value for features which were missing from its
+    // feature set.
+    unsigned tmp_n_features = readCount();
+    assert(tmp_n_features <= n_features);
 
-    std::map<unsigned, double> features;
-    for (unsigned j = 0; j < n_features; ++j) {
+    double *row = &model->feature_values[i * model->stride];
+    for (unsigned j = 0; j < tmp_n_features; ++j) {
       unsigned id = util::read16LE(it);
       uint64_t value = util::read64LE(it);
-      features[id] = *reinterpret_cast<double*>(&value);
+      util::Option<unsigned> column = model->getFeatureColumn(id);
+      assert(column && "Feature point has a feature with no range");
+      row[column.get()] = *reinterpret_cast<double*>(&value);
     }
-    unsigned n_parameters = util::read16LE(it);
-    std::map<unsigned, int64_t> parameters;
+    unsigned n_parameters = readCount();
+    std::vector<std::pair<unsigned, int64_t>> parameters;
     for (unsigned j = 0; j < n_parameters; ++j) {
       unsigned id = util::read16LE(it);
       int64_t value = util::read64LE(it);
-      parameters[id] = value;
+      parameters.push_back(std::make_pair(id, value));
+      parameter_ids.insert(id);
     }
-    OneNN::Point point = {features, parameters};
-    feature_points.push_back(point);
+    point_parameters.push_back(parameters);
+  }
+
+  // Now the parameters are known, fill in their matrix
+  model->parameter_ids.assign(parameter_ids.cbegin(), parameter_ids.cend());
+  model->parameter_values.assign(n_points * parameter_ids.size(), 0);
+  model->parameter_known.assign(n_points * parameter_ids.size(), 0);
+  for (unsigned i = 0; i < n_points; ++i) {
+    for (auto param : point_parameters[i]) {
+      unsigned column = model->getParameterColumn(param.first).get();
+      model->parameter_values[i * parameter_ids.size() + column] = param.second;
+      model->parameter_known[i * parameter_ids.size() + column] = 1;
+    }
+  }
+
+  // The index over the feature points follows. Blobs from before the index
+  // was introduced do not have one, so it is built now instead.
+  if (!model->readIndex(it, blob.cend())) {
+    MAGEEC_DEBUG("Building 1-NN index for " << n_points << " points");
+    model->buildIndex();
+  }
+  return std::unique_ptr<IModel>(std::move(model));
+}
+
+std::unique_ptr<DecisionBase>
+OneNN::makeDecision(const DecisionRequestBase &request,
+                    const FeatureSet &features,
+                    const IModel &model) const {
+  const auto &nn_model = static_cast<const OneNN::Model &>(model);
+  return decide(request, nn_model, findNearestNeighbor(nn_model, features));
+}
+
+std::vector<std::unique_ptr<DecisionBase>> OneNN::makeDecisions(
+    const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+    const FeatureSet &features, const IModel &model) const {
+  const auto &nn_model = static_cast<const OneNN::Model &>(model);
+
+  // Every decision is made using the same nearest neighbor, so only search
+  // for it once.
+  util::Option<unsigned> nearest_neighbor =
+      findNearestNeighbor(nn_model, features);
+
+  std::vector<std::unique_ptr<DecisionBase>> decisions;
+  decisions.reserve(requests.size());
+  for (const auto &request : requests) {
+    decisions.push_back(decide(*request, nn_model, nearest_neighbor));
   }
+  return decisions;
+}
 
-  // Take the input features and normalize them
-  std::map<unsigned, double> query_features;
+std::vector<double>
+OneNN::normalizeFeatures(const OneNN::Model &nn_model,
+                         const FeatureSet &features) const {
+  std::vector<double> query(nn_model.stride,
+                            std::numeric_limits<double>::quiet_NaN());
   for (auto f : features) {
-    double max = feature_max_min[f->getID()].first;
-    double min = feature_max_min[f->getID()].second;
+    util::Option<unsigned> column = nn_model.getFeatureColumn(f->getID());
+    if (!column) {
+      continue;
+    }
+    double max = nn_model.feature_max_min[column.get()].first;
+    double min = nn_model.feature_max_min[column.get()].second;
+
     switch(f->getType()) {
     case FeatureType::kBool: {
       bool value = static_cast<BoolFeature *>(f.get())->getValue();
       double double_value = value ? 1.0 : 0;
-      query_features[f->getID()] = double_value;
+      query[column.get()] = double_value;
       break;
     }
     case FeatureType::kInt: {
@@ -115,63 +679,62 @@ OneNN::makeDecision(const DecisionRequestBase &request,
         double_value = (double_value - min) / (max - min);
       else
         double_value = 0.0;
-      query_features[f->getID()] = double_value;
+      query[column.get()] = double_value;
       break;
     }
     }
   }
 
+  return query;
+}
+
+unsigned OneNN::getParameterID(const DecisionRequestBase &request) const {
+  DecisionRequestType request_type = request.getType();
+  if (request_type == DecisionRequestType::kBool) {
+    return static_cast<const BoolDecisionRequest &>(request).getID();
+  } else if (request_type == DecisionRequestType::kRange) {
+    return static_cast<const RangeDecisionRequest &>(request).getID();
+  }
+  assert(0 && "Unhandled decision request type");
+  return 0;
+}
+
+util::Option<unsigned>
+OneNN::findNearestNeighbor(const OneNN::Model &nn_model,
+                           const FeatureSet &features) const {
+  std::vector<double> query = normalizeFeatures(nn_model, features);
+  std::vector<double> weights(nn_model.stride, 1.0);
+
   // Find the closest point to the query point
-  // TODO: Don't use a dumb n^2 search here
-  double min_squared_distance = std::numeric_limits<double>::max();
-  OneNN::Point nearest_neighbor;
-  for (auto point : feature_points) {
-    // calculate the distance between the query point and this point. If
-    // any feature is missing, then just ignore it.
-    for (auto query_feature : query_features) {
-      double squared_distance = 0.0;
-      if (point.features.count(query_feature.first)) {
-        double value = point.features[query_feature.first];
-        double query_value = query_feature.second;
-        double diff = value - query_value;
-        double squared_diff = diff * diff;
-        squared_distance += squared_diff;
-      }
-      if (squared_distance < min_squared_distance) {
-        min_squared_distance = squared_distance;
-        nearest_neighbor = point;
-      }
-    }
+  std::vector<OneNN::Model::Neighbor> nearest =
+      nn_model.findNearest(query, 1, DistanceMetric::kEuclidean, weights);
+  if (nearest.empty()) {
+    return nullptr;
   }
+  return nearest[0].second;
+}
 
+std::unique_ptr<DecisionBase>
+OneNN::decide(const DecisionRequestBase &request, const OneNN::Model &nn_model,
+              util::Option<unsigned> nearest_neighbor) const {
   // Get the parameter from the parameter set associated with the nearest
   // neighbor.
-  DecisionRequestType request_type = request.getType();
-
-  if (request_type == DecisionRequestType::kBool) {
-    const auto *bool_request =
-        static_cast<const BoolDecisionRequest *>(&request);
-    unsigned param_id = bool_request->getID();
-
-    if (nearest_neighbor.parameters.count(param_id)) {
-      int64_t res = nearest_neighbor.parameters[param_id];
-      return std::unique_ptr<BoolDecision>(new BoolDecision(res));
-    }
+  util::Option<unsigned> column =
+      nn_model.getParameterColumn(getParameterID(request));
+  if (!nearest_neighbor || !column) {
     return std::unique_ptr<NativeDecision>(new NativeDecision());
-  } else if (request_type == DecisionRequestType::kRange) {
-    const auto *range_request =
-        static_cast<const RangeDecisionRequest *>(&request);
-    unsigned param_id = range_request->getID();
-
-    if (nearest_neighbor.parameters.count(param_id)) {
-      int64_t res = nearest_neighbor.parameters[param_id];
-      return std::unique_ptr<RangeDecision>(new RangeDecision(res));
-    }
+  }
+  unsigned n_parameters = static_cast<unsigned>(nn_model.parameter_ids.size());
+  unsigned index = nearest_neighbor.get() * n_parameters + column.get();
+  if (!nn_model.parameter_known[index]) {
     return std::unique_ptr<NativeDecision>(new NativeDecision());
-  } else {
-    assert(0 && "Unhandled decision request type");
   }
-  return std::unique_ptr<NativeDecision>(new NativeDecision());
+
+  int64_t res = nn_model.parameter_values[index];
+  if (request.getType() == DecisionRequestType::kBool) {
+    return std::unique_ptr<BoolDecision>(new BoolDecision(res));
+  }
+  return std::unique_ptr<RangeDecision>(new RangeDecision(res));
 }
 
 const std::vector<uint8_t>
@@ -179,42 +742,23 @@ OneNN::train(std::set<FeatureDesc> feature_descs,
              std::set<ParameterDesc>,
              std::set<std::string>,
              ResultIterator result_iter) const {
-  // Read all of the results data in one go. For each distinct set of input
-  // features, store the best set of results. This is achieved by storing a
-  // hash from a feature set to its current best result.
+  // Read all of the results data in one go. The iterator provides only the
+  // best result for each distinct set of input features, so each is stored
+  // by the hash of its features. Distinct feature sets may still share a
+  // hash, in which case the next free hash is used.
   MAGEEC_DEBUG("Collecting results");
-  std::map<uint64_t, Result> result_map;
+  std::map<uint64_t, FlatResult> result_map;
   for (util::Option<Result> result; (result = *result_iter);
        result_iter = result_iter.next()) {
-    FeatureSet features = result.get().getFeatures();
-    double value = result.get().getValue();
-    uint64_t hash = features.hash();
-
-    bool result_handled = false;
-    while (!result_handled) {
-      auto curr_entry = result_map.find(hash);
-      if (curr_entry != result_map.end()) {
-        const FeatureSet &curr_features = curr_entry->second.getFeatures();
-        double curr_value = curr_entry->second.getValue();
-
-        if (features == curr_features) {
-          if (value < curr_value) {
-            result_map.at(hash) = result.get();
-          }
-          result_handled = true;
-        } else {
-          hash++;
-        }
-      } else {
-        result_map.emplace(hash, result.get());
-        result_handled = true;
-      }
+    FlatResult flat_result(result.get());
+    uint64_t hash = flat_result.getFeatures().hash();
+    while (!result_map.emplace(hash, flat_result).second) {
+      hash++;
     }
   }
 
   std::map<unsigned, FeatureType> feature_type;
   std::map<unsigned, std::pair<double, double>> feature_max_min;
-  std::vector<OneNN::Point> feature_points;
 
   // Get all of the feature ids and their types
   for (auto desc : feature_descs) {
@@ -226,25 +770,26 @@ OneNN::train(std::set<FeatureDesc> feature_descs,
   }
 
   // Find the max and min of each feature
-  for (auto res : result_map) {
-    FeatureSet features = res.second.getFeatures();
-    for (auto f : features) {
-      assert(feature_type.count(f->getID()));
-      assert(feature_type[f->getID()] == f->getType());
+  for (const auto &res : result_map) {
+    const FlatFeatureSet &features = res.second.getFeatures();
+    for (unsigned i = 0; i < features.size(); ++i) {
+      unsigned id = features.getID(i);
+      assert(feature_type.count(id));
+      assert(feature_type[id] == features.getType(i));
 
-      switch (f->getType()) {
+      switch (features.getType(i)) {
       case FeatureType::kBool: {
-        if (feature_max_min.count(f->getID()) == 0)
-          feature_max_min[f->getID()] = std::make_pair<double, double>(1.0, 0.0);
+        if (feature_max_min.count(id) == 0)
+          feature_max_min[id] = std::make_pair<double, double>(1.0, 0.0);
+        break;
       }
       case FeatureType::kInt: {
-        int64_t value = static_cast<IntFeature *>(f.get())->getValue();
-        double double_value = static_cast<double>(value);
-        if (feature_max_min.count(f->getID()) == 0) {
-          feature_max_min[f->getID()] =
+        double double_value = static_cast<double>(features.getValue(i));
+        if (feature_max_min.count(id) == 0) {
+          feature_max_min[id] =
               std::pair<double, double>(double_value, double_value);
         } else {
-          auto &entry = feature_max_min[f->getID()];
+          auto &entry = feature_max_min[id];
           if (double_value < entry.first)
             entry.first = double_value;
           if (double_value > entry.second)
@@ -257,44 +802,64 @@ OneNN::train(std::set<FeatureDesc> feature_descs,
 
   // Add a point for each feature set, normalize the features in the process to
   // the range [0, 1]
-  for (auto res : result_map) {
-    ParameterSet parameters = res.second.getParameters();
-    FeatureSet features = res.second.getFeatures();
+  OneNN::Model model;
+  for (auto feat_max_min : feature_max_min) {
+    model.feature_ids.push_back(feat_max_min.first);
+    model.feature_max_min.push_back(feat_max_min.second);
+  }
+  std::set<unsigned> parameter_ids;
+  for (const auto &res : result_map) {
+    for (auto p : res.second.getParameters()) {
+      parameter_ids.insert(p->getID());
+    }
+  }
+  model.parameter_ids.assign(parameter_ids.cbegin(), parameter_ids.cend());
+  model.resize(static_cast<unsigned>(result_map.size()));
+  unsigned n_parameters = static_cast<unsigned>(model.parameter_ids.size());
 
-    OneNN::Point point;
-    for (auto f : features) {
-      assert(feature_type[f->getID()] == f->getType());
+  unsigned point = 0;
+  for (const auto &res : result_map) {
+    const ParameterSet &parameters = res.second.getParameters();
+    const FlatFeatureSet &features = res.second.getFeatures();
 
-      switch (f->getType()) {
+    double *row = &model.feature_values[point * model.stride];
+    for (unsigned i = 0; i < features.size(); ++i) {
+      unsigned id = features.getID(i);
+      assert(feature_type[id] == features.getType(i));
+      unsigned column = model.getFeatureColumn(id).get();
+
+      switch (features.getType(i)) {
       case FeatureType::kBool: {
-        bool value = static_cast<BoolFeature *>(f.get())->getValue();
-        point.features[f->getID()] = value ? 1.0 : 0.0;
+        row[column] = features.getValue(i) ? 1.0 : 0.0;
         break;
       }
       case FeatureType::kInt: {
-        int64_t value = static_cast<IntFeature *>(f.get())->getValue();
-        double double_value = static_cast<double>(value);
-        double max = feature_max_min[f->getID()].first;
-        double min = feature_max_min[f->getID()].second;
+        double double_value = static_cast<double>(features.getValue(i));
+        double max = feature_max_min[id].first;
+        double min = feature_max_min[id].second;
         if ((max - min) != 0.0)
           double_value = (double_value - min) / (max - min);
         else
           double_value = 0.0;
-        point.features[f->getID()] = double_value;
+        row[column] = double_value;
         break;
       }
       }
     }
     for (auto p : parameters) {
+      unsigned index =
+          point * n_parameters + model.getParameterColumn(p->getID()).get();
       switch(p->getType()) {
       case ParameterType::kBool: {
         bool value = static_cast<BoolParameter*>(p.get())->getValue();
-        point.parameters[p->getID()] = value;
+        model.parameter_values[index] = value;
+        model.parameter_known[index] = 1;
         break;
       } 
       case ParameterType::kRange: {
         int64_t value = static_cast<RangeParameter*>(p.get())->getValue();
-        point.parameters[p->getID()] = value;
+        model.parameter_values[index] = value;
+        model.parameter_known[index] = 1;
         break;
       }
       default:
@@ -302,18 +867,28 @@ OneNN::train(std::set<FeatureDesc> feature_descs,
         break;
       }
     }
-    feature_points.push_back(point);
+    ++point;
   }
 
+  // Index the points, so that the nearest point can be found without
+  // searching all of them.
+  model.buildIndex();
+
   // Serialize to a blob
   // Buffer used to store the training blob
   std::vector<uint8_t> blob;
 
+  // Emit the magic number and version
+  // |  32 |   16  |
+  // |Magic|Version|
+  blob.insert(blob.end(), std::begin(blob_magic), std::end(blob_magic));
+  util::write16LE(blob, blob_version);
+
   // Emit the number of features, followed by the feature ids, and the
   // min and max ranges for each feature
-  // |    16     |  16  | 64  | 64  |...
+  // |    32     |  16  | 64  | 64  |...
   // |NumFeatures|FeatID| max | min |...
-  util::write16LE(blob, feature_max_min.size());
+  util::write32LE(blob, static_cast<uint32_t>(feature_max_min.size()));
   for (auto feat_max_min : feature_max_min) {
     util::write16LE(blob, feat_max_min.first);
     // FIXME: Make this safe and portable
@@ -322,26 +897,42 @@ OneNN::train(std::set<FeatureDesc> feature_descs,
   }
   // Emit the number of feature points, followed by each feature point in
   // turn.
-  // |   16    |    ??      |    ??      |
+  // |   32    |    ??      |    ??      |
   // |NumPoints|FeaturePoint|FeaturePoint|...
-  util::write16LE(blob, feature_points.size());
-  for (auto point : feature_points) {
+  util::write32LE(blob, model.n_points);
+  for (unsigned i = 0; i < model.n_points; ++i) {
     // Emit each feature point. This consists of each feature value in turn,
-    // followed by each parameter in turn
-    // |    16     |  16  | 64  |...|      16     |  16   | 64  |...
+    // followed by each parameter in turn. Missing values are omitted.
+    // |    32     |  16  | 64  |...|      32     |  16   | 64  |...
     // |NumFeatures|FeatID|value|...|NumParameters|ParamID|value|...
-    util::write16LE(blob, point.features.size());
-    for (auto feature : point.features) {
-      util::write16LE(blob, feature.first);
+    const double *row = model.getRow(i);
+    unsigned n_point_features = 0;
+    for (unsigned j = 0; j < model.feature_ids.size(); ++j) {
+      n_point_features += std::isnan(row[j]) ? 0 : 1;
+    }
+    util::write32LE(blob, n_point_features);
+    for (unsigned j = 0; j < model.feature_ids.size(); ++j) {
+      if (std::isnan(row[j]))
+        continue;
+      double value = row[j];
+      util::write16LE(blob, model.feature_ids[j]);
       // FIXME: Make this safe and portable
-      util::write64LE(blob, *reinterpret_cast<uint64_t*>(&feature.second));
+      util::write64LE(blob, *reinterpret_cast<uint64_t*>(&value));
     }
-    util::write16LE(blob, point.parameters.size());
-    for (auto parameter : point.parameters) {
-      util::write16LE(blob, parameter.first);
-      util::write64LE(blob, *reinterpret_cast<uint64_t*>(&parameter.second));
+    unsigned n_point_parameters = 0;
+    for (unsigned j = 0; j < n_parameters; ++j) {
+      n_point_parameters += model.parameter_known[i * n_parameters + j];
+    }
+    util::write32LE(blob, n_point_parameters);
+    for (unsigned j = 0; j < n_parameters; ++j) {
+      if (!model.parameter_known[i * n_parameters + j])
+        continue;
+      util::write16LE(blob, model.parameter_ids[j]);
+      util::write64LE(blob, static_cast<uint64_t>(
+                                model.parameter_values[i * n_parameters + j]));
     }
   }
+  model.writeIndex(blob);
   return blob;
 }
 
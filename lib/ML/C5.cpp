@@ -32,7 +32,9 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <map>
 #include <set>
 #include <string>
@@ -60,6 +62,26 @@ extern "C" {
            char **rulesv,
            char **outputv);
 
+  void c50table(char **namesv,
+                int ncases,
+                const double *const *columns,
+                char **costv,
+                int *subset,
+                int *rules,
+                int *utility,
+                int *trials,
+                int *winnow,
+                double *sample,
+                int *seed,
+                int *noGlobalPruning,
+                double *CF,
+                int *minCases,
+                int *fuzzyThreshold,
+                int *earlyStopping,
+                char **treev,
+                char **rulesv,
+                char **outputv);
+
   void predictions(char **casev,
                    char **namesv,
                    char **treev,
@@ -274,114 +296,588 @@ std::vector<uint8_t> C5Context::toBlob() {
   return blob;
 }
 
-C5Driver::C5Driver() : IMachineLearner() {}
+namespace {
 
-C5Driver::~C5Driver() {}
+/// \class C5Tree
+///
+/// \brief A C5.0 decision tree compiled into a flat array of nodes, so that
+/// it can be evaluated directly against a set of features.
+///
+/// This mirrors the classification performed by the C5.0 predictions
+/// routine for a single tree without misclassification costs, including the
+/// weighting of branches when a feature value is unknown. Trees which use
+/// anything else cannot be compiled, and must be evaluated by C5.0 itself.
+class C5Tree {
+public:
+  /// \brief Value of a feature, as seen by the tree
+  struct Value {
+    /// Whether there is a value for the feature
+    bool known;
+    /// Value of a continuous feature
+    float cont;
+    /// Value of a discrete feature. As in C5.0, 1 is reserved for N/A and
+    /// the values declared in the .names data start at 2.
+    int discr;
+  };
+
+  /// \brief Description of a tree attribute, used when compiling a tree
+  struct AttributeDesc {
+    /// Index of the attribute's value in the vector of values
+    unsigned index;
+    /// Names of the values of a discrete attribute, excluding N/A. Empty if
+    /// the attribute is continuous.
+    std::vector<std::string> values;
+  };
+
+  /// \brief Compile a tree from the text output by C5.0 when training
+  ///
+  /// \param tree_str  The .tree data for the classifier
+  /// \param attributes  Description of each attribute, keyed by the name of
+  /// the attribute in the .names data.
+  /// \param class_names  Names of each class, in the order they are declared
+  /// in the .names data.
+  ///
+  /// \return The compiled tree, or nullptr if the tree could not be compiled.
+  static std::unique_ptr<C5Tree>
+  compile(const std::string &tree_str,
+          const std::map<std::string, AttributeDesc> &attributes,
+          const std::vector<std::string> &class_names);
 
-std::unique_ptr<DecisionBase>
-C5Driver::makeDecision(const DecisionRequestBase &request,
-                       const FeatureSet &features,
-                       const std::vector<uint8_t> &blob) const {
-  // Deserialize the machine learner data from the blob
-  std::unique_ptr<C5Context> context = C5Context::fromBlob(blob);
+  /// \brief Classify a set of feature values using the tree
+  ///
+  /// \param values  The value of each attribute of the tree
+  ///
+  /// \return The predicted class, with the first class numbered from 1
+  int classify(const std::vector<Value> &values) const;
+
+private:
+  /// Types of node, numbered as in C5.0
+  enum NodeType : unsigned {
+    kLeaf = 0,
+    kDiscrete = 1,
+    kThreshold = 2,
+    kSubset = 3
+  };
+
+  struct Node {
+    NodeType type;
+    /// Best class at this node
+    int leaf_class;
+    /// Number of training cases at this node
+    float cases;
+    /// Offset of the class distribution of the node in m_class_dists
+    unsigned class_dist;
+
+    /// Index of the value of the tested attribute
+    unsigned attribute;
+    /// Number of values of the tested attribute, if it is discrete
+    int num_values;
+    /// Number of branches, and offset of the first branch in m_branches
+    int forks;
+    unsigned branches;
+    /// Offset of the first branch's subset in m_subsets
+    unsigned subsets;
+
+    /// Thresholds for a test of a continuous attribute
+    float cut;
+    float lower;
+    float mid;
+    float upper;
+  };
+
+  /// \brief Property of a node, as found in the tree text
+  typedef std::pair<std::string, std::string> Property;
+
+  C5Tree() : m_num_classes(0) {}
+
+  static bool readProperty(const std::string &str, size_t &pos, Property &prop,
+                           char &delim);
+  static std::vector<std::string> unquote(const std::string &value);
+  static std::string unquoteOne(const std::string &value);
+
+  bool compileNode(const std::string &str, size_t &pos,
+                   const std::map<std::string, AttributeDesc> &attributes,
+                   const std::vector<std::string> &class_names,
+                   unsigned &node_index);
+
+  void findLeaf(const std::vector<Value> &values, unsigned node,
+                unsigned parent, float fraction,
+                std::vector<double> &prob) const;
+  void followAllBranches(const std::vector<Value> &values, unsigned node,
+                         float fraction, std::vector<double> &prob) const;
+
+  std::vector<Node> m_nodes;
+  std::vector<unsigned> m_branches;
+  std::vector<uint32_t> m_subsets;
+  std::vector<float> m_class_dists;
+  unsigned m_num_classes;
+
+  /// Marks the absence of a parent node
+  static const unsigned kNoParent = std::numeric_limits<unsigned>::max();
+};
 
-  // Find the appropriate classifier tree for the provided decision request
-  DecisionRequestType request_type = request.getType();
+/// Threshold below which C5.0 treats a count of cases as empty
+const double kC5Epsilon = 1E-4;
 
-  assert((request_type == DecisionRequestType::kBool ||
-          request_type == DecisionRequestType::kRange) &&
-         "Unhandled decision request type");
+/// Value used for attributes which are not tested
+const C5Tree::Value kUnknownValue = {false, 0.0f, 0};
 
-  unsigned param_id;
-  ParameterType param_type;
+bool C5Tree::readProperty(const std::string &str, size_t &pos, Property &prop,
+                          char &delim) {
+  // A property is of the form name="value", and is followed by a space if
+  // there are further properties for the same node, or a newline otherwise.
+  size_t eq = str.find('=', pos);
+  if (eq == std::string::npos) {
+    return false;
+  }
+  prop.first = str.substr(pos, eq - pos);
+  pos = eq + 1;
+
+  bool quote = false;
+  prop.second.clear();
+  for (; pos < str.size(); ++pos) {
+    char c = str[pos];
+    if (!quote && (c == ' ' || c == '\n')) {
+      break;
+    }
+    prop.second.push_back(c);
+    if (c == '\\' && pos + 1 < str.size()) {
+      prop.second.push_back(str[++pos]);
+    } else if (c == '"') {
+      quote = !quote;
+    }
+  }
+  if (pos == str.size()) {
+    return false;
+  }
+  delim = str[pos++];
+  return true;
+}
 
-  // The ID is the identifier of the tunable parameter
-  if (request_type == DecisionRequestType::kBool) {
-    const auto *bool_request =
-        static_cast<const BoolDecisionRequest *>(&request);
-    param_id = bool_request->getID();
+std::vector<std::string> C5Tree::unquote(const std::string &value) {
+  // Values are a comma separated list of quoted strings
+  std::vector<std::string> res;
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] != '"') {
+      continue;
+    }
+    std::string str;
+    for (++i; i < value.size() && value[i] != '"'; ++i) {
+      if (value[i] == '\\') {
+        ++i;
+      }
+      str.push_back(value[i]);
+    }
+    res.push_back(str);
+  }
+  return res;
+}
 
-    assert(bool_request->getDecisionType() == DecisionType::kBool);
-    param_type = ParameterType::kBool;
-  } else if (request_type == DecisionRequestType::kRange) {
-    const auto *range_request =
-        static_cast<const RangeDecisionRequest *>(&request);
-    param_id = range_request->getID();
+std::string C5Tree::unquoteOne(const std::string &value) {
+  std::vector<std::string> res = unquote(value);
+  return res.empty() ? std::string() : res[0];
+}
 
-    assert(range_request->getDecisionType() == DecisionType::kRange);
-    param_type = ParameterType::kRange;
-  } else {
-    assert(0 && "Unreachable");
+std::unique_ptr<C5Tree>
+C5Tree::compile(const std::string &tree_str,
+                const std::map<std::string, AttributeDesc> &attributes,
+                const std::vector<std::string> &class_names) {
+  std::unique_ptr<C5Tree> tree(new C5Tree());
+  tree->m_num_classes = static_cast<unsigned>(class_names.size());
+
+  // Read the header. Only a single tree without costs can be compiled.
+  size_t pos = 0;
+  Property prop;
+  char delim;
+  while (true) {
+    if (!readProperty(tree_str, pos, prop, delim)) {
+      return nullptr;
+    }
+    if (prop.first == "entries") {
+      if (unquoteOne(prop.second) != "1") {
+        return nullptr;
+      }
+      break;
+    } else if (prop.first != "id") {
+      return nullptr;
+    }
   }
 
-  // Check if we have a classifier tree for this parameter.
-  const auto res = context->parameter_classifier_trees.find(param_id);
-  if (res == context->parameter_classifier_trees.cend()) {
-    return std::unique_ptr<DecisionBase>(new NativeDecision());
+  unsigned root;
+  if (!tree->compileNode(tree_str, pos, attributes, class_names, root)) {
+    return nullptr;
   }
+  assert(root == 0);
+  return tree;
+}
 
-  // Output the classifier tree to a buffer
-  const std::vector<uint8_t> &tree_blob = res->second;
-  std::ostringstream tree_data;
-  for (auto c : tree_blob) {
-    tree_data << c;
+bool C5Tree::compileNode(const std::string &str, size_t &pos,
+                         const std::map<std::string, AttributeDesc> &attributes,
+                         const std::vector<std::string> &class_names,
+                         unsigned &node_index) {
+  Node node = {kLeaf, 0, 0.0f, 0, 0, 0, 0, 0, 0, 0.0f, 0.0f, 0.0f, 0.0f};
+  std::vector<std::vector<std::string>> subsets;
+  std::vector<std::string> values;
+
+  node_index = static_cast<unsigned>(m_nodes.size());
+  node.class_dist = static_cast<unsigned>(m_class_dists.size());
+  m_class_dists.resize(m_class_dists.size() + m_num_classes + 1, 0.0f);
+  m_nodes.push_back(node);
+
+  Property prop;
+  char delim = ' ';
+  while (delim == ' ') {
+    if (!readProperty(str, pos, prop, delim)) {
+      return false;
+    }
+    const std::string value = unquoteOne(prop.second);
+
+    if (prop.first == "type") {
+      unsigned type = static_cast<unsigned>(std::atoi(value.c_str()));
+      if (type > kSubset) {
+        return false;
+      }
+      node.type = static_cast<NodeType>(type);
+    } else if (prop.first == "class") {
+      auto name = std::find(class_names.cbegin(), class_names.cend(), value);
+      if (name == class_names.cend()) {
+        return false;
+      }
+      node.leaf_class = static_cast<int>(name - class_names.cbegin()) + 1;
+    } else if (prop.first == "att") {
+      auto attr = attributes.find(value);
+      if (attr == attributes.cend()) {
+        return false;
+      }
+      node.attribute = attr->second.index;
+      values = attr->second.values;
+      node.num_values = static_cast<int>(values.size()) + 1;
+    } else if (prop.first == "forks") {
+      node.forks = std::atoi(value.c_str());
+    } else if (prop.first == "cut") {
+      node.cut = static_cast<float>(std::strtod(value.c_str(), nullptr));
+      node.lower = node.mid = node.upper = node.cut;
+    } else if (prop.first == "low") {
+      node.lower = static_cast<float>(std::strtod(value.c_str(), nullptr));
+    } else if (prop.first == "mid") {
+      node.mid = static_cast<float>(std::strtod(value.c_str(), nullptr));
+    } else if (prop.first == "high") {
+      node.upper = static_cast<float>(std::strtod(value.c_str(), nullptr));
+    } else if (prop.first == "freq") {
+      // Counts are accumulated in single precision, as in C5.0
+      const char *p = value.c_str();
+      for (unsigned c = 1; c <= m_num_classes; ++c) {
+        char *end;
+        float freq = static_cast<float>(std::strtod(p, &end));
+        m_class_dists[node.class_dist + c] = freq;
+        node.cases += freq;
+        p = (*end == ',') ? end + 1 : end;
+      }
+    } else if (prop.first == "elts") {
+      subsets.push_back(unquote(prop.second));
+    } else {
+      return false;
+    }
   }
+  if (node.type != kLeaf) {
+    // Discrete values are numbered from 2, with 1 being N/A, and each subset
+    // is held as a mask of these values.
+    if (node.type == kSubset) {
+      if (node.num_values >= 32 ||
+          subsets.size() != static_cast<size_t>(node.forks)) {
+        return false;
+      }
+      node.subsets = static_cast<unsigned>(m_subsets.size());
+      for (const auto &subset : subsets) {
+        uint32_t mask = 0;
+        for (const auto &elt : subset) {
+          if (elt == "N/A") {
+            mask |= 1u << 1;
+            continue;
+          }
+          auto v = std::find(values.cbegin(), values.cend(), elt);
+          if (v == values.cend()) {
+            return false;
+          }
+          mask |= 1u << (static_cast<unsigned>(v - values.cbegin()) + 2);
+        }
+        m_subsets.push_back(mask);
+      }
+    }
+    if ((node.type == kThreshold) != values.empty()) {
+      return false;
+    }
 
-  // Output names data (columns for classifier) for this parameter
-  // FIXME: This is copied from the 'train' code and should be factored out
-  // TODO: Platform independent temporary file
-  std::ostringstream names_data;
-    
-  // Output the target parameter first
-  // TODO: Comment containing parameter description
-  names_data << "parameter_" << std::to_string(param_id) << ".\n";
+    node.branches = static_cast<unsigned>(m_branches.size());
+    m_branches.resize(m_branches.size() + node.forks);
+    for (int v = 0; v < node.forks; ++v) {
+      unsigned branch;
+      if (!compileNode(str, pos, attributes, class_names, branch)) {
+        return false;
+      }
+      m_branches[node.branches + v] = branch;
+    }
+  }
+  m_nodes[node_index] = node;
+  return true;
+}
 
-  // Output columns for all of the features which we have seen in the
-  // training set.
-  // TODO: Add comment containing feature description
-  for (auto feat : context->feature_descs) {
-    names_data << "feature_" << std::to_string(feat.id) << ": ";
+int C5Tree::classify(const std::vector<Value> &values) const {
+  std::vector<double> prob(m_num_classes + 1, 0.0);
+  findLeaf(values, 0, kNoParent, 1.0f, prob);
 
-    switch (feat.type) {
-    case FeatureType::kBool:
+  int best = m_nodes[0].leaf_class;
+  for (unsigned c = 1; c <= m_num_classes; ++c) {
+    if (prob[c] > prob[best]) {
+      best = static_cast<int>(c);
+    }
+  }
+  return best;
+}
+
+void C5Tree::findLeaf(const std::vector<Value> &values, unsigned node_index,
+                      unsigned parent, float fraction,
+                      std::vector<double> &prob) const {
+  const Node &node = m_nodes[node_index];
+  const Value &value =
+      (node.type != kLeaf) ? values[node.attribute] : kUnknownValue;
+
+  switch (node.type) {
+  case kLeaf:
+    break;
+
+  case kDiscrete:
+    if (value.known && value.discr <= node.forks) {
+      findLeaf(values, m_branches[node.branches + value.discr - 1], node_index,
+               fraction, prob);
+    } else {
+      followAllBranches(values, node_index, fraction, prob);
+    }
+    return;
+
+  case kThreshold: {
+    if (!value.known) {
+      followAllBranches(values, node_index, fraction, prob);
+      return;
+    }
+    // Find weights for the <= and > branches, interpolating if soft
+    // thresholds are used
+    const float val = value.cont;
+    const float low_weight = static_cast<float>(
+        val <= node.lower ? 1.0 :
+        val >= node.upper ? 0.0 :
+        val <= node.cut ?
+          1 - 0.5 * (val - node.lower) / (node.cut - node.lower + 1E-10) :
+          0.5 * (val - node.upper) / (node.cut - node.upper + 1E-10));
+    const double weights[2] = {low_weight, 1 - static_cast<double>(low_weight)};
+
+    for (int v = 0; v < 2; ++v) {
+      double new_fraction = fraction * weights[v];
+      if (new_fraction >= 1E-6) {
+        findLeaf(values, m_branches[node.branches + v + 1], node_index,
+                 static_cast<float>(new_fraction), prob);
+      }
+    }
+    return;
+  }
+
+  case kSubset:
+    if (!value.known || value.discr > node.num_values) {
+      followAllBranches(values, node_index, fraction, prob);
+      return;
+    }
+    for (int v = 0; v < node.forks; ++v) {
+      if (m_subsets[node.subsets + v] & (1u << value.discr)) {
+        findLeaf(values, m_branches[node.branches + v], node_index, fraction,
+                 prob);
+        return;
+      }
+    }
+    // The value is not in any subset, so treat this node as a leaf
+    break;
+  }
+
+  // Use the parent if there are effectively no cases at this node, then
+  // update the probability of each class from the class distribution
+  const Node &leaf =
+      (node.cases < kC5Epsilon && parent != kNoParent) ? m_nodes[parent] : node;
+  for (unsigned c = 1; c <= m_num_classes; ++c) {
+    prob[c] += fraction * m_class_dists[leaf.class_dist + c] / leaf.cases;
+  }
+}
+
+void C5Tree::followAllBranches(const std::vector<Value> &values,
+                               unsigned node_index, float fraction,
+                               std::vector<double> &prob) const {
+  // Follow every branch, weighted by the number of training cases it holds
+  const Node &node = m_nodes[node_index];
+  for (int v = 0; v < node.forks; ++v) {
+    unsigned branch = m_branches[node.branches + v];
+    if (m_nodes[branch].cases > kC5Epsilon) {
+      findLeaf(values, branch, node_index,
+               (fraction * m_nodes[branch].cases) / node.cases, prob);
+    }
+  }
+}
+
+/// \struct C5Model
+///
+/// \brief Model for the C5.0 machine learner, holding the deserialized
+/// context along with a compiled tree for each parameter.
+///
+/// Trees which cannot be compiled are instead held as .names and .tree data,
+/// to be evaluated by the C5.0 library.
+struct C5Model : public IModel {
+  ~C5Model() override {}
+
+  /// The context deserialized from the training blob
+  std::unique_ptr<C5Context> context;
+
+  /// Index of the value of each feature in the values passed to the
+  /// compiled trees.
+  std::map<unsigned, unsigned> feature_indices;
+
+  /// Compiled classifier tree for each parameter
+  std::map<unsigned, std::unique_ptr<C5Tree>> parameter_trees;
+
+  /// .names file data for the classifier of each parameter
+  std::map<unsigned, std::string> parameter_names_data;
+
+  /// .tree file data for the classifier of each parameter
+  std::map<unsigned, std::string> parameter_tree_data;
+};
+
+} // end of anonymous namespace
+
+C5Driver::C5Driver(unsigned training_jobs)
+    : IMachineLearner(), m_training_jobs(training_jobs) {}
+
+C5Driver::~C5Driver() {}
+
+std::unique_ptr<DecisionBase>
+C5Driver::makeDecision(const DecisionRequestBase &request,
+                       const FeatureSet &features,
+                       const std::vector<uint8_t> &blob) const {
+  return makeDecision(request, features, *loadModel(blob));
+}
+
+std::unique_ptr<IModel>
+C5Driver::loadModel(const std::vector<uint8_t> &blob) const {
+  std::unique_ptr<C5Model> model(new C5Model());
+
+  // Deserialize the machine learner data from the blob
+  model->context = C5Context::fromBlob(blob);
+  const C5Context &context = *model->context;
+
+  // Describe the attributes of the trees. Feature values are held in the
+  // order they appear in the feature description map, which is the order
+  // they appear in the .names data.
+  std::map<std::string, C5Tree::AttributeDesc> attributes;
+  for (auto feat : context.feature_descs) {
+    unsigned index = static_cast<unsigned>(model->feature_indices.size());
+    model->feature_indices[feat.id] = index;
+
+    C5Tree::AttributeDesc attr;
+    attr.index = index;
+    if (feat.type == FeatureType::kBool) {
+      attr.values = {"t", "f"};
+    }
+    attributes["feature_" + std::to_string(feat.id)] = attr;
+  }
+
+  for (auto param : context.parameter_descs) {
+    const auto res = context.parameter_classifier_trees.find(param.id);
+    if (res == context.parameter_classifier_trees.cend()) {
+      continue;
+    }
+    const std::vector<uint8_t> &tree_blob = res->second;
+    std::string tree_str(tree_blob.cbegin(), tree_blob.cend());
+
+    // Compile the tree if possible, so that decisions are made without
+    // going through the C5.0 library.
+    if (param.type == ParameterType::kBool) {
+      std::unique_ptr<C5Tree> tree =
+          C5Tree::compile(tree_str, attributes, {"t", "f"});
+      if (tree) {
+        model->parameter_trees[param.id] = std::move(tree);
+        continue;
+      }
+    }
+    MAGEEC_DEBUG("Could not compile the classifier tree for parameter "
+                 << param.id);
+
+    // Output the classifier tree to a buffer
+    model->parameter_tree_data[param.id] = tree_str;
+
+    // Output names data (columns for classifier) for this parameter
+    // FIXME: This is copied from the 'train' code and should be factored out
+    std::ostringstream names_data;
+
+    // Output the target parameter first
+    // TODO: Comment containing parameter description
+    names_data << "parameter_" << std::to_string(param.id) << ".\n";
+
+    // Output columns for all of the features which we have seen in the
+    // training set.
+    // TODO: Add comment containing feature description
+    for (auto feat : context.feature_descs) {
+      names_data << "feature_" << std::to_string(feat.id) << ": ";
+
+      switch (feat.type) {
+      case FeatureType::kBool:
+        names_data << "t, f.";
+        break;
+      case FeatureType::kInt:
+        names_data << "continuous.";
+        break;
+      }
+      names_data << '\n';
+    }
+    names_data << '\n';
+
+    // Output a column for the target parameter
+    names_data << "parameter_" << std::to_string(param.id) << ": ";
+    switch (param.type) {
+    case ParameterType::kBool:
       names_data << "t, f.";
       break;
-    case FeatureType::kInt:
+    case ParameterType::kRange:
       names_data << "continuous.";
       break;
+    default:
+      break;
     }
     names_data << '\n';
-  }
-  names_data << '\n';
 
-  // Output a column for the target parameter
-  names_data << "parameter_" << std::to_string(param_id) << ": ";
-  switch (param_type) {
-  case ParameterType::kBool:
-    names_data << "t, f.";
-    break;
-  case ParameterType::kRange:
-    names_data << "continuous.";
-    break;
-  default:
-    break;
+    model->parameter_names_data[param.id] = names_data.str();
   }
-  names_data << '\n';
+  return std::unique_ptr<IModel>(std::move(model));
+}
+
+namespace {
 
+/// \brief Build the .cases data used to classify a set of features
+///
+/// \param context  Context holding the features which the classifier was
+/// trained against.
+/// \param features  The features to be classified
+///
+/// \return The .cases data for the features
+std::string buildCasesData(const C5Context &context,
+                           const FeatureSet &features) {
   // Output cases file (.cases) data, containing the feature set
   std::ostringstream cases_data;
 
-  for (auto feat : context->feature_descs) {
+  std::map<unsigned, FeatureBase *> feature_map;
+  for (const auto &f : features) {
+    feature_map[f->getID()] = f.get();
+  }
+
+  for (auto feat : context.feature_descs) {
     // Feature values are output in the order they appear in the feature
     // description map (ascending order of feature id)
-
-    // FIXME: Avoid the dumb linear search here
-    FeatureBase *f = nullptr;
-    for (std::shared_ptr<FeatureBase> it : features) {
-      if (it->getID() == feat.id) {
-        f = it.get();
-      }
-    }
+    auto feature = feature_map.find(feat.id);
+    FeatureBase *f = (feature != feature_map.end()) ? feature->second : nullptr;
 
     if (f) {
       // There is a value for this feature in the feature set, output it
@@ -407,17 +903,56 @@ C5Driver::makeDecision(const DecisionRequestBase &request,
   }
   // Finally, add the 'unknown' for our target parameter
   cases_data << "?" << '\n';
+  return cases_data.str();
+}
+
 
+/// \brief Build the values of each feature as seen by the compiled trees
+///
+/// \param c5_model  Model holding the index of each feature
+/// \param features  The features to be classified
+///
+/// \return The value of each feature, in the order of the feature indices
+std::vector<C5Tree::Value> buildTreeValues(const C5Model &c5_model,
+                                           const FeatureSet &features) {
+  std::vector<C5Tree::Value> values(c5_model.feature_indices.size(),
+                                    {false, 0.0f, 0});
+  for (const auto &f : features) {
+    auto index = c5_model.feature_indices.find(f->getID());
+    if (index == c5_model.feature_indices.cend()) {
+      continue;
+    }
+    C5Tree::Value &value = values[index->second];
+    value.known = true;
+
+    switch (f->getType()) {
+    case FeatureType::kBool: {
+      // Values 't' and 'f' are the first and second values of the attribute
+      bool bool_value = static_cast<BoolFeature *>(f.get())->getValue();
+      value.discr = bool_value ? 2 : 3;
+      break;
+    }
+    case FeatureType::kInt: {
+      // C5.0 reads the value as a double, and holds it as a float
+      int64_t int_value = static_cast<IntFeature *>(f.get())->getValue();
+      value.cont = static_cast<float>(static_cast<double>(int_value));
+      break;
+    }
+    }
+  }
+  return values;
+}
+
+/// \brief Run the C5.0 library over .names, .tree and .cases data
+///
+/// \return The predicted class, with the first class numbered from 1
+int runPredictions(const std::string &names_str, const std::string &tree_str,
+                   const std::string &cases_str) {
   // Now we have a .tree, .names and .cases data, run the classifier over them
   // to make a prediction
   // TODO: Useful debug here
   MAGEEC_DEBUG("Running the C5.0 classifier for decision");
 
-  // input files as buffers
-  std::string cases_str = cases_data.str();
-  std::string names_str = names_data.str();
-  std::string tree_str = tree_data.str();
-
   char *casev = (char*)malloc(cases_str.size() + 1);
   strcpy(casev, cases_str.c_str());
   char *namesv = (char*)malloc(names_str.size() + 1);
@@ -430,7 +965,7 @@ C5Driver::makeDecision(const DecisionRequestBase &request,
   // default parameters for C5.0
   int trials = 1;
   // output parameters
-  int *predv = (int*)malloc(1);
+  int *predv = (int*)malloc(sizeof(int));
   double confidencev;
   char *outputv = nullptr;
 
@@ -450,6 +985,14 @@ C5Driver::makeDecision(const DecisionRequestBase &request,
   int predict_res = predv[0];
   free(predv);
 
+  return predict_res;
+}
+
+/// \brief Convert the class predicted by a classifier into a decision
+std::unique_ptr<DecisionBase> toDecision(const DecisionRequestBase &request,
+                                         int predict_res) {
+  DecisionRequestType request_type = request.getType();
+
   // Get the value of the returned decision
   // FIXME: Call out to the C5.0 classifier
   switch (request_type) {
@@ -477,398 +1020,491 @@ C5Driver::makeDecision(const DecisionRequestBase &request,
   }
 }
 
-const std::vector<uint8_t>
-C5Driver::train(std::set<FeatureDesc> feature_descs,
-                std::set<ParameterDesc> parameter_descs,
-                std::set<std::string> passes,
-                ResultIterator result_iter) const {
-  std::unique_ptr<C5Context> context(new C5Context());
-  context->feature_descs = feature_descs;
-  context->parameter_descs = parameter_descs;
-  context->passes = passes;
+/// \brief Inputs to the classifiers for a set of features.
+///
+/// The .cases data is only needed by trees which could not be compiled, so
+/// is built on first use.
+struct C5Query {
+  C5Query(const C5Model &c5_model, const FeatureSet &features)
+      : features(features), values(buildTreeValues(c5_model, features)),
+        cases_str() {}
+
+  const FeatureSet &features;
+  const std::vector<C5Tree::Value> values;
+  std::string cases_str;
+};
 
-  MAGEEC_DEBUG("Training database using C5 Machine Learner");
+/// \brief Run the classifier for a single decision request
+///
+/// \param c5_model  Model holding the trees for each parameter
+/// \param request  The decision to be made
+/// \param query  Inputs to the classifier for the features being classified
+///
+/// \return The decision made, or the native decision if there is no tree
+/// for the requested parameter.
+std::unique_ptr<DecisionBase> classify(const C5Model &c5_model,
+                                       const DecisionRequestBase &request,
+                                       C5Query &query) {
+  // Find the appropriate classifier tree for the provided decision request
+  DecisionRequestType request_type = request.getType();
 
-  // Read all of the results data in one go. For each distinct set of input
-  // features, store the best set of results. This is achieved by storing a
-  // hash from a feature set to its current best result.
-  MAGEEC_DEBUG("Collecting results");
-  std::map<uint64_t, Result> result_map;
-  for (util::Option<Result> result; (result = *result_iter);
-       result_iter = result_iter.next()) {
-    FeatureSet features = result.get().getFeatures();
-    double value = result.get().getValue();
-    uint64_t hash = features.hash();
-
-    bool result_handled = false;
-    while (!result_handled) {
-      auto curr_entry = result_map.find(hash);
-      if (curr_entry != result_map.end()) {
-        const FeatureSet &curr_features = curr_entry->second.getFeatures();
-        double curr_value = curr_entry->second.getValue();
-
-        if (features == curr_features) {
-          if (value < curr_value) {
-            result_map.at(hash) = result.get();
-          }
-          result_handled = true;
-        } else {
-          hash++;
-        }
-      } else {
-        result_map.emplace(hash, result.get());
-        result_handled = true;
-      }
-    }
+  assert((request_type == DecisionRequestType::kBool ||
+          request_type == DecisionRequestType::kRange) &&
+         "Unhandled decision request type");
+
+  unsigned param_id;
+
+  // The ID is the identifier of the tunable parameter
+  if (request_type == DecisionRequestType::kBool) {
+    const auto *bool_request =
+        static_cast<const BoolDecisionRequest *>(&request);
+    param_id = bool_request->getID();
+
+    assert(bool_request->getDecisionType() == DecisionType::kBool);
+  } else if (request_type == DecisionRequestType::kRange) {
+    const auto *range_request =
+        static_cast<const RangeDecisionRequest *>(&request);
+    param_id = range_request->getID();
+
+    assert(range_request->getDecisionType() == DecisionType::kRange);
+  } else {
+    assert(0 && "Unreachable");
+  }
+
+  // Use the compiled tree for this parameter if there is one
+  const auto tree = c5_model.parameter_trees.find(param_id);
+  if (tree != c5_model.parameter_trees.cend()) {
+    return toDecision(request, tree->second->classify(query.values));
   }
 
-  // Create a classifier trained for each tunable parameter in turn.
-  MAGEEC_DEBUG("Training for tunable parameters");
+  // Otherwise check if we have a classifier tree for this parameter.
+  const auto tree_data = c5_model.parameter_tree_data.find(param_id);
+  if (tree_data == c5_model.parameter_tree_data.cend()) {
+    return std::unique_ptr<DecisionBase>(new NativeDecision());
+  }
+  const auto names_data = c5_model.parameter_names_data.find(param_id);
+  assert(names_data != c5_model.parameter_names_data.cend());
 
-  unsigned curr_param = 0;
-  unsigned param_count = static_cast<unsigned>(parameter_descs.size());
+  if (query.cases_str.empty()) {
+    query.cases_str = buildCasesData(*c5_model.context, query.features);
+  }
+  return toDecision(request, runPredictions(names_data->second,
+                                            tree_data->second,
+                                            query.cases_str));
+}
 
-  // Train for all of the simple parameter types. Training for pass sequences
-  // is a little more complicated and is handled separately later.
-  for (auto param : parameter_descs) {
-    if (param.type == ParameterType::kPassSeq) {
-      continue;
-    }
+} // end of anonymous namespace
 
-    MAGEEC_DEBUG("Training parameter " << curr_param << " of "
-                 << param_count - 1);
-    curr_param++;
+std::unique_ptr<DecisionBase>
+C5Driver::makeDecision(const DecisionRequestBase &request,
+                       const FeatureSet &features,
+                       const IModel &model) const {
+  const auto &c5_model = static_cast<const C5Model &>(model);
+  C5Query query(c5_model, features);
+  return classify(c5_model, request, query);
+}
 
-    // Output names file (columns for classifier) for this parameter
-    MAGEEC_DEBUG("Building .names file data");
-    std::ostringstream names_data;
+std::vector<std::unique_ptr<DecisionBase>> C5Driver::makeDecisions(
+    const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+    const FeatureSet &features, const IModel &model) const {
+  const auto &c5_model = static_cast<const C5Model &>(model);
 
-    // Output the target parameter first
-    // TODO: Comment containing parameter description
-    names_data << "parameter_" << param.id << ".\n";
+  // The inputs to the classifiers only depend on the features, so are shared
+  // between all of the requests.
+  C5Query query(c5_model, features);
 
-    // Output columns for all of the features which we have seen in the
-    // training set.
-    // TODO: Add comment containing feature description
-    for (auto feat : feature_descs) {
-      names_data << "feature_" << feat.id << ": ";
+  std::vector<std::unique_ptr<DecisionBase>> decisions;
+  decisions.reserve(requests.size());
+  for (const auto &request : requests) {
+    decisions.push_back(classify(c5_model, *request, query));
+  }
+  return decisions;
+}
+
+namespace {
+
+/// Values of boolean columns in a training table. These are the numbers of
+/// the values in the "t, f." declaration of the column in the .names file.
+const double c5_true = 1.0;
+const double c5_false = 2.0;
+
+/// Value of a missing entry in a training table
+const double c5_missing = std::numeric_limits<double>::quiet_NaN();
+
+/// \brief Run the C5.0 classifier over the provided .names file and table
+/// of training data
+///
+/// \param names_str The text of the .names file
+/// \param columns A column of values for each attribute in the .names file,
+/// in the same order
+/// \param num_rows The number of values in each column
+///
+/// \return The text of the generated classifier tree
+std::vector<uint8_t> runC50(const std::string &names_str,
+                            const std::vector<const double *> &columns,
+                            unsigned num_rows) {
+  // input files as buffers
+  char *namesv = (char*)malloc(names_str.size() + 1);
+  strcpy(namesv, names_str.c_str());
+  char *costv = (char*)malloc(1); costv[0] = '\0';
+  // default parameters for C5.0
+  int subset = 1;
+  int rules = 0;
+  int utility = 0;
+  int trials = 1;
+  int winnow = 0;
+  double sample = 0.0;
+  int seed = 0xbeef;
+  int noGlobalPruning = 0;
+  double CF = 0.25;
+  int minCases = 2;
+  int fuzzyThreshold = 0;
+  int earlyStopping = 1;
+  // output parameters
+  char *treev = nullptr;
+  char *rulesv = nullptr;
+  char *outputv = nullptr;
+
+  c50table(&namesv, static_cast<int>(num_rows), columns.data(), &costv,
+           &subset, &rules, &utility, &trials, &winnow, &sample, &seed,
+           &noGlobalPruning, &CF, &minCases, &fuzzyThreshold, &earlyStopping,
+           &treev, &rulesv, &outputv);
+
+  // free memory for all of the unused parameters
+  free(namesv);
+  free(costv);
+  if (rulesv != nullptr)
+    free(rulesv);
+  if (outputv != nullptr)
+    free(outputv);
+
+  // Retrieve the tree
+  assert(treev != nullptr);
+  std::vector<uint8_t> tree_blob;
+  tree_blob.resize(strlen(treev));
+  for (unsigned i = 0; i < strlen(treev); ++i)
+    tree_blob.data()[i] = treev[i];
+  // free the memory for the tree buffer
+  free(treev);
+  return tree_blob;
+}
+
+/// \brief Build a column of values for each feature seen in the training
+/// set, with a row for each result.
+///
+/// The feature columns are the same for every classifier, so are built once
+/// and shared between all of them. Only the target column differs.
+///
+/// \param feature_descs All of the features seen in the training set
+/// \param result_map The best result for each distinct set of features
+///
+/// \return The columns, in ascending order of feature id
+std::vector<std::vector<double>>
+buildFeatureColumns(const std::set<FeatureDesc> &feature_descs,
+                    const std::map<uint64_t, FlatResult> &result_map) {
+  std::vector<std::vector<double>> columns;
+  columns.reserve(feature_descs.size());
+
+  for (auto feat : feature_descs) {
+    std::vector<double> column;
+    column.reserve(result_map.size());
+
+    for (const auto &res : result_map) {
+      const FlatFeatureSet &features = res.second.getFeatures();
+      util::Option<unsigned> f = features.find(feat.id);
+      if (!f) {
+        // No value for this feature for this result.
+        column.push_back(c5_missing);
+        continue;
+      }
+      assert(features.getType(f.get()) == feat.type);
 
       switch (feat.type) {
       case FeatureType::kBool:
-        names_data << "t, f.";
+        column.push_back(features.getValue(f.get()) ? c5_true : c5_false);
         break;
       case FeatureType::kInt:
-        names_data << "continuous.";
+        column.push_back(static_cast<double>(features.getValue(f.get())));
         break;
       }
-      names_data << '\n';
     }
-    names_data << '\n';
+    columns.push_back(std::move(column));
+  }
+  return columns;
+}
 
-    // Output a column for the target parameter
-    names_data << "parameter_" << param.id << ": ";
-    switch (param.type) {
-    case ParameterType::kBool:
+/// \brief Get the columns to train a classifier from, given the feature
+/// columns and a target column.
+std::vector<const double *>
+getTrainingColumns(const std::vector<std::vector<double>> &feature_columns,
+                   const std::vector<double> &target) {
+  std::vector<const double *> columns;
+  columns.reserve(feature_columns.size() + 1);
+  for (const auto &column : feature_columns) {
+    columns.push_back(column.data());
+  }
+  columns.push_back(target.data());
+  return columns;
+}
+
+/// \brief Train a classifier for a single tunable parameter
+///
+/// \param param The parameter to train the classifier for
+/// \param feature_descs All of the features seen in the training set
+/// \param result_map The best result for each distinct set of features
+/// \param feature_columns The values of each feature for each result
+///
+/// \return The text of the generated classifier tree
+std::vector<uint8_t>
+trainParameter(const ParameterDesc &param,
+               const std::set<FeatureDesc> &feature_descs,
+               const std::map<uint64_t, FlatResult> &result_map,
+               const std::vector<std::vector<double>> &feature_columns) {
+  // Output names file (columns for classifier) for this parameter
+  MAGEEC_DEBUG("Building .names file data");
+  std::ostringstream names_data;
+
+  // Output the target parameter first
+  // TODO: Comment containing parameter description
+  names_data << "parameter_" << param.id << ".\n";
+
+  // Output columns for all of the features which we have seen in the
+  // training set.
+  // TODO: Add comment containing feature description
+  for (auto feat : feature_descs) {
+    names_data << "feature_" << feat.id << ": ";
+
+    switch (feat.type) {
+    case FeatureType::kBool:
       names_data << "t, f.";
       break;
-    case ParameterType::kRange:
+    case FeatureType::kInt:
       names_data << "continuous.";
       break;
-    default:
-      break;
     }
     names_data << '\n';
+  }
+  names_data << '\n';
 
-    // For the current parameter, generate the values in the .data file
-    // containing all of the training data
-    MAGEEC_DEBUG("Building .data file data");
-    std::ostringstream data_data;
-
-    for (auto res : result_map) {
-      ParameterSet parameters = res.second.getParameters();
-      FeatureSet features = res.second.getFeatures();
-
-      // Check that this result has an entry for this parameter. If not then
-      // skip as we can't use it for training.
-      // FIXME: Don't use a dumb linear search here
-      ParameterBase *p = nullptr;
-      for (auto it : parameters) {
-        if (it->getID() == param.id) {
-          p = it.get();
-        }
+  // Output a column for the target parameter
+  names_data << "parameter_" << param.id << ": ";
+  switch (param.type) {
+  case ParameterType::kBool:
+    names_data << "t, f.";
+    break;
+  case ParameterType::kRange:
+    names_data << "continuous.";
+    break;
+  default:
+    break;
+  }
+  names_data << '\n';
+
+  // For the current parameter, generate the target column of the training
+  // data. Results without an entry for this parameter are left missing, so
+  // are skipped by the classifier.
+  MAGEEC_DEBUG("Building target column");
+  std::vector<double> target;
+  target.reserve(result_map.size());
+
+  for (const auto &res : result_map) {
+    const ParameterSet &parameters = res.second.getParameters();
+
+    // FIXME: Don't use a dumb linear search here
+    ParameterBase *p = nullptr;
+    for (auto it : parameters) {
+      if (it->getID() == param.id) {
+        p = it.get();
       }
-      if (!p)
-        continue;
+    }
+    if (!p) {
+      target.push_back(c5_missing);
+      continue;
+    }
+    assert(p->getType() == param.type);
 
-      for (auto feat : feature_descs) {
-        // Feature values are output in the order they appear in the feature
-        // description map (ascending order of feature id)
-        // FIXME: Don't use a dumb linear search here
-        FeatureBase *f = nullptr;
-        for (auto it : features) {
-          if (it->getID() == feat.id) {
-            f = it.get();
-          }
-        }
+    switch (param.type) {
+    case ParameterType::kBool: {
+      bool value = static_cast<BoolParameter *>(p)->getValue();
+      target.push_back(value ? c5_true : c5_false);
+      break;
+    }
+    case ParameterType::kRange: {
+      int64_t value = static_cast<RangeParameter *>(p)->getValue();
+      target.push_back(static_cast<double>(value));
+      break;
+    }
+    default:
+      target.push_back(c5_missing);
+      break;
+    }
+  }
 
-        if (f) {
-          // The result has a value for this feature, output it
-          assert(f->getType() == feat.type);
+  // Now we have the .names file and training data, run the classifier over
+  // them to generate a tree
+  MAGEEC_DEBUG("Running the C5.0 classifier for parameter "
+               << std::to_string(param.id));
 
-          switch (feat.type) {
-          case FeatureType::kBool: {
-            bool value = static_cast<BoolFeature *>(f)->getValue();
-            data_data << (value ? "t" : "f");
-            break;
-          }
-          case FeatureType::kInt: {
-            int64_t value = static_cast<IntFeature *>(f)->getValue();
-            data_data << value;
-            break;
-          }
-          }
-          data_data << ",";
-        } else {
-          // No value for this feature for this result.
-          data_data << "?,";
-        }
-      }
-      // Output the parameter value last.
-      assert(p->getType() == param.type);
+  return runC50(names_data.str(), getTrainingColumns(feature_columns, target),
+                static_cast<unsigned>(result_map.size()));
+}
 
-      switch (param.type) {
-      case ParameterType::kBool: {
-        bool value = static_cast<BoolParameter *>(p)->getValue();
-        data_data << (value ? "t" : "f");
-        break;
-      }
-      case ParameterType::kRange: {
-        int64_t value = static_cast<RangeParameter *>(p)->getValue();
-        data_data << value;
+/// \brief Train a classifier deciding whether a single pass should run
+///
+/// \param pass The name of the pass to train the classifier for
+/// \param feature_descs All of the features seen in the training set
+/// \param result_map The best result for each distinct set of features
+/// \param feature_columns The values of each feature for each result
+///
+/// \return The text of the generated classifier tree
+std::vector<uint8_t>
+trainPass(const std::string &pass, const std::set<FeatureDesc> &feature_descs,
+          const std::map<uint64_t, FlatResult> &result_map,
+          const std::vector<std::vector<double>> &feature_columns) {
+  // Output names file (columns for classifier) for this pass
+  MAGEEC_DEBUG("Building .names file data");
+  std::ostringstream names_data;
+
+  // Output the target pass first
+  // TODO: Comment containing pass description
+  names_data << "pass_" << pass << ".\n";
+
+  // Output columns for all of the features which we have seen in the
+  // training set.
+  // TODO: Add comment containing feature description
+  for (auto feat : feature_descs) {
+    names_data << "feature_" << feat.id << ": ";
+
+    switch (feat.type) {
+    case FeatureType::kBool:
+      names_data << "t, f.";
+      break;
+    case FeatureType::kInt:
+      names_data << "continuous.";
+      break;
+    }
+    names_data << '\n';
+  }
+  names_data << '\n';
+
+  // Output a column for the target pass
+  names_data << "pass_" << pass << ": t, f.\n";
+
+  // For the current pass, generate the target column of the training data
+  MAGEEC_DEBUG("Building target column");
+  std::vector<double> target;
+  target.reserve(result_map.size());
+
+  for (const auto &res : result_map) {
+    const ParameterSet &parameters = res.second.getParameters();
+
+    // Find the parameter in the parameter set which holds the pass
+    // sequence.
+    // TODO: Don't use a linear search to do this?
+    std::vector<std::string> pass_seq;
+    for (auto p : parameters) {
+      if (p->getType() == ParameterType::kPassSeq) {
+        pass_seq = static_cast<PassSeqParameter *>(p.get())->getValue();
         break;
       }
-      default:
+    }
+    assert(pass_seq.size());
+
+    // Whether the pass was run or not is the target value
+    bool run_pass = false;
+    for (auto p : pass_seq) {
+      if (p == pass) {
+        run_pass = true;
         break;
       }
-      data_data << "\n";
-    }
-
-    // Now we have .names and .data files, run the classifier over them to
-    // generate a tree
-    MAGEEC_DEBUG("Running the C5.0 classifier for parameter "
-                 << std::to_string(param.id));
-
-    // input files as buffers
-    std::string names_str = names_data.str();
-    std::string data_str = data_data.str();
-
-    char *namesv = (char*)malloc(names_str.size() + 1);
-    strcpy(namesv, names_str.c_str());
-    char *datav = (char*)malloc(data_str.size() + 1);
-    strcpy(datav, data_str.c_str());
-    char *costv = (char*)malloc(1); costv[0] = '\0';
-    // default parameters for C5.0
-    int subset = 1;
-    int rules = 0;
-    int utility = 0;
-    int trials = 1;
-    int winnow = 0;
-    double sample = 0.0;
-    int seed = 0xbeef;
-    int noGlobalPruning = 0;
-    double CF = 0.25;
-    int minCases = 2;
-    int fuzzyThreshold = 0;
-    int earlyStopping = 1;
-    // output parameters
-    char *treev = nullptr;
-    char *rulesv = nullptr;
-    char *outputv = nullptr;
-
-    c50(&namesv, &datav, &costv, &subset, &rules, &utility, &trials,
-        &winnow, &sample, &seed, &noGlobalPruning, &CF, &minCases,
-        &fuzzyThreshold, &earlyStopping, &treev, &rulesv, &outputv);
-
-    // free memory for all of the unused parameters
-    free(namesv);
-    free(datav);
-    if (rulesv != nullptr)
-      free(rulesv);
-    if (outputv != nullptr)
-      free(outputv);
-
-    // Retrieve the tree
-    assert(treev != nullptr);
-    std::vector<uint8_t> tree_blob;
-    tree_blob.resize(strlen(treev));
-    for (unsigned i = 0; i < strlen(treev); ++i)
-      tree_blob.data()[i] = treev[i];
-    // free the memory for the tree buffer
-    free(treev);
-
-    // save the tree for the current parameter
-    context->parameter_classifier_trees.insert(
-        std::make_pair(param.id, tree_blob));
+    }
+    target.push_back(run_pass ? c5_true : c5_false);
   }
 
-  MAGEEC_DEBUG("Training passes");
+  // Now we have the .names file and training data, run the classifier over
+  // them to generate a tree
+  MAGEEC_DEBUG("Running the C5.0 classifier for pass " << pass);
 
-  // Create a classifier trained for each of the input passes in turn
-  for (auto pass : passes) {
-    MAGEEC_DEBUG("Training for pass '" << pass << "'");
+  return runC50(names_data.str(), getTrainingColumns(feature_columns, target),
+                static_cast<unsigned>(result_map.size()));
+}
 
-    // Output names file (columns for classifier) for this pass
-    MAGEEC_DEBUG("Building .names file data");
-    std::ostringstream names_data;
+} // end of anonymous namespace
 
-    // Output the target pass first
-    // TODO: Comment containing pass description
-    names_data << "pass_" << pass << ".\n";
+const std::vector<uint8_t>
+C5Driver::train(std::set<FeatureDesc> feature_descs,
+                std::set<ParameterDesc> parameter_descs,
+                std::set<std::string> passes,
+                ResultIterator result_iter) const {
+  std::unique_ptr<C5Context> context(new C5Context());
+  context->feature_descs = feature_descs;
+  context->parameter_descs = parameter_descs;
+  context->passes = passes;
 
-    // Output columns for all of the features which we have seen in the
-    // training set.
-    // TODO: Add comment containing feature description
-    for (auto feat : feature_descs) {
-      names_data << "feature_" << feat.id << ": ";
+  MAGEEC_DEBUG("Training database using C5 Machine Learner");
 
-      switch (feat.type) {
-      case FeatureType::kBool:
-        names_data << "t, f.";
-        break;
-      case FeatureType::kInt:
-        names_data << "continuous.";
-        break;
-      }
-      names_data << '\n';
+  // Read all of the results data in one go. The iterator provides only the
+  // best result for each distinct set of input features, so each is stored
+  // by the hash of its features. Distinct feature sets may still share a
+  // hash, in which case the next free hash is used.
+  MAGEEC_DEBUG("Collecting results");
+  std::map<uint64_t, FlatResult> result_map;
+  for (util::Option<Result> result; (result = *result_iter);
+       result_iter = result_iter.next()) {
+    FlatResult flat_result(result.get());
+    uint64_t hash = flat_result.getFeatures().hash();
+    while (!result_map.emplace(hash, flat_result).second) {
+      hash++;
     }
-    names_data << '\n';
-
-    // Output a column for the target pass
-    names_data << "pass_" << pass << ": t, f.\n";
-
-    // For the current pass, generate the values in the .data file
-    // containing all of the training data
-    MAGEEC_DEBUG("Building .data file data");
-    std::ostringstream data_data;
-
-    for (auto res : result_map) {
-      FeatureSet features = res.second.getFeatures();
-      ParameterSet parameters = res.second.getParameters();
-
-      // Find the parameter in the parameter set which holds the pass
-      // sequence.
-      // TODO: Don't use a linear search to do this?
-      std::vector<std::string> pass_seq;
-      for (auto p : parameters) {
-        if (p->getType() == ParameterType::kPassSeq) {
-          pass_seq = static_cast<PassSeqParameter *>(p.get())->getValue();
-          break;
-        }
-      }
-      assert(pass_seq.size());
-
-      for (auto feat : feature_descs) {
-        // Feature values are output in the order they appear in the feature
-        // description map (ascending order of feature id)
-        // FIXME: Don't use a dumb linear search here
-        FeatureBase *f = nullptr;
-        for (auto it : features) {
-          if (it->getID() == feat.id) {
-            f = it.get();
-          }
-        }
+  }
 
-        if (f) {
-          // The result has a value for this feature, output it
-          assert(f->getType() == feat.type);
+  // Train a classifier for each of the simple parameter types, and then one
+  // for each of the passes. Pass sequence parameters are covered by the
+  // per-pass classifiers instead.
+  std::vector<ParameterDesc> params;
+  for (auto param : parameter_descs) {
+    if (param.type != ParameterType::kPassSeq) {
+      params.push_back(param);
+    }
+  }
+  std::vector<std::string> pass_list(passes.begin(), passes.end());
+
+  // The classifiers are independent of each other, so are trained
+  // concurrently. Each tree is stored by index, so the resulting blob does
+  // not depend on the order in which training completes.
+  unsigned param_count = static_cast<unsigned>(params.size());
+  unsigned tree_count = param_count + static_cast<unsigned>(pass_list.size());
+  std::vector<std::vector<uint8_t>> trees(tree_count);
+
+  MAGEEC_DEBUG("Training " << tree_count << " classifiers with "
+               << m_training_jobs << " jobs");
+  // The feature columns of the training data are the same for every
+  // classifier, so are only built once.
+  MAGEEC_DEBUG("Building feature columns");
+  std::vector<std::vector<double>> feature_columns =
+      buildFeatureColumns(feature_descs, result_map);
+
+  util::parallelFor(tree_count, m_training_jobs, [&](unsigned i) {
+    if (i < param_count) {
+      MAGEEC_DEBUG("Training parameter " << params[i].id);
+      trees[i] = trainParameter(params[i], feature_descs, result_map,
+                                feature_columns);
+    } else {
+      const std::string &pass = pass_list[i - param_count];
+      MAGEEC_DEBUG("Training for pass '" << pass << "'");
+      trees[i] = trainPass(pass, feature_descs, result_map, feature_columns);
+    }
+  });
+  MAGEEC_DEBUG("Training finished");
 
-          switch (feat.type) {
-          case FeatureType::kBool: {
-            bool value = static_cast<BoolFeature *>(f)->getValue();
-            data_data << (value ? "t" : "f");
-            break;
-          }
-          case FeatureType::kInt: {
-            int64_t value = static_cast<IntFeature *>(f)->getValue();
-            data_data << value;
-            break;
-          }
-          }
-          data_data << ",";
-        } else {
-          // No value for this feature for this result.
-          data_data << "?,";
-        }
-      }
-      // Output whether the pass was run or not last.
-      bool run_pass = false;
-      for (auto p : pass_seq) {
-        if (p == pass) {
-          run_pass = true;
-          break;
-        }
-      }
-      data_data << (run_pass ? "t" : "f");
-      data_data << "\n";
-    }
-
-    // Now we have .names and .data files, run the classifier over them to
-    // generate a tree
-    MAGEEC_DEBUG("Running the C5.0 classifier for pass " << pass);
-
-    // input files as buffers
-    std::string names_str = names_data.str();
-    std::string data_str = data_data.str();
-
-    char *namesv = (char*)malloc(names_str.size() + 1);
-    strcpy(namesv, names_str.c_str());
-    char *datav = (char*)malloc(data_str.size() + 1);
-    strcpy(datav, data_str.c_str());
-    char *costv = (char*)malloc(1); costv[0] = '\0';
-    // default parameters for C5.0
-    int subset = 1;
-    int rules = 0;
-    int utility = 0;
-    int trials = 1;
-    int winnow = 0;
-    double sample = 0.0;
-    int seed = 0xbeef;
-    int noGlobalPruning = 0;
-    double CF = 0.25;
-    int minCases = 2;
-    int fuzzyThreshold = 0;
-    int earlyStopping = 1;
-    // output parameters
-    char *treev = nullptr;
-    char *rulesv = nullptr;
-    char *outputv = nullptr;
-
-    c50(&namesv, &datav, &costv, &subset, &rules, &utility, &trials,
-        &winnow, &sample, &seed, &noGlobalPruning, &CF, &minCases,
-        &fuzzyThreshold, &earlyStopping, &treev, &rulesv, &outputv);
-
-    // free memory for all of the unused parameters
-    free(namesv);
-    free(datav);
-    if (rulesv != nullptr)
-      free(rulesv);
-    if (outputv != nullptr)
-      free(outputv);
-
-    // Retrieve the tree
-    assert(treev != nullptr);
-    std::vector<uint8_t> tree_blob;
-    tree_blob.resize(strlen(treev));
-    for (unsigned i = 0; i < strlen(treev); ++i)
-      tree_blob.data()[i] = treev[i];
-    // free the memory for the tree buffer
-    free(treev);
-
-    // save the tree for the current parameter
+  for (unsigned i = 0; i < param_count; ++i) {
+    context->parameter_classifier_trees.insert(
+        std::make_pair(params[i].id, std::move(trees[i])));
+  }
+  for (unsigned i = param_count; i < tree_count; ++i) {
     context->pass_classifier_trees.insert(
-        std::make_pair(pass, tree_blob));
+        std::make_pair(pass_list[i - param_count], std::move(trees[i])));
   }
-  MAGEEC_DEBUG("Training finished");
 
   // Serialize the context to a blob
   return context->toBlob();
@@ -38,8 +38,8 @@
 #include "transform.h"
 #include "redefine.h"
 
-float		*AttImp=Nil;		/* att importance */
-Boolean		*Split=Nil,		/* atts used in unpruned tree */
+C5_TLS float		*AttImp=Nil;		/* att importance */
+C5_TLS Boolean		*Split=Nil,		/* atts used in unpruned tree */
 		*Used=Nil;		/* atts used in pruned tree */
 
 
@@ -61,8 +61,8 @@ void WinnowAtts()
     float	Base;
     Boolean	First=true, *Upper;
     ClassNo	c;
-    extern Attribute	*DList;
-    extern int		NDList;
+    extern C5_TLS Attribute	*DList;
+    extern C5_TLS int		NDList;
 
     /*  Save original case order  */
 
@@ -10,24 +10,35 @@ extern void c50main();
 extern void sample(double *outputv);
 extern void FreeCases(void);
 
-void c50(char **namesv,
-         char **datav,
-         char **costv,
-         int *subset,
-         int *rules,
-         int *utility,
-         int *trials,
-         int *winnow,
-         double *sample,
-         int *seed,
-         int *noGlobalPruning,
-         double *CF,
-         int *minCases,
-         int *fuzzyThreshold,
-         int *earlyStopping,
-         char **treev,
-         char **rulesv,
-         char **outputv)
+/* In-memory training data, defined in global.c */
+extern C5_TLS const double *const *DataTable;
+extern C5_TLS int DataTableCases;
+
+/*
+ * Train a classifier, reading the training cases either from the text of a
+ * .data file in *datav, or from a table of ncases values for each attribute
+ * in columns if datav is NULL.
+ */
+static void train(char **namesv,
+                  char **datav,
+                  int ncases,
+                  const double *const *columns,
+                  char **costv,
+                  int *subset,
+                  int *rules,
+                  int *utility,
+                  int *trials,
+                  int *winnow,
+                  double *sample,
+                  int *seed,
+                  int *noGlobalPruning,
+                  double *CF,
+                  int *minCases,
+                  int *fuzzyThreshold,
+                  int *earlyStopping,
+                  char **treev,
+                  char **rulesv,
+                  char **outputv)
 {
     int val;  /* Used by setjmp/longjmp for implementing rbm_exit */
 
@@ -66,13 +77,19 @@ void c50(char **namesv,
     fprintf(stderr, "undefined.names already exists");
 	}
 
-    // Create a strbuf using *datav and register it as "undefined.data"
-    STRBUF *sb_datav = strbuf_create_full(*datav, strlen(*datav));
-    // XXX why is sb_datav copied? was that part of my debugging?
-    // XXX or is this the cause of the leak?
-	if (rbm_register(strbuf_copy(sb_datav), "undefined.data", 0) < 0) {
-		fprintf(stderr, "undefined data already exists");
-	}
+    if (datav != NULL) {
+        // Create a strbuf using *datav and register it as "undefined.data"
+        STRBUF *sb_datav = strbuf_create_full(*datav, strlen(*datav));
+        // XXX why is sb_datav copied? was that part of my debugging?
+        // XXX or is this the cause of the leak?
+        if (rbm_register(strbuf_copy(sb_datav), "undefined.data", 0) < 0) {
+            fprintf(stderr, "undefined data already exists");
+        }
+    } else {
+        // The cases are read from the table by c50main instead
+        DataTable = columns;
+        DataTableCases = ncases;
+    }
 
     // Create a strbuf using *costv and register it as "undefined.costs"
     if (strlen(*costv) > 0) {
@@ -144,6 +161,65 @@ void c50(char **namesv,
     initglobals();
 }
 
+void c50(char **namesv,
+         char **datav,
+         char **costv,
+         int *subset,
+         int *rules,
+         int *utility,
+         int *trials,
+         int *winnow,
+         double *sample,
+         int *seed,
+         int *noGlobalPruning,
+         double *CF,
+         int *minCases,
+         int *fuzzyThreshold,
+         int *earlyStopping,
+         char **treev,
+         char **rulesv,
+         char **outputv)
+{
+    train(namesv, datav, 0, NULL, costv, subset, rules, utility, trials,
+          winnow, sample, seed, noGlobalPruning, CF, minCases,
+          fuzzyThreshold, earlyStopping, treev, rulesv, outputv);
+}
+
+/*
+ * As c50, but with the training cases provided as a table of values rather
+ * than the text of a .data file, so that they need not be formatted and
+ * parsed again. columns holds an array of ncases values for each attribute
+ * in the order they appear in the .names file, followed by the class if
+ * there is no class attribute. A discrete value is the number of the value
+ * in the attribute's list of values in the .names file, starting from 1, and
+ * a missing value is NaN. Discrete attributes must have their values listed.
+ * Cases with a missing class are skipped. Sampling is not supported.
+ */
+void c50table(char **namesv,
+              int ncases,
+              const double *const *columns,
+              char **costv,
+              int *subset,
+              int *rules,
+              int *utility,
+              int *trials,
+              int *winnow,
+              double *sample,
+              int *seed,
+              int *noGlobalPruning,
+              double *CF,
+              int *minCases,
+              int *fuzzyThreshold,
+              int *earlyStopping,
+              char **treev,
+              char **rulesv,
+              char **outputv)
+{
+    train(namesv, NULL, ncases, columns, costv, subset, rules, utility,
+          trials, winnow, sample, seed, noGlobalPruning, CF, minCases,
+          fuzzyThreshold, earlyStopping, treev, rulesv, outputv);
+}
+
 void predictions(char **casev,
                  char **namesv,
                  char **treev,
@@ -85,10 +85,17 @@ int c50main()
     SomeMiss = AllocZero(MaxAtt+1, Boolean);
     SomeNA   = AllocZero(MaxAtt+1, Boolean);
 
-    /*  Read data file  */
+    /*  Read data file, or the in-memory table if one was provided  */
 
-    if ( ! (F = GetFile(".data", "r")) ) Error(NOFILE, "", "");
-    GetData(F, true, false);
+    if ( DataTable )
+    {
+	GetTableData();
+    }
+    else
+    {
+	if ( ! (F = GetFile(".data", "r")) ) Error(NOFILE, "", "");
+	GetData(F, true, false);
+    }
     fprintf(Of, TX_ReadData(MaxCase+1, MaxAtt, FileStem));
 
     if ( XVAL && (F = GetFile(".test", "r")) )
@@ -40,7 +40,7 @@
 	/* Local data used by MarkActive and RuleClassify.
 	   Note: Active is never deallocated, just grows as required */
 
-RuleNo	*Active=Nil,	/* rules that fire while classifying case */
+C5_TLS RuleNo	*Active=Nil,	/* rules that fire while classifying case */
 	NActive,	/* number ditto */
 	ActiveSpace=0;	/* space allocated */
 
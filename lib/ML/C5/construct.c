@@ -69,7 +69,7 @@ void ConstructClassifiers()
     CaseNo	i, Errs, Cases, Bp, Excl=0;
     double	ErrWt, ExclWt=0, OKWt, ExtraErrWt, NFact, MinWt=1.0, a, b;
     ClassNo	c, Pred, Real, Best;
-    static	ClassNo	*Wrong=Nil;
+    static C5_TLS	ClassNo	*Wrong=Nil;
     int		BaseLeaves;
     Boolean	NoStructure, CheckExcl;
     float	*BVote;
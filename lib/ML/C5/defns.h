@@ -50,6 +50,7 @@
 #include <float.h>
 
 #include "text.h"
+#include "threadlocal.h"
 
 
 
@@ -505,6 +506,7 @@ AttValue    EvaluateDef(Definition D, DataRec Case);
 	/* getdata.c */
 
 void	    GetData(FILE *Df, Boolean Train, Boolean AllowUnknownClass);
+void	    GetTableData(void);
 DataRec	    GetDataRec(FILE *Df, Boolean Train);
 DataRec	    PredictGetDataRec(FILE *Df, Boolean Train);
 DataRec	    PredictGetDataRec(FILE *Df, Boolean Train);
@@ -23,13 +23,13 @@
 /*************************************************************************/
 
 
-extern	int		VERBOSITY,
+extern C5_TLS	int		VERBOSITY,
 			TRIALS,
 			FOLDS,
 			UTILITY,
 			NCPU;
 
-extern	Boolean		SUBSET,
+extern C5_TLS	Boolean		SUBSET,
 			BOOST,
 			PROBTHRESH,
 			RULES,
@@ -40,31 +40,31 @@ extern	Boolean		SUBSET,
 			GLOBAL;
 
 /* Added for sample.c */
-extern  Boolean         RULESUSED;
+extern C5_TLS  Boolean         RULESUSED;
 
-extern	CaseCount	MINITEMS,
+extern C5_TLS	CaseCount	MINITEMS,
 			LEAFRATIO;
 
-extern	float		CF,
+extern C5_TLS	float		CF,
 			SAMPLE;
 
-extern	Boolean		LOCK;
+extern C5_TLS	Boolean		LOCK;
 
-extern	Attribute	ClassAtt,
+extern C5_TLS	Attribute	ClassAtt,
 			LabelAtt,
 			CWtAtt;
 
-extern double		AvCWt;
+extern C5_TLS double		AvCWt;
 
-extern	String		*ClassName,
+extern C5_TLS	String		*ClassName,
 			*AttName,
 			**AttValName;
 
-extern	char 		*IgnoredVals;
-extern	int		IValsSize,
+extern C5_TLS	char 		*IgnoredVals;
+extern C5_TLS	int		IValsSize,
 			IValsOffset;
 
-extern	int		MaxAtt,
+extern C5_TLS	int		MaxAtt,
 			MaxClass,
 			MaxDiscrVal,
 			MaxLabel,
@@ -73,32 +73,35 @@ extern	int		MaxAtt,
 			AttExIn,
 			TSBase;
 
-extern	DiscrValue	*MaxAttVal;
+extern C5_TLS	DiscrValue	*MaxAttVal;
 
-extern	char		*SpecialStatus;
+extern C5_TLS	char		*SpecialStatus;
 
-extern	Definition	*AttDef;
-extern	Attribute	**AttDefUses;
+extern C5_TLS	Definition	*AttDef;
+extern C5_TLS	Attribute	**AttDefUses;
 
-extern	Boolean		*SomeMiss,
+extern C5_TLS	Boolean		*SomeMiss,
 			*SomeNA,
 			Winnowed;
 
-extern	ContValue	*ClassThresh;
+extern C5_TLS	ContValue	*ClassThresh;
 
-extern	CaseNo		MaxCase;
+extern C5_TLS	CaseNo		MaxCase;
 
-extern	DataRec		*Case;
+extern C5_TLS	DataRec		*Case;
 
-extern	DataRec		*SaveCase;
+extern C5_TLS	DataRec		*SaveCase;
 
-extern	String		FileStem;
+extern C5_TLS	const double	*const *DataTable;
+extern C5_TLS	CaseNo		DataTableCases;
 
-extern	Tree		*Raw,
+extern C5_TLS	String		FileStem;
+
+extern C5_TLS	Tree		*Raw,
 			*Pruned,
 			WTree;
 
-extern	float		Confidence,
+extern C5_TLS	float		Confidence,
 			SampleFrac,
 			*Vote,
 			*BVoteBlock,
@@ -106,74 +109,74 @@ extern	float		Confidence,
 			**NCost,
 			*WeightMul;
 
-extern	CRule		*MostSpec;
+extern C5_TLS	CRule		*MostSpec;
 
-extern	Boolean		UnitWeights,
+extern C5_TLS	Boolean		UnitWeights,
 			CostWeights;
 
-extern	int		Trial,
+extern C5_TLS	int		Trial,
 			MaxTree;
 
-extern	ClassNo		*TrialPred;
+extern C5_TLS	ClassNo		*TrialPred;
 
-extern double		*ClassFreq,
+extern C5_TLS double		*ClassFreq,
 			**DFreq;
 
-extern	float		*Gain,
+extern C5_TLS	float		*Gain,
 			*Info,
 			*EstMaxGR;
 
-double			*ClassSum;
+extern C5_TLS	double		*ClassSum;
 
-extern	ContValue	*Bar;
+extern C5_TLS	ContValue	*Bar;
 
-extern	double		GlobalBaseInfo,
+extern C5_TLS	double		GlobalBaseInfo,
 			**Bell;
 
-extern	Byte		*Tested;
+extern C5_TLS	Byte		*Tested;
 
-extern	Set		**Subset;
-extern	int		*Subsets;
+extern C5_TLS	Set		**Subset;
+extern C5_TLS	int		*Subsets;
 
-extern	EnvRec		GEnv;
+extern C5_TLS	EnvRec		GEnv;
 
-extern	CRule		*Rule;
+extern C5_TLS	CRule		*Rule;
 
-extern	RuleNo		NRules,
+extern C5_TLS	RuleNo		NRules,
 			RuleSpace;
 
 /* Added for sample.c */
-extern  RuleNo          *RulesUsed,
+extern C5_TLS  RuleNo          *RulesUsed,
 			NRulesUsed;
 
-extern	CRuleSet	 *RuleSet;
+extern C5_TLS	CRuleSet	 *RuleSet;
 
-extern	ClassNo		Default;
+extern C5_TLS	ClassNo		Default;
 
-extern	Byte		**Fires,
+extern C5_TLS	Byte		**Fires,
 			*CBuffer;
 
-extern	int		*CovBy,
+extern C5_TLS	int		*CovBy,
 			*List;
 
-extern	float		AttTestBits,
+extern C5_TLS	float		AttTestBits,
 			*BranchBits;
-extern	int		*AttValues,
+extern C5_TLS	int		*AttValues,
 			*PossibleCuts;
 
-extern	double		*LogCaseNo,
+extern C5_TLS	double		*LogCaseNo,
 			*LogFact;
 
-extern	int		*UtilErr,
+extern C5_TLS	int		*UtilErr,
 			*UtilBand;
-extern	double		*UtilCost;
+extern C5_TLS	double		*UtilCost;
 
-extern	int		KRInit,
+extern C5_TLS	int		KRInit,
 			Now;
 
-extern	FILE		*TRf;
-extern	char		Fn[500];
+extern C5_TLS	FILE		*TRf;
+extern C5_TLS	char		Fn[500];
 
-extern	FILE  		*Of;
-extern enum mode {m_build ,m_predict} MODE;
+extern C5_TLS	FILE  		*Of;
+extern C5_TLS enum mode {m_build ,m_predict} MODE;
 
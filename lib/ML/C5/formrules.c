@@ -45,27 +45,27 @@
 #include "transform.h"
 #include "redefine.h"
 
-double		*Errors=Nil,		/* [Condition] */
+C5_TLS double		*Errors=Nil,		/* [Condition] */
 		*Total=Nil;		/* [Condition] */
 
-float		*Pessimistic=Nil,	/* [Condition] */
+C5_TLS float		*Pessimistic=Nil,	/* [Condition] */
 		*CondCost=Nil;		/* [Condition] */
 
-Boolean		**CondFailedBy=Nil,	/* [Condition][CaseNo] */
+C5_TLS Boolean		**CondFailedBy=Nil,	/* [Condition][CaseNo] */
 		*Deleted=Nil;		/* [Condition] */
 
-Condition	*Stack=Nil;
+C5_TLS Condition	*Stack=Nil;
 
-int		MaxDepth=0,		/* depth of tree */
+C5_TLS int		MaxDepth=0,		/* depth of tree */
 		NCond,
 		Bestd;
 
-ClassNo		TargetClass;
+C5_TLS ClassNo		TargetClass;
 
-short		*NFail=Nil,		/* NFail[i] = conditions failed by i */
+C5_TLS short		*NFail=Nil,		/* NFail[i] = conditions failed by i */
 		*LocalNFail=Nil;	/* copy used during rule pruning */
 
-CaseNo		Fail0,
+C5_TLS CaseNo		Fail0,
 		Fail1,
 		FailMany,
 		*Succ=Nil;		/* case following case i */
@@ -38,22 +38,22 @@
 #include "transform.h"
 #include "redefine.h"
 
-Boolean		MultiVal,	/* all atts have many values */
+C5_TLS Boolean		MultiVal,	/* all atts have many values */
 		Subsample;	/* use subsampling */
-float		AvGainWt,	/* weight of average gain in gain threshold */
+C5_TLS float		AvGainWt,	/* weight of average gain in gain threshold */
 		MDLWt;		/* weight of MDL threshold ditto */
 
-Attribute	*DList=Nil;	/* list of discrete atts */
-int		NDList;		/* number in list */
+C5_TLS Attribute	*DList=Nil;	/* list of discrete atts */
+C5_TLS int		NDList;		/* number in list */
 
-DiscrValue	MaxLeaves;	/* target maximum tree size */
+C5_TLS DiscrValue	MaxLeaves;	/* target maximum tree size */
 
 #define		SAMPLEUNIT	2000
 
-float		ValThresh;	/* minimum GR when evaluating sampled atts */
-Boolean		Sampled;	/* true if sampling used */
+C5_TLS float		ValThresh;	/* minimum GR when evaluating sampled atts */
+C5_TLS Boolean		Sampled;	/* true if sampling used */
 
-Attribute	*Waiting=Nil,	/* attribute wait list */
+C5_TLS Attribute	*Waiting=Nil,	/* attribute wait list */
 		NWaiting=0;
 
 
@@ -58,7 +58,7 @@ drand48()
 double drand48(void);
 #endif
 
-Boolean SuppressErrorMessages=false;
+C5_TLS Boolean SuppressErrorMessages=false;
 #define XError(a,b,c)	\
     if (MODE == m_build) { \
 	if (! SuppressErrorMessages) Error((a),(b),(c)); \
@@ -66,7 +66,7 @@ Boolean SuppressErrorMessages=false;
 	Error((a),(b),(c)); \
     }
 
-CaseNo	SampleFrom;		/* file count for sampling */
+C5_TLS CaseNo	SampleFrom;		/* file count for sampling */
 
 
 /*************************************************************************/
@@ -188,6 +188,131 @@ void GetData(FILE *Df, Boolean Train, Boolean AllowUnknownClass)
 
 
 
+/*************************************************************************/
+/*									 */
+/*	Read training cases from the in-memory table DataTable rather	 */
+/*	than from a file.  The table holds DataTableCases values for	 */
+/*	each attribute in turn, followed by the class if there is no	 */
+/*	class attribute.  A discrete value is the number of the value	 */
+/*	in the attribute's list of values in the names file, from 1,	 */
+/*	and a missing value is NaN.  Discrete attributes must have	 */
+/*	their values listed.  Cases with a missing class are skipped.	 */
+/*									 */
+/*	On completion, cases are stored in array Case in the same way	 */
+/*	as by GetData.							 */
+/*									 */
+/*************************************************************************/
+
+
+void GetTableData(void)
+/*   ------------  */
+{
+    DataRec	DVec;
+    CaseNo	i, CaseSpace;
+    Attribute	Att;
+    ContValue	Cv;
+    double	V;
+    int		Dv;
+
+    MaxCase = MaxLabel = CaseSpace = 0;
+    Case = Alloc(1, DataRec);
+
+    ForEach(i, 0, DataTableCases-1)
+    {
+	/*  Skip cases with unknown class before recording anything  */
+
+	if ( isnan(DataTable[( ClassAtt ? ClassAtt : MaxAtt+1 ) - 1][i]) )
+	{
+	    continue;
+	}
+
+	/*  Make sure there is room for another case  */
+
+	if ( MaxCase >= CaseSpace )
+	{
+	    CaseSpace += Inc;
+	    Realloc(Case, CaseSpace+1, DataRec);
+	}
+
+	Case[MaxCase] = DVec = NewCase();
+	ForEach(Att, 1, MaxAtt)
+	{
+	    if ( AttDef[Att] )
+	    {
+		DVec[Att] = EvaluateDef(AttDef[Att], DVec);
+
+		if ( Continuous(Att) )
+		{
+		    CheckValue(DVec, Att);
+		}
+
+		if ( SomeMiss )
+		{
+		    SomeMiss[Att] |= Unknown(DVec, Att);
+		    SomeNA[Att]   |= NotApplic(DVec, Att);
+		}
+
+		continue;
+	    }
+
+	    if ( Exclude(Att) ) continue;
+
+	    V = DataTable[Att-1][i];
+	    if ( isnan(V) )
+	    {
+		/*  Set marker to indicate missing value  */
+
+		DVal(DVec, Att) = UNKNOWN;
+		if ( SomeMiss ) SomeMiss[Att] = true;
+	    }
+	    else
+	    if ( Discrete(Att) )
+	    {
+		/*  Skip the N/A value added by GetNames, which is not  */
+		/*  numbered in the table  */
+
+		Dv = (DiscrValue) V;
+		if ( ! strcmp(AttValName[Att][1], "N/A") ) Dv++;
+		DVal(DVec, Att) = Dv;
+	    }
+	    else
+	    {
+		CVal(DVec, Att) = V;
+		CheckValue(DVec, Att);
+	    }
+	}
+
+	if ( ClassAtt )
+	{
+	    if ( Discrete(ClassAtt) )
+	    {
+		Class(DVec) = XDVal(DVec, ClassAtt);
+	    }
+	    else
+	    {
+		/*  Find appropriate segment using class thresholds  */
+
+		Cv = CVal(DVec, ClassAtt);
+
+		for ( Dv = 1 ; Dv < MaxClass && Cv > ClassThresh[Dv] ; Dv++ )
+		    ;
+
+		Class(DVec) = Dv;
+	    }
+	}
+	else
+	{
+	    Class(DVec) = (ClassNo) DataTable[MaxAtt][i];
+	}
+
+	MaxCase++;
+    }
+
+    MaxCase--;
+}
+
+
+
 /*************************************************************************/
 /*									 */
 /*	Read a raw case from file Df.					 */
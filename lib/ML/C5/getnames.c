@@ -43,8 +43,8 @@
 #include "redefine.h"
 
 #define	MAXLINEBUFFER	10000
-int	Delimiter;
-char	LineBuffer[MAXLINEBUFFER], *LBp=LineBuffer;
+C5_TLS int	Delimiter;
+C5_TLS char	LineBuffer[MAXLINEBUFFER], *LBp=Nil;	/* set by GetNames */
 
 
 
@@ -443,6 +443,7 @@ void ExplicitAtt(FILE *Nf)
     DiscrValue	v;
     int		ValCeiling=100, BaseYear;
     time_t	clock;
+    struct tm	BaseTime;
 
     /*  Read attribute type or first discrete value  */
 
@@ -470,7 +471,8 @@ void ExplicitAtt(FILE *Nf)
 	    if ( ! TSBase )
 	    {
 		clock = time(0);
-		BaseYear = gmtime(&clock)->tm_year + 1900;
+		gmtime_r(&clock, &BaseTime);
+		BaseYear = BaseTime.tm_year + 1900;
 		SetTSBase(BaseYear);
 	    }
 	}
@@ -734,7 +736,7 @@ void FreeNames()
 int InChar(FILE *f)
 /*  ------  */
 {
-    if ( ! *LBp )
+    if ( ! LBp || ! *LBp )
     {
 	LBp = LineBuffer;
 
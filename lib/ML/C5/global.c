@@ -42,12 +42,12 @@
 /*									 */
 /*************************************************************************/
 
-int		VERBOSITY=0,	/* verbosity level (0 = none) */
+C5_TLS int		VERBOSITY=0,	/* verbosity level (0 = none) */
 		TRIALS=1,	/* number of trees to be grown */
 		FOLDS=10,	/* crossvalidation folds */
 		UTILITY=0;	/* rule utility bands */
 
-Boolean		SUBSET=0,	/* subset tests allowed */
+C5_TLS Boolean		SUBSET=0,	/* subset tests allowed */
 		BOOST=0,        /* boosting invoked */
                 EARLYSTOPPING=0,/* let C5 check for effective boosting */
 		PROBTHRESH=0,	/* to use soft thresholds */
@@ -57,18 +57,18 @@ Boolean		SUBSET=0,	/* subset tests allowed */
 		WINNOW=0,	/* attribute winnowing */
 		GLOBAL=1;	/* use global pruning for trees */
 
-enum mode {m_build ,m_predict} MODE = m_build;
+C5_TLS enum mode {m_build ,m_predict} MODE = m_build;
 
 /* Added for sample.c */
-Boolean         RULESUSED=0;    /* list applicable rules */
+C5_TLS Boolean         RULESUSED=0;    /* list applicable rules */
 
-CaseCount	MINITEMS=2,	/* minimum cases each side of a cut */
+C5_TLS CaseCount	MINITEMS=2,	/* minimum cases each side of a cut */
 		LEAFRATIO=0;	/* leaves per case for boosting */
 
-float		CF=0.25,	/* confidence limit for tree pruning */
+C5_TLS float		CF=0.25,	/* confidence limit for tree pruning */
 		SAMPLE=0.0;	/* sample training proportion */
 
-Boolean		LOCK=false;	/* sample locked */
+C5_TLS Boolean		LOCK=false;	/* sample locked */
 
 
 /*************************************************************************/
@@ -77,21 +77,21 @@ Boolean		LOCK=false;	/* sample locked */
 /*									 */
 /*************************************************************************/
 
-Attribute	ClassAtt=0,	/* attribute to use as class */
+C5_TLS Attribute	ClassAtt=0,	/* attribute to use as class */
 		LabelAtt=0,	/* attribute to use as case ID */
 		CWtAtt=0;	/* attribute to use for case weight */
 
-double		AvCWt;		/* average case weight */
+C5_TLS double		AvCWt;		/* average case weight */
 
-String		*ClassName=0,	/* class names */
+C5_TLS String		*ClassName=0,	/* class names */
 		*AttName=0,	/* att names */
 		**AttValName=0;	/* att value names */
 
-char		*IgnoredVals=0;	/* values of labels and atts marked ignore */
-int		IValsSize=0,	/* size of above */
+C5_TLS char		*IgnoredVals=0;	/* values of labels and atts marked ignore */
+C5_TLS int		IValsSize=0,	/* size of above */
 		IValsOffset=0;	/* index of first free char */
 
-int		MaxAtt,		/* max att number */
+C5_TLS int		MaxAtt,		/* max att number */
 		MaxClass,	/* max class number */
 		MaxDiscrVal=3,	/* max discrete values for any att */
 		MaxLabel=0,	/* max characters in case label */
@@ -100,26 +100,29 @@ int		MaxAtt,		/* max att number */
 		AttExIn=0,	/* attribute exclusions/inclusions */
 		TSBase=0;	/* base day for time stamps */
 
-DiscrValue	*MaxAttVal=0;	/* number of values for each att */
+C5_TLS DiscrValue	*MaxAttVal=0;	/* number of values for each att */
 
-char		*SpecialStatus=0;/* special att treatment */
+C5_TLS char		*SpecialStatus=0;/* special att treatment */
 
-Definition	*AttDef=0;	/* definitions of implicit atts */
-Attribute	**AttDefUses=0;	/* list of attributes used by definition */
+C5_TLS Definition	*AttDef=0;	/* definitions of implicit atts */
+C5_TLS Attribute	**AttDefUses=0;	/* list of attributes used by definition */
 
-Boolean		*SomeMiss=Nil,	/* att has missing values */
+C5_TLS Boolean		*SomeMiss=Nil,	/* att has missing values */
 		*SomeNA=Nil,	/* att has N/A values */
 		Winnowed=0;	/* atts have been winnowed */
 
-ContValue	*ClassThresh=0;	/* thresholded class attribute */
+C5_TLS ContValue	*ClassThresh=0;	/* thresholded class attribute */
 
-CaseNo		MaxCase=-1;	/* max data case number */
+C5_TLS CaseNo		MaxCase=-1;	/* max data case number */
 
-DataRec		*Case=0;	/* data cases */
+C5_TLS DataRec		*Case=0;	/* data cases */
 
-DataRec		*SaveCase=0;
+C5_TLS DataRec		*SaveCase=0;
 
-String		FileStem="undefined";
+C5_TLS const double	*const *DataTable=Nil;	/* in-memory training data */
+C5_TLS CaseNo		DataTableCases=0;	/* cases in DataTable */
+
+C5_TLS String		FileStem="undefined";
 
 /*************************************************************************/
 /*									 */
@@ -127,49 +130,49 @@ String		FileStem="undefined";
 /*									 */
 /*************************************************************************/
 
-Tree		*Raw=0,		/* unpruned trees */
+C5_TLS Tree		*Raw=0,		/* unpruned trees */
 		*Pruned=0,	/* pruned trees */
 		WTree=0;	/* winnow tree */
 
-float		SampleFrac=1,	/* fraction used when sampling */
+C5_TLS float		SampleFrac=1,	/* fraction used when sampling */
 		*Vote=0,	/* total votes for classes */
 		*BVoteBlock=0,	/* boost voting block */
 		**MCost=0,	/* misclass cost [pred][real] */
 		**NCost=0,	/* normalised MCost used for rules */
 		*WeightMul=0;	/* prior adjustment factor */
 
-double		Confidence;	/* set by classify() */
+C5_TLS double		Confidence;	/* set by classify() */
 
-CRule		*MostSpec=0;	/* most specific rule for each class */
+C5_TLS CRule		*MostSpec=0;	/* most specific rule for each class */
 
-Boolean		UnitWeights=1,	/* all weights are 1.0 */
+C5_TLS Boolean		UnitWeights=1,	/* all weights are 1.0 */
 		CostWeights=0;	/* reweight cases for costs */
 
-int		Trial,		/* trial number for boosting */
+C5_TLS int		Trial,		/* trial number for boosting */
 		MaxTree=0;	/* max tree grown */
 
-ClassNo		*TrialPred=0;	/* predictions for each boost trial */
+C5_TLS ClassNo		*TrialPred=0;	/* predictions for each boost trial */
 
-double		*ClassFreq=0,	/* ClassFreq[c] = # cases of class c */
+C5_TLS double		*ClassFreq=0,	/* ClassFreq[c] = # cases of class c */
 		**DFreq=0;	/* DFreq[a][c*x] = Freq[][] for attribute a */
 
-float		*Gain=0,	/* Gain[a] = info gain by split on att a */
+C5_TLS float		*Gain=0,	/* Gain[a] = info gain by split on att a */
 		*Info=0,	/* Info[a] = max info from split on att a */
 		*EstMaxGR=0;	/* EstMaxGR[a] = est max GR from folit on a */
 
-double		*ClassSum=0;	/* class weights during classification */
+C5_TLS double		*ClassSum=0;	/* class weights during classification */
 
-ContValue	*Bar=0;		/* Bar[a]  = best threshold for contin att a */
+C5_TLS ContValue	*Bar=0;		/* Bar[a]  = best threshold for contin att a */
 
-double		GlobalBaseInfo,	/* base information before split */
+C5_TLS double		GlobalBaseInfo,	/* base information before split */
 		**Bell=0;	/* table of Bell numbers for subsets */
 
-Byte		*Tested=0;	/* Tested[a] = att a already tested */
+C5_TLS Byte		*Tested=0;	/* Tested[a] = att a already tested */
 
-Set		**Subset=0;	/* Subset[a][s] = subset s for att a */
-int		*Subsets=0;	/* Subsets[a] = no. subsets for att a */
+C5_TLS Set		**Subset=0;	/* Subset[a][s] = subset s for att a */
+C5_TLS int		*Subsets=0;	/* Subsets[a] = no. subsets for att a */
 
-EnvRec		GEnv;		/* environment block */
+C5_TLS EnvRec		GEnv;		/* environment block */
 
 /*************************************************************************/
 /*									 */
@@ -177,37 +180,37 @@ EnvRec		GEnv;		/* environment block */
 /*									 */
 /*************************************************************************/
 
-CRule		*Rule=0;	/* current rules */
+C5_TLS CRule		*Rule=0;	/* current rules */
 
-RuleNo		NRules,		/* number of rules */
+C5_TLS RuleNo		NRules,		/* number of rules */
 		RuleSpace;	/* space currently allocated for rules */
 
 /* Added for sample.c */
-RuleNo		*RulesUsed=Nil, /* list of all rules used */
+C5_TLS RuleNo		*RulesUsed=Nil, /* list of all rules used */
 		NRulesUsed;    /* number ditto */
 
-CRuleSet	*RuleSet=0;	/* rulesets */
+C5_TLS CRuleSet	*RuleSet=0;	/* rulesets */
 
-ClassNo		Default;	/* default class associated with ruleset or
+C5_TLS ClassNo		Default;	/* default class associated with ruleset or
 				   boosted classifier */
 
-Byte		**Fires=Nil,	/* Fires[r][*] = cases covered by rule r */
+C5_TLS Byte		**Fires=Nil,	/* Fires[r][*] = cases covered by rule r */
 		*CBuffer=Nil;	/* buffer for compressing lists */
 
-int		*CovBy=Nil,	/* entry numbers for Fires inverse */
+C5_TLS int		*CovBy=Nil,	/* entry numbers for Fires inverse */
 		*List=Nil;	/* temporary list of cases or rules */
 
-float		AttTestBits,	/* average bits to encode tested attribute */
+C5_TLS float		AttTestBits,	/* average bits to encode tested attribute */
 		*BranchBits=0;	/* ditto attribute value */
-int		*AttValues=0,	/* number of attribute values in the data */
+C5_TLS int		*AttValues=0,	/* number of attribute values in the data */
 		*PossibleCuts=0;/* number of thresholds for an attribute */
 
-double		*LogCaseNo=0,	/* LogCaseNo[i] = log2(i) */
+C5_TLS double		*LogCaseNo=0,	/* LogCaseNo[i] = log2(i) */
 		*LogFact=0;	/* LogFact[i] = log2(i!) */
 
-int		*UtilErr=0,	/* error by utility band */
+C5_TLS int		*UtilErr=0,	/* error by utility band */
 		*UtilBand=0;	/* last rule in each band */
-double		*UtilCost=0;	/* cost ditto */
+C5_TLS double		*UtilCost=0;	/* cost ditto */
 
 
 /*************************************************************************/
@@ -216,10 +219,10 @@ double		*UtilCost=0;	/* cost ditto */
 /*									 */
 /*************************************************************************/
 
-int		KRInit=0,	/* KRandom initializer for SAMPLE */
+C5_TLS int		KRInit=0,	/* KRandom initializer for SAMPLE */
 		Now=0;		/* current stage */
 
-FILE		*TRf=0;		/* file pointer for tree and rule i/o */
-char		Fn[500];	/* file name */
+C5_TLS FILE		*TRf=0;		/* file pointer for tree and rule i/o */
+C5_TLS char		Fn[500];	/* file name */
 
-FILE  		*Of=0;		/* output file */
+C5_TLS FILE  		*Of=0;		/* output file */
@@ -40,17 +40,17 @@
 #include "transform.h"
 #include "redefine.h"
 
-char	*Buff;			/* buffer for input characters */
-int	BuffSize, BN;		/* size and index of next character */
+C5_TLS char	*Buff;			/* buffer for input characters */
+C5_TLS int	BuffSize, BN;		/* size and index of next character */
 
-EltRec	*TStack;		/* expression stack model */
-int	TStackSize, TSN;	/* size of stack and index of next entry */
+C5_TLS EltRec	*TStack;		/* expression stack model */
+C5_TLS int	TStackSize, TSN;	/* size of stack and index of next entry */
 
-int	DefSize, DN;		/* size of definition and next element */
+C5_TLS int	DefSize, DN;		/* size of definition and next element */
 
-Boolean PreviousError;		/* to avoid parasitic errors */
+C5_TLS Boolean PreviousError;		/* to avoid parasitic errors */
 
-AttValue _UNK,			/* quasi-constant for unknown value */
+C5_TLS AttValue _UNK,			/* quasi-constant for unknown value */
 	 _NA;			/* ditto for not applicable */
 
 
@@ -38,8 +38,8 @@
 #include "transform.h"
 #include "redefine.h"
 
-Boolean	BINARY=false;
-int	Entry;
+C5_TLS Boolean	BINARY=false;
+C5_TLS int	Entry;
 
 char*	Prop[]={"null",
 		"att",
@@ -67,11 +67,11 @@ char*	Prop[]={"null",
 		"init"
 	       };
 
-char	PropName[20],
+C5_TLS char	PropName[20],
 	*PropVal=Nil,
 	*Unquoted;
-int	PropValSize=0;
-char *	LastExt="";
+C5_TLS int	PropValSize=0;
+C5_TLS char *	LastExt="";
 
 #define	PROPS 23
 
@@ -164,7 +164,7 @@ void WriteFilePrefix(String Extension)
 /*   ---------------  */
 {
     time_t	clock;
-    struct tm	*now;
+    struct tm	NowRec, *now=&NowRec;
 
     if ( ! (TRf = GetFile(Extension, "w")) )
     {
@@ -172,7 +172,7 @@ void WriteFilePrefix(String Extension)
     }
 
     clock = time(0);
-    now = localtime(&clock);
+    localtime_r(&clock, now);
     now->tm_mon++;
     fprintf(TRf, "id=\"See5/C5.0 %s %d-%d%d-%d%d\"\n",
 	    RELEASE,
@@ -46,14 +46,14 @@
 #define	  REPORTPROGRESS	4	/*	 original tree */
 #define	  UNITWEIGHTS		8	/*	 UnitWeights is true*/
 
-Set		*PossibleValues;
+C5_TLS Set		*PossibleValues;
 
-double		MaxExtraErrs,		/* limit for global prune */
+C5_TLS double		MaxExtraErrs,		/* limit for global prune */
 		TotalExtraErrs;		/* extra errors from ties */
-Tree		*XT;			/* subtrees with lowest cost comp */
-int		NXT;			/* number ditto */
-float		MinCC;			/* cost compexity for XT */
-Boolean		RecalculateErrs;	/* if missing values */
+C5_TLS Tree		*XT;			/* subtrees with lowest cost comp */
+C5_TLS int		NXT;			/* number ditto */
+C5_TLS float		MinCC;			/* cost compexity for XT */
+C5_TLS Boolean		RecalculateErrs;	/* if missing values */
 
 
 
@@ -809,7 +809,7 @@ void CheckSubsets(Tree T, Boolean PruneDefaults)
 /*************************************************************************/
 
 
-float Val[] = {  0,  0.001, 0.005, 0.01, 0.05, 0.10, 0.20, 0.40, 1.00},
+C5_TLS float Val[] = {  0,  0.001, 0.005, 0.01, 0.05, 0.10, 0.20, 0.40, 1.00},
       Dev[] = {4.0,  3.09,  2.58,  2.33, 1.65, 1.28, 0.84, 0.25, 0.00},
       Coeff;
 
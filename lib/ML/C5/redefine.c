@@ -17,6 +17,7 @@
 #include <string.h>
 
 #include "redefine.h"
+#include "threadlocal.h"
 #include "strbuf.h"
 #include "hash.h"
 
@@ -34,7 +35,7 @@
  * This is used to save the contents of files that have been
  * created and written.
  */
-static void *strbufv;
+static C5_TLS void *strbufv;
 
 /*
  * XXX Is this called anywhere in Cubist?  It looks like it's
@@ -8,10 +8,10 @@
 
 /* Global variables defined in update.d */
 extern int Stage;
-extern FILE *Uf;
+extern C5_TLS FILE *Uf;
 
 /* Used to implement rbm_exit */
-jmp_buf rbm_buf;
+C5_TLS jmp_buf rbm_buf;
 
 /*
  * Reset all global variables to their initial value
@@ -199,6 +199,9 @@ void initglobals(void)
     Fn[0] = '\0';	/* file name */
 
     Of=0;		/* output file */
+
+    DataTable=Nil;	/* in-memory training data */
+    DataTableCases=0;
     MODE = m_build;
 
     modelfilesinit();
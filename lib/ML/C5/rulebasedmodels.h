@@ -3,8 +3,10 @@
 
 #include <setjmp.h>
 
+#include "threadlocal.h"
+
 #define JMP_OFFSET 100
-extern jmp_buf rbm_buf;
+extern C5_TLS jmp_buf rbm_buf;
 
 extern void initglobals(void);
 extern void setglobals(int subset, int rules, int bands, int trials,
@@ -42,13 +42,13 @@
 #include "transform.h"
 #include "redefine.h"
 
-Condition	*Test=Nil;	/* tests that appear in ruleset */
-int		NTest,		/* number of distinct tests */
+C5_TLS Condition	*Test=Nil;	/* tests that appear in ruleset */
+C5_TLS int		NTest,		/* number of distinct tests */
 		TestSpace,	/* space allocated for tests */
 		*TestOccur,	/* frequency of test occurrence in rules */
 		*RuleCondOK;	/* conditions satisfied by rule */
 
-Boolean		*TestUsed;	/* used in parent nodes */
+C5_TLS Boolean		*TestUsed;	/* used in parent nodes */
 
 
 
@@ -38,24 +38,24 @@
 #include "transform.h"
 #include "redefine.h"
 
-float	*DeltaErrs=Nil,	/* DeltaErrs[r]	 = change attributable to rule r or
+C5_TLS float	*DeltaErrs=Nil,	/* DeltaErrs[r]	 = change attributable to rule r or
 					   realisable if rule r included */
 	*Bits=Nil,	/* Bits[r]	 = bits to encode rule r */
 	BitsErr,	/* BitsErr	 = bits to label prediction as error */
 	BitsOK;		/* BitsOK	 = bits to label prediction as ok */
 
-int	**TotVote=Nil;	/* TotVote[i][c] = case i's votes for class c */
+C5_TLS int	**TotVote=Nil;	/* TotVote[i][c] = case i's votes for class c */
 
-ClassNo	*TopClass=Nil,	/* TopClass[i]	 = class with highest vote */
+C5_TLS ClassNo	*TopClass=Nil,	/* TopClass[i]	 = class with highest vote */
 	*AltClass=Nil;	/* AltClass[i]	 = class with second highest vote */
 
-Boolean	*RuleIn=Nil,	/* RuleIn[r]	 = rule r included */
+C5_TLS Boolean	*RuleIn=Nil,	/* RuleIn[r]	 = rule r included */
 	*Covered=Nil;	/* Covered[i]	 = case i covered by rule(s) */
 
-Byte	*CovByBlock=Nil,/* holds entries for inverse of Fires */
+C5_TLS Byte	*CovByBlock=Nil,/* holds entries for inverse of Fires */
 	**CovByPtr=Nil;	/* next entry for CovBy[i] */
 
-RuleNo	*LastCovBy=Nil; /* Last rule covering case i  */
+C5_TLS RuleNo	*LastCovBy=Nil; /* Last rule covering case i  */
 
 
 /*************************************************************************/
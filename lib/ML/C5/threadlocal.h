@@ -0,0 +1,17 @@
+#ifndef _THREADLOCAL_H_
+#define _THREADLOCAL_H_
+
+/*
+ * C5.0 keeps all of its working state in global variables.  Every one of
+ * them is declared thread local, so that each thread gets its own copy of
+ * that state and independent trainings and classifications can run in
+ * parallel threads.  c50() and predictions() reinitialize the state of the
+ * calling thread on entry, so each invocation starts from a clean slate.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define C5_TLS __thread
+#else
+#define C5_TLS _Thread_local
+#endif
+
+#endif
@@ -47,10 +47,10 @@
 	    printed, subtrees are broken off and printed separately after
 	    the main tree is finished	 */
 
-int	SubTree,		/* highest subtree to be printed */
+C5_TLS int	SubTree,		/* highest subtree to be printed */
 	SubSpace=0;		/* maximum subtree encountered */
-Tree	*SubDef=Nil;		/* pointers to subtrees */
-Boolean	LastBranch[Width];	/* whether printing last branch of subtree */
+C5_TLS Tree	*SubDef=Nil;		/* pointers to subtrees */
+C5_TLS Boolean	LastBranch[Width];	/* whether printing last branch of subtree */
 
 
 
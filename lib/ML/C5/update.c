@@ -38,7 +38,7 @@
 #include "transform.h"
 #include "redefine.h"
 
-FILE	*Uf=0;			/* File to which update info written  */
+C5_TLS FILE	*Uf=0;			/* File to which update info written  */
 
 
 /*************************************************************************/
@@ -73,8 +73,8 @@ void NotifyStage(int S)
 void Progress(float Delta)
 /*   --------  */
 {
-    static float Total, Current=0;
-    static int   Twentieth=0, LastStage=0;
+    static C5_TLS float Total, Current=0;
+    static C5_TLS int   Twentieth=0, LastStage=0;
     int		 p;
     static char *Message[]={ "",
 			     "Reading training data      ",
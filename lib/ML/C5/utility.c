@@ -45,13 +45,13 @@
 void PrintHeader(String Title)
 /*   -----------  */
 {
-    char	TitleLine[80];
+    char	TitleLine[80], TimeLine[26];
     time_t	clock;
     int		Underline;
 
     clock = time(0);
     sprintf(TitleLine, "%s%s [%s]", NAME, Title, TX_Release(RELEASE));
-    fprintf(Of, "\n%s  \t%s", TitleLine, ctime(&clock));
+    fprintf(Of, "\n%s  \t%s", TitleLine, ctime_r(&clock, TimeLine));
 
     Underline = CharWidth(TitleLine);
     while ( Underline-- ) putc('-', Of);
@@ -67,14 +67,14 @@ void PrintHeader(String Title)
 /*************************************************************************/
 
 
-String	OptArg, Option;
+C5_TLS String	OptArg, Option;
 
 
 char ProcessOption(int Argc, char *Argv[], char *Options)
 /*   -------------  */
 {
     int		i;
-    static int	OptNo=1;
+    static C5_TLS int	OptNo=1;
 
     if ( OptNo >= Argc ) return '\00';
 
@@ -98,7 +98,7 @@ char PredictProcessOption(int Argc, char *Argv[], char *Options)
 /*   -------------  */
 {
     int		i;
-    static int	OptNo=1;
+    static C5_TLS int	OptNo=1;
 
     if ( OptNo >= Argc ) return '\00';
 
@@ -215,8 +215,8 @@ typedef	struct _datablockrec
 	}
 	DataBlockRec;
 
-DataBlock	DataMem=Nil;
-int		DataBlockSize=0;
+C5_TLS DataBlock	DataMem=Nil;
+C5_TLS int		DataBlockSize=0;
 
 
 
@@ -279,12 +279,12 @@ void PredictFreeLastCase(DataRec DVec)
 
 #define	Modify(F,S)	if ( (F -= S) < 0 ) F += 1.0
 
-int	KRFp=0, KRSp=0;
+C5_TLS int	KRFp=0, KRSp=0;
 
 double KRandom()
 /*     -------  */
 {
-    static double	URD[55];
+    static C5_TLS double	URD[55];
     double		V1, V2;
     int			i, j;
 
@@ -550,7 +550,7 @@ void Error(int ErrNo, String S1, String S2)
 /*                                                                       */
 /*************************************************************************/
 
-char	LabelBuffer[1000];
+C5_TLS char	LabelBuffer[1000];
 
 
 String CaseLabel(CaseNo N)
@@ -956,14 +956,14 @@ void Cleanup()
 {
     int		t, r;
 
-    extern DataRec	*Blocked;
-    extern Tree		*SubDef;
-    extern int		SubSpace, ActiveSpace, PropValSize;
-    extern RuleNo	*Active;
-    extern float	*AttImp;
-    extern char		*PropVal;
-    extern Boolean	*Split, *Used;
-    extern FILE		*Uf;
+    extern C5_TLS DataRec	*Blocked;
+    extern C5_TLS Tree		*SubDef;
+    extern C5_TLS int		SubSpace, ActiveSpace, PropValSize;
+    extern C5_TLS RuleNo	*Active;
+    extern C5_TLS float	*AttImp;
+    extern C5_TLS char		*PropVal;
+    extern C5_TLS Boolean	*Split, *Used;
+    extern C5_TLS FILE		*Uf;
 
     NotifyStage(CLEANUP);
 
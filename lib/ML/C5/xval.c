@@ -37,8 +37,8 @@
 #include "transform.h"
 #include "redefine.h"
 
-DataRec	*Blocked=Nil;
-float	**Result=Nil;	/* Result[f][0] = tree/ruleset size
+C5_TLS DataRec	*Blocked=Nil;
+C5_TLS float	**Result=Nil;	/* Result[f][0] = tree/ruleset size
 				    [1] = tree/ruleset errors
 				    [2] = tree/ruleset cost  */
 
@@ -57,8 +57,8 @@ void CrossVal()
     CaseNo	i, Size, Start=0, Next, SaveMaxCase;
     int		f, SmallTestBlocks, t, SaveTRIALS;
     ClassNo	c;
-    static CaseNo *ConfusionMat=Nil;
-    static int    SaveFOLDS=0;
+    static C5_TLS CaseNo *ConfusionMat=Nil;
+    static C5_TLS int    SaveFOLDS=0;
 
     /*  Check for left-overs after interrupt  */
 
@@ -0,0 +1,148 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===----------------------- MAGEEC k-NN Classifier -----------------------===//
+//
+// This implements a k-NN machine learner. This finds the k closest feature
+// sets in the training set to the input feature set, and then makes each
+// decision by a vote between the configurations of those feature sets.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mageec/ML/KNN.h"
+#include "mageec/ML/1NNModel.h"
+#include "mageec/Decision.h"
+#include "mageec/Util.h"
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mageec {
+
+/// Added to the distance of a neighbor when weighting its vote, so that a
+/// neighbor at the same point as the query has a finite weight.
+static const double kVoteDistanceBias = 1e-9;
+
+KNN::KNN(unsigned k, DistanceMetric metric, bool distance_weighted)
+    : OneNN(), m_k(k), m_metric(metric),
+      m_distance_weighted(distance_weighted), m_feature_weights() {
+  assert(k > 0 && "k-NN requires at least one neighbor");
+}
+
+KNN::~KNN() {}
+
+std::unique_ptr<DecisionBase>
+KNN::makeDecision(const DecisionRequestBase &request,
+                  const FeatureSet &features, const IModel &model) const {
+  const auto &nn_model = static_cast<const OneNN::Model &>(model);
+  return vote(request, nn_model, findNearestNeighbors(nn_model, features));
+}
+
+std::vector<std::unique_ptr<DecisionBase>> KNN::makeDecisions(
+    const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+    const FeatureSet &features, const IModel &model) const {
+  const auto &nn_model = static_cast<const OneNN::Model &>(model);
+
+  // Every decision is voted on by the same neighbors, so only search for
+  // them once.
+  std::vector<OneNN::Model::Neighbor> neighbors =
+      findNearestNeighbors(nn_model, features);
+
+  std::vector<std::unique_ptr<DecisionBase>> decisions;
+  decisions.reserve(requests.size());
+  for (const auto &request : requests) {
+    decisions.push_back(vote(*request, nn_model, neighbors));
+  }
+  return decisions;
+}
+
+std::vector<double> KNN::getWeights(const OneNN::Model &nn_model) const {
+  std::vector<double> weights(nn_model.stride, 1.0);
+  for (auto weight : m_feature_weights) {
+    util::Option<unsigned> column = nn_model.getFeatureColumn(weight.first);
+    if (column) {
+      weights[column.get()] = weight.second;
+    }
+  }
+  return weights;
+}
+
+std::vector<OneNN::Model::Neighbor>
+KNN::findNearestNeighbors(const OneNN::Model &nn_model,
+                          const FeatureSet &features) const {
+  std::vector<double> query = normalizeFeatures(nn_model, features);
+  return nn_model.findNearest(query, m_k, m_metric, getWeights(nn_model));
+}
+
+std::unique_ptr<DecisionBase>
+KNN::vote(const DecisionRequestBase &request, const OneNN::Model &nn_model,
+          const std::vector<OneNN::Model::Neighbor> &neighbors) const {
+  util::Option<unsigned> column =
+      nn_model.getParameterColumn(getParameterID(request));
+  if (!column) {
+    return std::unique_ptr<NativeDecision>(new NativeDecision());
+  }
+  unsigned n_parameters = static_cast<unsigned>(nn_model.parameter_ids.size());
+
+  // Tally the votes for each value of the parameter. Values are kept in the
+  // order they are first voted for, so that a tie goes to the value of the
+  // nearer neighbor.
+  std::vector<std::pair<int64_t, double>> tally;
+  for (auto neighbor : neighbors) {
+    unsigned index = neighbor.second * n_parameters + column.get();
+    if (!nn_model.parameter_known[index]) {
+      continue;
+    }
+    int64_t value = nn_model.parameter_values[index];
+    double weight = 1.0;
+    if (m_distance_weighted) {
+      weight = 1.0 / (neighbor.first + kVoteDistanceBias);
+    }
+
+    auto entry = tally.begin();
+    while (entry != tally.end() && entry->first != value) {
+      ++entry;
+    }
+    if (entry == tally.end()) {
+      tally.push_back(std::make_pair(value, weight));
+    } else {
+      entry->second += weight;
+    }
+  }
+  if (tally.empty()) {
+    return std::unique_ptr<NativeDecision>(new NativeDecision());
+  }
+
+  auto best = tally.cbegin();
+  for (auto entry = tally.cbegin(); entry != tally.cend(); ++entry) {
+    if (entry->second > best->second) {
+      best = entry;
+    }
+  }
+  MAGEEC_DEBUG("k-NN voted " << best->first << " with weight "
+               << best->second << " from " << neighbors.size()
+               << " neighbors");
+
+  if (request.getType() == DecisionRequestType::kBool) {
+    return std::unique_ptr<BoolDecision>(new BoolDecision(best->first));
+  }
+  return std::unique_ptr<RangeDecision>(new RangeDecision(best->first));
+}
+
+} // end of namespace mageec
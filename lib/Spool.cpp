@@ -0,0 +1,511 @@
+/*  Copyright (C) 2017, Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===------------------------ MAGEEC feature spool ------------------------===//
+//
+// This implements reading and writing of spool files. A spool file starts
+// with a magic number and format version, followed by any number of
+// records. Each record is laid out as follows, with all integers in little
+// endian order:
+//
+//   u32  length of the payload
+//   u64  crc64 of the payload
+//   payload:
+//     str  out_path, src_path, type, name
+//     u8   feature class
+//     u16  number of features
+//     for each feature:
+//       u16  feature id
+//       u8   feature type
+//       str  serialized value
+//       str  feature name
+//
+// where each str is a u16 length followed by that many bytes.
+//
+// Appends to a spool file, and the claiming of a file for ingestion, are
+// serialized with an exclusive flock on the file. A process appending to
+// its file holds the lock while checking that the file has not been
+// renamed, and while writing to it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mageec/Spool.h"
+#include "mageec/Attribute.h"
+#include "mageec/AttributeSet.h"
+#include "mageec/Types.h"
+#include "mageec/Util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace mageec {
+
+/// Magic number at the start of every spool file
+static const uint8_t spool_magic[4] = {'M', 'G', 'S', 'P'};
+
+/// Version of the format of spool files
+static const unsigned spool_format_version = 1;
+
+/// Size of the magic number and format version at the start of the file
+static const size_t spool_header_size = sizeof(spool_magic) + 2;
+
+/// Size of the length and checksum preceding the payload of each record
+static const size_t spool_record_header_size = 4 + 8;
+
+/// Extension of spool files
+static const char spool_extension[] = ".spool";
+
+/// Extension of spool files which have been claimed for ingestion
+static const char claimed_extension[] = ".ingesting";
+
+/// Extension of claimed spool files which could not be read to their end
+static const char bad_extension[] = ".bad";
+
+/// Number of names tried when creating a new spool file
+static const unsigned spool_create_attempts = 100;
+
+/// \brief Check whether a path ends with an extension
+static bool hasExtension(const std::string &path, const char *ext) {
+  size_t ext_len = strlen(ext);
+  return path.size() > ext_len &&
+         path.compare(path.size() - ext_len, ext_len, ext) == 0;
+}
+
+/// \brief Replace one extension of a path with another
+///
+/// If the path does not end with the extension to be replaced, then the new
+/// extension is added to the whole path.
+static std::string replaceExtension(const std::string &path,
+                                    const char *from, const char *to) {
+  if (hasExtension(path, from)) {
+    return path.substr(0, path.size() - strlen(from)) + to;
+  }
+  return path + to;
+}
+
+/// \brief Take an exclusive lock on a file, waiting for it if necessary
+static bool lockFile(int fd) {
+  int res;
+  do {
+    res = flock(fd, LOCK_EX);
+  } while (res != 0 && errno == EINTR);
+  return res == 0;
+}
+
+/// \brief Write a string, prefixed by its 16-bit length, to a buffer
+static void writeString(std::vector<uint8_t> &buf, const std::string &str) {
+  assert(str.size() <= UINT16_MAX && "String too long for spool record");
+  util::write16LE(buf, static_cast<unsigned>(str.size()));
+  buf.insert(buf.end(), str.begin(), str.end());
+}
+
+/// \brief Serialize a record to the end of a buffer
+static void writeRecord(std::vector<uint8_t> &buf, const SpoolRecord &record) {
+  std::vector<uint8_t> payload;
+  writeString(payload, record.out_path);
+  writeString(payload, record.src_path);
+  writeString(payload, record.type);
+  writeString(payload, record.name);
+  payload.push_back(static_cast<uint8_t>(record.feature_class));
+
+  assert(record.features.size() <= UINT16_MAX &&
+         "Too many features for spool record");
+  util::write16LE(payload, record.features.size());
+  for (auto feature : record.features) {
+    std::vector<uint8_t> blob = feature->toBlob();
+    util::write16LE(payload, feature->getID());
+    payload.push_back(static_cast<uint8_t>(feature->getType()));
+    writeString(payload, std::string(blob.begin(), blob.end()));
+    writeString(payload, feature->getName());
+  }
+
+  assert(payload.size() <= UINT32_MAX && "Spool record too large");
+  util::write32LE(buf, static_cast<uint32_t>(payload.size()));
+  util::write64LE(buf, util::crc64(payload.data(),
+                                   static_cast<unsigned>(payload.size())));
+  buf.insert(buf.end(), payload.begin(), payload.end());
+}
+
+/// \brief Read a string, prefixed by its 16-bit length, from a payload
+///
+/// \return False if the string would extend beyond the end of the payload
+static bool readString(std::vector<uint8_t>::const_iterator &it,
+                       std::vector<uint8_t>::const_iterator end,
+                       std::string &str) {
+  if (std::distance(it, end) < 2) {
+    return false;
+  }
+  unsigned len = util::read16LE(it);
+  if (static_cast<unsigned>(std::distance(it, end)) < len) {
+    return false;
+  }
+  str.assign(it, it + len);
+  it += len;
+  return true;
+}
+
+/// \brief Deserialize the payload of a record
+///
+/// \return The record, or nothing if the payload is malformed
+static util::Option<SpoolRecord>
+readRecord(const std::vector<uint8_t> &payload) {
+  auto it = payload.cbegin();
+  auto end = payload.cend();
+
+  SpoolRecord record;
+  if (!readString(it, end, record.out_path) ||
+      !readString(it, end, record.src_path) ||
+      !readString(it, end, record.type) ||
+      !readString(it, end, record.name) ||
+      std::distance(it, end) < 3) {
+    return nullptr;
+  }
+  unsigned feature_class = *it++;
+  if (feature_class >
+      static_cast<unsigned>(FeatureClass::kLAST_FEATURE_CLASS)) {
+    return nullptr;
+  }
+  record.feature_class = static_cast<FeatureClass>(feature_class);
+
+  unsigned num_features = util::read16LE(it);
+  for (unsigned i = 0; i < num_features; ++i) {
+    if (std::distance(it, end) < 3) {
+      return nullptr;
+    }
+    unsigned feature_id = util::read16LE(it);
+    FeatureType feature_type = static_cast<FeatureType>(*it++);
+
+    std::string blob_str;
+    std::string name;
+    if (!readString(it, end, blob_str) || !readString(it, end, name)) {
+      return nullptr;
+    }
+    std::vector<uint8_t> blob(blob_str.begin(), blob_str.end());
+
+    switch (feature_type) {
+    case FeatureType::kBool:
+      if (blob.size() != sizeof(BoolFeature::value_type)) {
+        return nullptr;
+      }
+      record.features.add(BoolFeature::fromBlob(feature_id, blob, name));
+      break;
+    case FeatureType::kInt:
+      if (blob.size() != sizeof(IntFeature::value_type)) {
+        return nullptr;
+      }
+      record.features.add(IntFeature::fromBlob(feature_id, blob, name));
+      break;
+    default:
+      return nullptr;
+    }
+  }
+  if (it != end) {
+    return nullptr;
+  }
+  return record;
+}
+
+/// \brief Create a new spool file in a directory
+///
+/// The name of the file is derived from the host name, the process id and
+/// the time, and the file is created exclusively, so that no other process
+/// appends to it, even once the process id has been reused.
+///
+/// \param spool_dir  Directory holding the spool files
+/// \param spool_path  Set to the path of the created file
+///
+/// \return A descriptor for appending to the file, or -1 if it could not be
+/// created
+static int createSpoolFile(const std::string &spool_dir,
+                           std::string &spool_path) {
+  char host[HOST_NAME_MAX + 1];
+  if (gethostname(host, sizeof(host)) != 0) {
+    strcpy(host, "localhost");
+  }
+  host[HOST_NAME_MAX] = '\0';
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  std::string prefix =
+      spool_dir + "/" + host + "-" + std::to_string(getpid()) + "-" +
+      std::to_string(static_cast<uint64_t>(now.tv_sec) * 1000000000 +
+                     static_cast<uint64_t>(now.tv_nsec));
+
+  for (unsigned i = 0; i < spool_create_attempts; ++i) {
+    spool_path = prefix;
+    if (i != 0) {
+      spool_path += "-" + std::to_string(i);
+    }
+    spool_path += spool_extension;
+
+    int fd = open(spool_path.c_str(),
+                  O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+      return fd;
+    }
+    if (errno != EEXIST) {
+      MAGEEC_ERR("Could not create spool file '" << spool_path
+                 << "': " << strerror(errno));
+      return -1;
+    }
+  }
+  MAGEEC_ERR("Could not create a spool file in '" << spool_dir << "'");
+  return -1;
+}
+
+/// \brief Check that an open file is still at the path it was opened with
+///
+/// This is not the case once the file has been claimed for ingestion.
+static bool isAtPath(int fd, const std::string &path) {
+  struct stat fd_st;
+  struct stat path_st;
+  return fstat(fd, &fd_st) == 0 && stat(path.c_str(), &path_st) == 0 &&
+         fd_st.st_dev == path_st.st_dev && fd_st.st_ino == path_st.st_ino;
+}
+
+bool appendSpoolRecords(const std::string &spool_dir, std::string &spool_path,
+                        const std::vector<SpoolRecord> &records) {
+  std::vector<uint8_t> record_buf;
+  for (const auto &record : records) {
+    writeRecord(record_buf, record);
+  }
+
+  // Open the file last appended to, or create a new file if there is none
+  // or it has been claimed.
+  int fd = -1;
+  while (fd < 0) {
+    if (!spool_path.empty()) {
+      fd = open(spool_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+      if (fd < 0 && errno != ENOENT) {
+        MAGEEC_ERR("Could not open spool file '" << spool_path
+                   << "': " << strerror(errno));
+        return false;
+      }
+    }
+    if (fd < 0) {
+      fd = createSpoolFile(spool_dir, spool_path);
+      if (fd < 0) {
+        return false;
+      }
+    }
+    if (!lockFile(fd)) {
+      MAGEEC_ERR("Could not lock spool file '" << spool_path
+                 << "': " << strerror(errno));
+      close(fd);
+      return false;
+    }
+    if (!isAtPath(fd, spool_path)) {
+      close(fd);
+      fd = -1;
+      spool_path.clear();
+    }
+  }
+
+  // Only this process appends to the file, so if it is empty the header
+  // has not been written yet.
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    MAGEEC_ERR("Could not stat spool file '" << spool_path
+               << "': " << strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  std::vector<uint8_t> buf;
+  if (st.st_size == 0) {
+    buf.insert(buf.end(), std::begin(spool_magic), std::end(spool_magic));
+    util::write16LE(buf, spool_format_version);
+  }
+  buf.insert(buf.end(), record_buf.begin(), record_buf.end());
+
+  size_t written = 0;
+  while (written < buf.size()) {
+    ssize_t res = write(fd, buf.data() + written, buf.size() - written);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      MAGEEC_ERR("Could not write to spool file '" << spool_path
+                 << "': " << strerror(errno));
+      close(fd);
+      return false;
+    }
+    written += static_cast<size_t>(res);
+  }
+  if (close(fd) != 0) {
+    MAGEEC_ERR("Could not close spool file '" << spool_path
+               << "': " << strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+util::Option<std::string> claimSpoolFile(const std::string &spool_path) {
+  std::string claimed_path = spool_path;
+  if (!hasExtension(spool_path, claimed_extension)) {
+    claimed_path =
+        replaceExtension(spool_path, spool_extension, claimed_extension);
+    if (rename(spool_path.c_str(), claimed_path.c_str()) != 0) {
+      MAGEEC_WARN("Could not claim spool file '" << spool_path << "': "
+                  << strerror(errno));
+      return nullptr;
+    }
+  }
+
+  // A process may have opened the file before it was renamed. Once the lock
+  // has been taken any such append has completed, and any later append
+  // finds that the file has been renamed.
+  int fd = open(claimed_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    MAGEEC_WARN("Could not open claimed spool file '" << claimed_path
+                << "': " << strerror(errno));
+    return nullptr;
+  }
+  bool locked = lockFile(fd);
+  close(fd);
+  if (!locked) {
+    MAGEEC_WARN("Could not lock claimed spool file '" << claimed_path
+                << "': " << strerror(errno));
+    return nullptr;
+  }
+  return claimed_path;
+}
+
+bool setAsideSpoolFile(const std::string &spool_path) {
+  std::string bad_path =
+      replaceExtension(spool_path, claimed_extension, bad_extension);
+  if (rename(spool_path.c_str(), bad_path.c_str()) != 0) {
+    MAGEEC_WARN("Could not rename spool file '" << spool_path << "' to '"
+                << bad_path << "': " << strerror(errno));
+    return false;
+  }
+  MAGEEC_WARN("Spool file '" << spool_path << "' was not read to its end, "
+              "and has been kept as '" << bad_path << "'");
+  return true;
+}
+
+util::Option<std::vector<SpoolRecord>>
+readSpoolRecords(const std::string &spool_path, bool &complete) {
+  complete = false;
+  std::ifstream in(spool_path, std::ifstream::binary);
+  if (!in) {
+    MAGEEC_ERR("Could not open spool file '" << spool_path << "'");
+    return nullptr;
+  }
+  std::vector<uint8_t> buf((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  if (in.bad()) {
+    MAGEEC_ERR("Could not read spool file '" << spool_path << "'");
+    return nullptr;
+  }
+  if (buf.empty()) {
+    complete = true;
+    return std::vector<SpoolRecord>();
+  }
+
+  if (buf.size() < spool_header_size ||
+      !std::equal(std::begin(spool_magic), std::end(spool_magic),
+                  buf.cbegin())) {
+    MAGEEC_ERR("'" << spool_path << "' is not a spool file");
+    return nullptr;
+  }
+  auto it = buf.cbegin() + sizeof(spool_magic);
+  unsigned version = util::read16LE(it);
+  if (version != spool_format_version) {
+    MAGEEC_ERR("Spool file '" << spool_path << "' has unsupported format "
+               "version " << version);
+    return nullptr;
+  }
+
+  std::vector<SpoolRecord> records;
+  while (it != buf.cend()) {
+    if (static_cast<size_t>(std::distance(it, buf.cend())) <
+        spool_record_header_size) {
+      break;
+    }
+    uint32_t len = util::read32LE(it);
+    uint64_t crc = util::read64LE(it);
+    if (static_cast<size_t>(std::distance(it, buf.cend())) < len) {
+      break;
+    }
+    std::vector<uint8_t> payload(it, it + len);
+    it += len;
+
+    util::Option<SpoolRecord> record;
+    if (util::crc64(payload.data(), len) == crc) {
+      record = readRecord(payload);
+    }
+    if (!record) {
+      break;
+    }
+    records.push_back(record.get());
+  }
+  complete = it == buf.cend();
+  if (!complete) {
+    MAGEEC_WARN("Spool file '" << spool_path << "' has an incomplete or "
+                "corrupt record, " << records.size() << " records before it "
+                "were read");
+  }
+  return records;
+}
+
+util::Option<std::vector<std::string>>
+findSpoolFiles(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    MAGEEC_ERR("Could not access '" << path << "': " << strerror(errno));
+    return nullptr;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return std::vector<std::string>({path});
+  }
+
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    MAGEEC_ERR("Could not open directory '" << path << "': "
+               << strerror(errno));
+    return nullptr;
+  }
+  std::vector<std::string> spool_paths;
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (hasExtension(name, spool_extension)) {
+      spool_paths.push_back(path + "/" + name);
+    }
+  }
+  closedir(dir);
+
+  std::sort(spool_paths.begin(), spool_paths.end());
+  return spool_paths;
+}
+
+} // end of namespace mageec
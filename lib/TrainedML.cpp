@@ -39,7 +39,7 @@
 namespace mageec {
 
 TrainedML::TrainedML(IMachineLearner &ml)
-    : m_ml(ml), m_feature_class(), m_metric(), m_blob() {
+    : m_ml(ml), m_feature_class(), m_metric(), m_blob(), m_model() {
   assert(!ml.requiresTraining() &&
          "Machine learner requires training, so it must be initialized with "
          "a metric and blob");
@@ -48,7 +48,8 @@ TrainedML::TrainedML(IMachineLearner &ml)
 TrainedML::TrainedML(IMachineLearner &ml, FeatureClass feature_class,
                      std::string metric,
                      const std::vector<uint8_t> blob)
-    : m_ml(ml), m_feature_class(feature_class), m_metric(metric), m_blob(blob) {
+    : m_ml(ml), m_feature_class(feature_class), m_metric(metric), m_blob(blob),
+      m_model() {
   assert(ml.requiresTraining() && "Machine learner does not require training, "
                                   "where did the metric and blob come from?");
 }
@@ -79,7 +80,22 @@ bool TrainedML::setDecisionConfig(std::string config_path) {
 std::unique_ptr<DecisionBase>
 TrainedML::makeDecision(const DecisionRequestBase &request,
                         const FeatureSet &features) {
-  return m_ml.makeDecision(request, features, m_blob);
+  return m_ml.makeDecision(request, features, getModel());
+}
+
+std::vector<std::unique_ptr<DecisionBase>> TrainedML::makeDecisions(
+    const std::vector<std::unique_ptr<DecisionRequestBase>> &requests,
+    const FeatureSet &features) {
+  return m_ml.makeDecisions(requests, features, getModel());
+}
+
+const IModel &TrainedML::getModel(void) {
+  if (!m_model) {
+    MAGEEC_DEBUG("Loading model for machine learner '" << getName() << "'");
+    m_model = m_ml.loadModel(m_blob);
+    assert(m_model && "Machine learner failed to load a model");
+  }
+  return *m_model;
 }
 
 void TrainedML::print(std::ostream &os) const {
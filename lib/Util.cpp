@@ -23,9 +23,12 @@
 
 #include "mageec/Util.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 namespace mageec {
@@ -64,6 +67,23 @@ void write16LE(std::vector<uint8_t> &buf, unsigned value) {
   buf.push_back(static_cast<uint8_t>(value >> 8));
 }
 
+uint32_t read32LE(std::vector<uint8_t>::const_iterator &it) {
+  uint32_t res = 0;
+  res |= static_cast<uint32_t>(*it);
+  res |= static_cast<uint32_t>(*(it + 1)) << 8;
+  res |= static_cast<uint32_t>(*(it + 2)) << 16;
+  res |= static_cast<uint32_t>(*(it + 3)) << 24;
+  it += 4;
+  return res;
+}
+
+void write32LE(std::vector<uint8_t> &buf, uint32_t value) {
+  buf.push_back(static_cast<uint8_t>(value));
+  buf.push_back(static_cast<uint8_t>(value >> 8));
+  buf.push_back(static_cast<uint8_t>(value >> 16));
+  buf.push_back(static_cast<uint8_t>(value >> 24));
+}
+
 uint64_t read64LE(std::vector<uint8_t>::const_iterator &it) {
   uint64_t res = 0;
   res |= static_cast<uint64_t>(*it);
@@ -89,28 +109,172 @@ void write64LE(std::vector<uint8_t> &buf, uint64_t value) {
   buf.push_back(static_cast<uint8_t>(value >> 56));
 }
 
-// Based on crc32b from Hacker's Delight
+/// Reflected form of the ECMA-182 polynomial used by crc64
+static const uint64_t crc64_poly = 0xC96C5795D7870F42ULL;
+
+/// \brief Lookup tables for slicing-by-8 crc64
+///
+/// Entry [0][n] is the crc of the byte n. Entry [k][n] is the crc of the
+/// byte n followed by k zero bytes, so that eight bytes of a message can be
+/// folded into the crc with eight independent lookups.
+struct CRC64Tables {
+  uint64_t table[8][256];
+
+  CRC64Tables() {
+    for (unsigned n = 0; n < 256; ++n) {
+      uint64_t crc = n;
+      for (unsigned j = 0; j < 8; ++j) {
+        crc = (crc >> 1) ^ (crc64_poly & -(crc & 1));
+      }
+      table[0][n] = crc;
+    }
+    for (unsigned n = 0; n < 256; ++n) {
+      for (unsigned k = 1; k < 8; ++k) {
+        uint64_t prev = table[k - 1][n];
+        table[k][n] = (prev >> 8) ^ table[0][prev & 0xFF];
+      }
+    }
+  }
+};
+
+// Originally based on crc32b from Hacker's Delight
 // (http://www.hackersdelight.org/hdcodetxt/crc.c.txt)
 // Expanded to support crc64 and nulls by Simon Cook
-uint64_t crc64(uint8_t *message, unsigned len) {
-  unsigned i;
-  int j;
-  uint64_t byte, crc, mask;
-
-  i = 0;
-  crc = 0xFFFFFFFFFFFFFFFFULL;
-  while (i < len) {
-    byte = message[i]; // Get next byte.
-    crc = crc ^ byte;
-    for (j = 7; j >= 0; j--) { // Do eight times.
-      mask = -(crc & 1);
-      crc = (crc >> 1) ^ (0xC96C5795D7870F42ULL & mask);
-    }
-    i = i + 1;
+//
+// This processes eight bytes of the message per step using the
+// slicing-by-8 tables, rather than a bit at a time, and produces the same
+// result as the original bitwise implementation.
+uint64_t crc64(const uint8_t *message, unsigned len) {
+  return crc64Update(0, message, len);
+}
+
+uint64_t crc64Update(uint64_t crc, const uint8_t *message, unsigned len) {
+  static const CRC64Tables tables;
+  const uint64_t (&t)[8][256] = tables.table;
+
+  // The result is inverted, so invert it back to continue the calculation
+  crc = ~crc;
+  unsigned i = 0;
+  for (; i + 8 <= len; i += 8) {
+    const uint8_t *p = message + i;
+    uint64_t word = static_cast<uint64_t>(p[0]) |
+                    (static_cast<uint64_t>(p[1]) << 8) |
+                    (static_cast<uint64_t>(p[2]) << 16) |
+                    (static_cast<uint64_t>(p[3]) << 24) |
+                    (static_cast<uint64_t>(p[4]) << 32) |
+                    (static_cast<uint64_t>(p[5]) << 40) |
+                    (static_cast<uint64_t>(p[6]) << 48) |
+                    (static_cast<uint64_t>(p[7]) << 56);
+    crc ^= word;
+    crc = t[7][crc & 0xFF] ^ t[6][(crc >> 8) & 0xFF] ^
+          t[5][(crc >> 16) & 0xFF] ^ t[4][(crc >> 24) & 0xFF] ^
+          t[3][(crc >> 32) & 0xFF] ^ t[2][(crc >> 40) & 0xFF] ^
+          t[1][(crc >> 48) & 0xFF] ^ t[0][crc >> 56];
+  }
+  for (; i < len; ++i) {
+    crc = (crc >> 8) ^ t[0][(crc ^ message[i]) & 0xFF];
   }
   return ~crc;
 }
 
+/// Round constants of SHA-256
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t rotr32(uint32_t x, unsigned n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+/// \brief Process a single 64 byte block of a message
+static void sha256Block(uint32_t state[8], const uint8_t *block) {
+  uint32_t w[64];
+  for (unsigned i = 0; i < 16; ++i) {
+    w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) |
+           (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+           (static_cast<uint32_t>(block[i * 4 + 2]) << 8) |
+           static_cast<uint32_t>(block[i * 4 + 3]);
+  }
+  for (unsigned i = 16; i < 64; ++i) {
+    uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^
+                  (w[i - 15] >> 3);
+    uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^
+                  (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (unsigned i = 0; i < 64; ++i) {
+    uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+    uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = s0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+std::array<uint8_t, 32> sha256(const uint8_t *message, size_t len) {
+  uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    sha256Block(state, message + i);
+  }
+
+  // Pad the tail of the message with a single set bit, then zeroes, then
+  // the length of the message in bits. This spills into a second block if
+  // the length does not fit after the tail.
+  uint8_t tail[128] = {0};
+  size_t tail_len = len - i;
+  std::copy(message + i, message + len, tail);
+  tail[tail_len] = 0x80;
+  size_t n_tail_blocks = tail_len + 9 <= 64 ? 1 : 2;
+  uint64_t bit_len = static_cast<uint64_t>(len) * 8;
+  for (unsigned j = 0; j < 8; ++j) {
+    tail[n_tail_blocks * 64 - 1 - j] = static_cast<uint8_t>(bit_len >> (j * 8));
+  }
+  for (size_t j = 0; j < n_tail_blocks; ++j) {
+    sha256Block(state, tail + j * 64);
+  }
+
+  std::array<uint8_t, 32> digest;
+  for (unsigned j = 0; j < 8; ++j) {
+    digest[j * 4] = static_cast<uint8_t>(state[j] >> 24);
+    digest[j * 4 + 1] = static_cast<uint8_t>(state[j] >> 16);
+    digest[j * 4 + 2] = static_cast<uint8_t>(state[j] >> 8);
+    digest[j * 4 + 3] = static_cast<uint8_t>(state[j]);
+  }
+  return digest;
+}
+
 #ifdef __unix__
   extern "C" {
     #include <linux/limits.h>
@@ -134,5 +298,37 @@ std::string getBaseName(std::string filename) {
   return res;
 }
 
+void parallelFor(unsigned count, unsigned jobs,
+                 const std::function<void(unsigned)> &fn) {
+  if (jobs == 0) {
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  jobs = std::min(jobs, count);
+  if (jobs <= 1) {
+    for (unsigned i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  // Each worker repeatedly claims the next unprocessed index. The calling
+  // thread acts as one of the workers.
+  std::atomic<unsigned> next(0);
+  auto worker = [&]() {
+    for (unsigned i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(jobs - 1);
+  for (unsigned i = 1; i < jobs; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
 } // end of namespace util
 } // end of namespace mageec
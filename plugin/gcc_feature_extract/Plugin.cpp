@@ -33,6 +33,7 @@
 #include <fstream>
 #include <map>
 #include <string>
+#include <vector>
 
 // GCC Plugin headers                                                           
 // Undefine these as gcc-plugin.h redefines them                                
@@ -120,6 +121,11 @@ static void printHelp()
 "  -sql-trace           Enable tracing of SQL queries in the framework\n"
 "  -database=<arg>      Database to be used to store extracted features\n"
 "  -database-version    Print the version of the provided database\n"
+"  -wal                 Use a write-ahead log for the database, so that many\n"
+"                       compiler processes can record to it at once\n"
+"  -spool=<arg>         Directory to append extracted features to, instead\n"
+"                       of a database. The features are added to the\n"
+"                       database later by 'mageec foo.db --ingest <arg>'\n"
 "  -out=<arg>           The output file records identifiers of feature sets\n"
 "                       in the database for each element of the program\n"
 "\n"
@@ -128,7 +134,10 @@ static void printHelp()
 "      -fplugin-libfeature_extract_gcc-help foo.c\n"
 "\n"
 "  gcc -fplugin=libfeature_extract_gcc.so\n"
-"      -fplugin-libfeature_extract_gcc-database=foo.db\n";
+"      -fplugin-libfeature_extract_gcc-database=foo.db\n"
+"\n"
+"  gcc -fplugin=libfeature_extract_gcc.so\n"
+"      -fplugin-libfeature_extract_gcc-spool=spool_dir\n";
 }
 
 
@@ -187,6 +196,7 @@ static bool parseArguments(struct plugin_name_args *plugin_info,
   struct plugin_argument *argv = plugin_info->argv;
 
   std::string db_str;
+  std::string spool_str;
   std::string outfile_str;
 
   // Simple flags
@@ -197,9 +207,11 @@ static bool parseArguments(struct plugin_name_args *plugin_info,
   bool with_debug               = false;
   bool with_sql_trace           = false;
   bool with_db_version          = false;
+  bool with_wal                 = false;
 
   // Flags with arguments
   bool with_db       = false;
+  bool with_spool    = false;
   bool with_outfile  = false;
 
   for (int i = 0; i < argc; ++i) {
@@ -248,6 +260,12 @@ static bool parseArguments(struct plugin_name_args *plugin_info,
         return false;
       }
       with_db_version = true;
+    } else if (arg_str == "wal") {
+      if (argv[i].value) {
+        MAGEEC_ERR("Plugin argument 'wal' does not take a value");
+        return false;
+      }
+      with_wal = true;
     }
 
     // Flags with arguments
@@ -262,6 +280,17 @@ static bool parseArguments(struct plugin_name_args *plugin_info,
       }
       db_str = std::string(argv[i].value);
       with_db = true;
+    } else if (arg_str == "spool") {
+      if (with_spool) {
+        MAGEEC_ERR("Plugin argument 'spool' already seen");
+        return false;
+      }
+      if (!argv[i].value) {
+        MAGEEC_ERR("No value provided to 'spool' argument");
+        return false;
+      }
+      spool_str = std::string(argv[i].value);
+      with_spool = true;
     } else if (arg_str == "out") {
       if (with_outfile) {
         MAGEEC_ERR("Plugin argument 'out' already seen");
@@ -299,9 +328,14 @@ static bool parseArguments(struct plugin_name_args *plugin_info,
     printFrameworkVersion(getContext().getFramework());
 
   // Errors
-  if (!with_db) {
-    MAGEEC_ERR("Cannot feature extract without a database to save features "
-               "to");
+  if (!with_db && !with_spool) {
+    MAGEEC_ERR("Cannot feature extract without a database or spool to save "
+               "features to");
+    return false;
+  }
+  if (with_db && with_spool) {
+    MAGEEC_ERR("Plugin arguments 'database' and 'spool' cannot be used "
+               "together");
     return false;
   }
   if (!with_outfile) {
@@ -310,9 +344,21 @@ static bool parseArguments(struct plugin_name_args *plugin_info,
     return false;
   }
 
+  // When spooling the database is never accessed
+  if (with_spool) {
+    if (with_db_version)
+      MAGEEC_WARN("Plugin argument 'database-version' ignored when spooling");
+    if (with_wal)
+      MAGEEC_WARN("Plugin argument 'wal' ignored when spooling");
+
+    getContext().setSpoolDir(spool_str);
+    getContext().openOutFile(outfile_str);
+    return true;
+  }
+
   // Now we know whether a database is required we can load it.
   assert(db_str != "");
-  getContext().loadDatabase(db_str);
+  getContext().loadDatabase(db_str, with_wal);
 
   // Print the database version now that it is loaded
   if (with_db_version)
@@ -463,6 +509,34 @@ void featureExtractStartUnit(void *, void *) {
   getContext().getFunctionFeatures().clear();
 }
 
+/// \brief Append the features of the unit to the spool file
+///
+/// The identifiers of the feature sets are emitted to the output file when
+/// the spool is ingested into the database.
+static void spoolFeatures(const std::string &src_filename,
+                          const std::string &module_name,
+                          const mageec::FeatureSet &module_feature_set) {
+  std::vector<mageec::SpoolRecord> records;
+  records.push_back({getContext().getOutFilePath(), src_filename, "module",
+                     module_name, mageec::FeatureClass::kModule,
+                     module_feature_set});
+
+  // Functions also inherit features from their encapsulating module
+  for (auto &features : getContext().getFunctionFeatures()) {
+    std::unique_ptr<mageec::FeatureSet> func_feature_set =
+        convertFunctionFeatures(*features.second.get());
+
+    records.push_back({getContext().getOutFilePath(), src_filename,
+                       "function", features.first,
+                       mageec::FeatureClass::kFunction, *func_feature_set});
+  }
+
+  if (!mageec::appendSpoolRecords(getContext().getSpoolDir(),
+                                  getContext().getSpoolPath(), records)) {
+    MAGEEC_ERR("Failed to spool features for '" << src_filename << "'");
+  }
+}
+
 void featureExtractFinishUnit(void *, void *) {
   std::vector<const FunctionFeatures *> func_features;
   for (auto &features : getContext().getFunctionFeatures())
@@ -480,8 +554,16 @@ void featureExtractFinishUnit(void *, void *) {
   std::unique_ptr<mageec::FeatureSet> module_feature_set =
       convertModuleFeatures(*module_features);
 
+  if (getContext().withSpool()) {
+    spoolFeatures(src_filename, module_name, *module_feature_set);
+    return;
+  }
+
+  // Add all of the feature sets of the unit in one transaction
+  mageec::Database::BulkWriter writer(getContext().getDatabase(), 0);
+
   mageec::FeatureSetID module_feature_set_id =
-      getContext().getDatabase().newFeatureSet(*module_feature_set);
+      writer.addFeatureSet(*module_feature_set);
 
   getContext().getOutFile() << src_filename << ",module,"
                             << module_name << ",features,"
@@ -496,7 +578,7 @@ void featureExtractFinishUnit(void *, void *) {
         convertFunctionFeatures(*features.second.get());
 
     mageec::FeatureSetID func_feature_set_id =
-        getContext().getDatabase().newFeatureSet(*func_feature_set);
+        writer.addFeatureSet(*func_feature_set);
 
     getContext().getOutFile() << src_filename << ",function,"
                               << features.first << ",features,"
@@ -30,6 +30,7 @@
 #include "mageec/AttributeSet.h"
 #include "mageec/Framework.h"
 #include "mageec/Database.h"
+#include "mageec/Spool.h"
 #include "mageec/Util.h"
 
 #include <fstream>
@@ -56,11 +57,17 @@ static_assert(GCC_FEATURE_EXTRACT_PLUGIN_VERSION_MAJOR == 2 &&
 /// This holds handles to the framework and database, as well as
 /// the features for each of the functions in the current modules. It also
 /// holds a handle to the output file into which the FeatureIDs are
-/// emitted once the features have been extracted
+/// emitted once the features have been extracted.
+///
+/// When spooling, there is no database. Instead the features are appended
+/// to a spool file, and the FeatureIDs are emitted when the spool is
+/// ingested into the database.
 class FeatureExtractContext {
 public:
   FeatureExtractContext()
-      : m_framework(), m_db(), m_outfile(), m_func_features()
+      : m_framework(), m_db(), m_spool_dir(), m_spool_path(), m_outfile(),
+        m_outfile_path(),
+        m_func_features()
   {}
 
   FeatureExtractContext(const FeatureExtractContext &) = delete;
@@ -80,19 +87,40 @@ public:
     return *m_framework;
   }
 
-  void loadDatabase(std::string db_path) {
+  void loadDatabase(std::string db_path, bool with_wal) {
     assert(db_path != "");
     assert(m_framework);
-    m_db = m_framework->getDatabase(db_path, false);
+    mageec::DatabaseOptions options;
+    options.with_wal = with_wal;
+    m_db = m_framework->getDatabase(db_path, false, options);
   }
   mageec::Database& getDatabase() {
     assert(m_db);
     return *m_db;
   }
 
+  void setSpoolDir(std::string spool_dir) {
+    assert(spool_dir != "");
+    m_spool_dir = spool_dir;
+  }
+  bool withSpool(void) const { return m_spool_dir != ""; }
+  const std::string& getSpoolDir(void) const {
+    assert(withSpool());
+    return m_spool_dir;
+  }
+  std::string& getSpoolPath(void) {
+    assert(withSpool());
+    return m_spool_path;
+  }
+
   void openOutFile(std::string file) {
     assert(file != "");
     m_outfile.reset(new std::ofstream(file, std::ofstream::app));
+    m_outfile_path = mageec::util::getFullPath(file);
+  }
+  const std::string& getOutFilePath(void) const {
+    assert(m_outfile);
+    return m_outfile_path;
   }
   std::ofstream& getOutFile(void) {
     assert(m_outfile);
@@ -111,9 +139,20 @@ private:
   /// Handle to the database
   std::unique_ptr<mageec::Database>  m_db;
 
+  /// Directory of spool files which features are appended to, instead of
+  /// the database
+  std::string m_spool_dir;
+
+  /// Spool file which features were last appended to, or empty if none has
+  /// been created yet
+  std::string m_spool_path;
+
   /// Output files which FeatureSetIDs will be emitted into
   std::unique_ptr<std::ofstream> m_outfile;
 
+  /// Full path of the output file, recorded in spooled features
+  std::string m_outfile_path;
+
   /// Extracted features for each function in the module, keyed on the
   /// name of the function
   std::map<std::string, std::unique_ptr<FunctionFeatures>> m_func_features;
@@ -1,11 +1,18 @@
 #include "mageec/Attribute.h"
 #include "mageec/Database.h"
+#include "mageec/DecisionServer.h"
 #include "mageec/Framework.h"
 #include "mageec/ML/C5.h"
 #include "mageec/ML/1NN.h"
+#include "mageec/ML/KNN.h"
 #include "mageec/Util.h"
+#include "FeaturesIndex.h"
+#include "Jobs.h"
+#include "Process.h"
 #include "Parameters.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <map>
@@ -13,6 +20,7 @@
 #include <set>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #if !defined(GCC_DRIVER_VERSION_MAJOR) ||                                      \
@@ -987,23 +995,6 @@ struct ParameterToFlag {
 static const std::map<unsigned, std::string> &parameter_to_flag =
     *new ParameterToFlag();
 
-/// \brief Split a string into substrings on an input character
-static std::vector<std::string> splitString(std::string str, char c) {
-  std::vector<std::string> res;
-
-  std::string buf;
-  for (auto I = str.begin(); I != str.end(); ++I) {
-    if (*I != c) {
-      buf.push_back(*I);
-    } else {
-      res.push_back(buf);
-      buf.clear();
-    }
-  }
-  res.push_back(buf);
-  return res;
-}
-
 /// \brief Print the version of this driver
 static void printVersion() {
   mageec::util::out() << MAGEEC_PREFIX "Driver version: "
@@ -1032,99 +1023,6 @@ static void printFrameworkVersion(mageec::Framework &framework) {
 }
 
 
-struct FeatureIDEntry {
-  std::string            name;
-  mageec::FeatureSetID   id;
-  mageec::FeatureClass   feature_class;
-
-  bool operator<(const FeatureIDEntry &other) const {
-    if (name < other.name)
-      return true;
-    return false;
-  }
-};
-
-struct FileFeatureIDs {
-  mageec::util::Option<FeatureIDEntry> module;
-  std::set<FeatureIDEntry>             functions;
-};
-
-/// \brief Load feature IDs from an input file
-static mageec::util::Option<std::map<std::string, FileFeatureIDs>>
-loadFeatureIDs(std::string features_path) {
-  std::map<std::string, FileFeatureIDs> file_to_features;
-
-  std::ifstream features_file(features_path);
-  if (!features_file.is_open()) {
-    MAGEEC_ERR("Error opening features file. The file may not exist, or you "
-               "may not have sufficient permissions to read and write it");
-    return nullptr;
-  }
-
-  std::string line;
-  while (std::getline(features_file, line)) {
-    std::vector<std::string> values = splitString(line, ',');
-    if (values.size() != 7)
-      continue;
-    if ((values[1] != "module") && (values[1] != "function"))
-      continue;
-    if (values[3] != "features")
-      continue;
-    if (values[5] != "feature_class")
-      continue;
-    if (!values[0].size() || !values[2].size() || !values[4].size() ||
-        !values[6].size()) {
-      continue;
-    }
-
-    std::stringstream feat_id_str(values[4]);
-    uint64_t feat_id;
-    feat_id_str >> feat_id;
-    if (feat_id_str.fail()) {
-      MAGEEC_ERR("Malformed line in features file");
-      return nullptr;
-    }
-
-    std::stringstream feat_class_str(values[6]);
-    unsigned feat_class;
-    feat_class_str >> feat_class;
-    if (feat_class_str.fail()) {
-      MAGEEC_ERR("Malformed line in features file");
-      return nullptr;
-    }
-
-    // Entry to be inserted into the map
-    FeatureIDEntry entry = { values[2],
-                             static_cast<mageec::FeatureSetID>(feat_id),
-                             static_cast<mageec::FeatureClass>(feat_class) };
-
-    FileFeatureIDs &file_entry = file_to_features[values[0]];
-    if (values[1] == "module") {
-      if (file_entry.module) {
-        FeatureIDEntry old_entry = file_entry.module.get();
-        if (old_entry.id != entry.id
-            || old_entry.feature_class != entry.feature_class) {
-          MAGEEC_WARN("Multiple entries for module: " << entry.name
-                      << " with different feature sets");
-        }
-      }
-      file_entry.module = entry;
-    } else {
-      assert(values[1] == "function");
-      if (file_entry.functions.count(entry)) {
-        FeatureIDEntry old_entry = *file_entry.functions.find(entry);
-        if (old_entry.id != entry.id
-            || old_entry.feature_class != entry.feature_class) {
-          MAGEEC_WARN("Multiple entries for function: " << entry.name
-                      << " with different feature sets");
-        }
-      }
-      file_entry.functions.insert(entry);
-    }
-  }
-  return file_to_features;
-}
-
 /// \brief Print help output string
 static void printHelp() {
   mageec::util::out() <<
@@ -1144,7 +1042,14 @@ static void printHelp() {
 "  -fmageec-out=<file>         File to output compilation ids into\n"
 "  -fmageec-ml=<id>            string identifier or shared object identifying\n"
 "                              the machine learner to be used\n"
-"  -fmageec-metric=<name>      Metric to optimize for\n";
+"  -fmageec-metric=<name>      Metric to optimize for\n"
+"  -fmageec-server=<socket>    Request decisions from a server started with\n"
+"                              'mageec <database> --serve <socket>', rather\n"
+"                              than loading the machine learner\n"
+"  -fmageec-jobs=<n>           Number of input files to compile concurrently,\n"
+"                              or 0 to use one per hardware thread. When run\n"
+"                              from make, this is further limited by the job\n"
+"                              slots available from make\n";
 }
 
 /// \brief Entry point for the GCC wrapper driver
@@ -1163,6 +1068,10 @@ int main(int argc, const char *argv[]) {
   std::string ml_str;
   // The metric to use when optimizing
   std::string metric_str;
+  // Number of input files to compile concurrently
+  unsigned compile_jobs = 1;
+  // Socket of the server to request decisions from
+  std::string server_path;
 
   bool with_help              = false;
   bool with_version           = false;
@@ -1175,6 +1084,7 @@ int main(int argc, const char *argv[]) {
   bool with_out               = false;
   bool with_ml                = false;
   bool with_metric            = false;
+  bool with_server            = false;
 
   // Handle arguments controlling mageec, accumulate the arguments which
   // aren't controlling this driver
@@ -1253,6 +1163,25 @@ int main(int argc, const char *argv[]) {
         return -1;
       }
       with_metric = true;
+    } else if (arg.compare(0, strlen("server="), "server=") == 0) {
+      server_path = std::string(arg.begin() + strlen("server="), arg.end());
+      if (server_path.size() == 0) {
+        MAGEEC_ERR("No server socket provided");
+        return -1;
+      }
+      with_server = true;
+    } else if (arg.compare(0, strlen("jobs="), "jobs=") == 0) {
+      std::string jobs_str(arg.begin() + strlen("jobs="), arg.end());
+      char *end;
+      unsigned long jobs = std::strtoul(jobs_str.c_str(), &end, 10);
+      if (jobs_str.size() == 0 || *end != '\0' || jobs > 1024) {
+        MAGEEC_ERR("Invalid jobs value: '" << jobs_str << "'");
+        return -1;
+      }
+      compile_jobs = static_cast<unsigned>(jobs);
+      if (compile_jobs == 0) {
+        compile_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+      }
     } else {
       MAGEEC_ERR("Unknown argument -fmageec-" << arg);
       return -1;
@@ -1305,6 +1234,8 @@ int main(int argc, const char *argv[]) {
       MAGEEC_WARN("-fmageec-ml argument will be ignored");
     if (with_metric)
       MAGEEC_WARN("-fmageec-metric argument will be ignored");
+    if (with_server)
+      MAGEEC_WARN("-fmageec-server argument will be ignored");
   }
 
   // Initialize the framework, and register some builtin machine learners so
@@ -1320,6 +1251,10 @@ int main(int argc, const char *argv[]) {
   std::unique_ptr<mageec::IMachineLearner> nn_ml(new mageec::OneNN());
   framework.registerMachineLearner(std::move(nn_ml));
 
+  MAGEEC_DEBUG("Registering k-NN machine learner interface");
+  std::unique_ptr<mageec::IMachineLearner> knn_ml(new mageec::KNN());
+  framework.registerMachineLearner(std::move(knn_ml));
+
   // Select the machine learner chosen by the user. This may be the name of
   // an already register machine learner, or a path to a shared object which
   // needs to be loaded and registered.
@@ -1404,23 +1339,15 @@ int main(int argc, const char *argv[]) {
   // If we are not in 'gather' or 'optimize' modes, or if we're not compiling
   // to an object file, then just run the original command
   if (!to_obj || (mode == DriverMode::kNone)) {
-    std::stringstream command;
-    for (unsigned i = 0; i < cmd_args.size(); ++i) {
-      if (i == 0) {
-        command << cmd_args[i];
-      } else {
-        command << " " << cmd_args[i];
-      }
-    }
     if (!to_obj && with_debug) {
       MAGEEC_WARN("MAGEEC driver called, but not compiling to an object file, "
                   "calling the original command");
     }
     if (with_debug) {
-      MAGEEC_DEBUG("Executing command: " + command.str());
+      MAGEEC_DEBUG("Executing command: " + joinCommand(cmd_args));
     }
     // FIXME: Windows?
-    return system(command.str().c_str());
+    return runProcess(cmd_args);
   }
 
   // Names of all of the input files involved in the compilation
@@ -1491,8 +1418,8 @@ int main(int argc, const char *argv[]) {
     return -1;
   }
 
-  // Load the features file to get the feature groups
-  auto feature_groups = loadFeatureIDs(features_path);
+  // Load the index of the features file to get the feature groups
+  auto feature_groups = FeaturesIndex::open(features_path);
   if (!feature_groups) {
     MAGEEC_ERR("Failed to retrieve feature groups from features file");
     return -1;
@@ -1573,9 +1500,20 @@ int main(int argc, const char *argv[]) {
     stripped_cmd_args.push_back(arg);
   }
 
-  auto src_file_feature_set_ids = feature_groups.get();
+  // Only the feature groups of the files being compiled are needed, so look
+  // them up rather than loading the whole features file.
+  std::map<std::string, FileFeatureIDs> src_file_feature_set_ids;
+  for (auto file_arg : src_files) {
+    auto src_file_path = mageec::util::getFullPath(file_arg);
+    auto file_ids = feature_groups->lookup(src_file_path);
+    if (file_ids) {
+      src_file_feature_set_ids[src_file_path] = file_ids.get();
+    }
+  }
   std::map<std::string, std::set<unsigned>> src_file_parameters;
-  std::map<std::string, mageec::ParameterSetID> src_file_parameter_set_ids;
+  // The parameter sets are only added to the database once the files have
+  // compiled successfully, along with their compilations.
+  std::map<std::string, mageec::ParameterSet> src_file_parameter_sets;
 
   if (mode == DriverMode::kGather) {
     // When in 'gather' mode, the parameters used for each file are based on
@@ -1588,42 +1526,51 @@ int main(int argc, const char *argv[]) {
                                                             orig_params.count(i),
                                                             param_flag));
     }
-    // Add the set of parameters to the database
-    auto param_set_id = db->newParameterSet(param_set);
-
     // Use the same parameters for every input file
     for (auto file_arg : src_files) {
       auto src_file_path = mageec::util::getFullPath(file_arg);
       src_file_parameters[src_file_path] = orig_params;
-      src_file_parameter_set_ids[src_file_path] = param_set_id;
+      src_file_parameter_sets[src_file_path] = param_set;
     }
   } else {
     // When in 'optimize' mode, the parameters used for each file are based on
     // flags generated from the features
     assert(mode == DriverMode::kOptimize);
 
+    // If a decision server was provided, then decisions are requested from
+    // it, and the machine learner is only loaded here if the server cannot
+    // be reached.
+    bool use_server = with_server;
+
     // Find the selected machine learner trained for the specified metric
-    auto trained_mls = db->getTrainedMachineLearners();
+    std::vector<mageec::TrainedML> trained_mls;
     mageec::TrainedML *chosen_ml = nullptr;
-
-    bool found_ml = false;
-    for (auto &trained_ml : trained_mls) {
-      if (trained_ml.getName() == ml->getName()) {
-        found_ml = true;
-
-        // Check that the found machine learner is trained for the desired
-        // metric and class of features.
-        // TODO: Only module features can be handled here
-        if (trained_ml.getMetric() == metric_str &&
-            trained_ml.getFeatureClass() == mageec::FeatureClass::kModule) {
-          chosen_ml = &trained_ml;
-          break;
+    auto loadTrainedML = [&]() {
+      trained_mls = db->getTrainedMachineLearners();
+
+      bool found_ml = false;
+      for (auto &trained_ml : trained_mls) {
+        if (trained_ml.getName() == ml->getName()) {
+          found_ml = true;
+
+          // Check that the found machine learner is trained for the desired
+          // metric and class of features.
+          // TODO: Only module features can be handled here
+          if (trained_ml.getMetric() == metric_str &&
+              trained_ml.getFeatureClass() == mageec::FeatureClass::kModule) {
+            chosen_ml = &trained_ml;
+            break;
+          }
         }
       }
-    }
-    if (!found_ml) {
-      MAGEEC_ERR("Could not find training data for specified machine learner "
-                 "and metric");
+      if (!found_ml) {
+        MAGEEC_ERR("Could not find training data for specified machine "
+                   "learner and metric");
+        return false;
+      }
+      return true;
+    };
+    if (!use_server && !loadTrainedML()) {
       return -1;
     }
 
@@ -1646,17 +1593,53 @@ int main(int argc, const char *argv[]) {
       // mageec then this will form the 'native' decision
       assert(feature_set_ids->second.module);
       auto feature_set_id = feature_set_ids->second.module.get().id;
-      auto features = db->getFeatureSetFeatures(feature_set_id);
-      assert(features.size() != 0);
 
-      std::set<unsigned> params;
-      mageec::ParameterSet param_set;
+      // Request decisions for every flag at once, so that the machine learner
+      // only needs to process the features a single time.
+      std::vector<std::unique_ptr<mageec::DecisionRequestBase>> requests;
       for (unsigned i = FlagParameterID::kFIRST_FLAG_PARAMETER;
            i <= FlagParameterID::kLAST_FLAG_PARAMETER; ++i) {
+        requests.emplace_back(new mageec::BoolDecisionRequest(i));
+      }
+
+      std::vector<std::unique_ptr<mageec::DecisionBase>> decisions;
+      if (use_server) {
+        auto status = mageec::requestDecisions(
+            server_path, ml->getName(), metric_str,
+            mageec::FeatureClass::kModule, feature_set_id, requests,
+            decisions);
+        if (status == mageec::DecisionStatus::kNoServer) {
+          MAGEEC_WARN("Could not get decisions from server '" << server_path
+                      << "', loading the machine learner instead");
+          use_server = false;
+          if (!loadTrainedML()) {
+            return -1;
+          }
+        } else if (status ==
+                   mageec::DecisionStatus::kUnknownMachineLearner) {
+          MAGEEC_ERR("Could not find training data for specified machine "
+                     "learner and metric");
+          return -1;
+        } else if (status != mageec::DecisionStatus::kSuccess) {
+          MAGEEC_ERR("Decision server could not make decisions for feature "
+                     "set " << static_cast<uint64_t>(feature_set_id));
+          return -1;
+        }
+      }
+      if (!use_server) {
+        auto features = db->getFeatureSetFeatures(feature_set_id);
+        assert(features.size() != 0);
         assert(chosen_ml);
+        decisions = chosen_ml->makeDecisions(requests, features);
+      }
+      assert(decisions.size() == requests.size());
 
-        mageec::BoolDecisionRequest req(i);
-        auto res = chosen_ml->makeDecision(req, features);
+      std::set<unsigned> params;
+      mageec::ParameterSet param_set;
+      for (unsigned i = FlagParameterID::kFIRST_FLAG_PARAMETER;
+           i <= FlagParameterID::kLAST_FLAG_PARAMETER; ++i) {
+        const auto &res =
+            decisions[i - FlagParameterID::kFIRST_FLAG_PARAMETER];
 
         bool enabled = false;
         if (res->getType() == mageec::DecisionType::kNative) {
@@ -1672,17 +1655,14 @@ int main(int argc, const char *argv[]) {
         if (enabled)
           params.insert(i);
       }
-      // Add the set of parameters to the database
-      auto param_set_id = db->newParameterSet(param_set);
-
       src_file_parameters[src_file_path] = params;
-      src_file_parameter_set_ids[src_file_path] = param_set_id;
+      src_file_parameter_sets[src_file_path] = param_set;
     }
   }
 
-  // Mapping from an input filename, to a command string to compile that file
-  // With the appropriate set of parameters.
-  std::map<std::string, std::string> src_file_commands;
+  // Mapping from an input filename, to a command to compile that file with
+  // the appropriate set of parameters.
+  std::map<std::string, std::vector<std::string>> src_file_commands;
 
   for (auto file_arg : src_files) {
     auto src_file_path = mageec::util::getFullPath(file_arg);
@@ -1690,17 +1670,11 @@ int main(int argc, const char *argv[]) {
     // If this file doesn't have any features, then it cannot be affected by
     // mageec. Just use the original command with the input filename appended
     if (src_file_feature_set_ids.count(src_file_path) == 0) {
-      std::stringstream command;
-      for (unsigned i = 0; i < cmd_args.size(); ++i) {
-        if (i == 0)
-          command << cmd_args[i];
-        else
-          command << " " << cmd_args[i];
-      }
+      std::vector<std::string> command = cmd_args;
       // Add in the input file
-      command << " " << file_arg;
+      command.push_back(file_arg);
 
-      src_file_commands[src_file_path] = command.str();
+      src_file_commands[src_file_path] = command;
       continue;
     }
 
@@ -1758,30 +1732,31 @@ int main(int argc, const char *argv[]) {
     // Add the input filename
     file_cmd.push_back(file_arg);
 
-    // Build a command appropriate to compile each of the files
-    std::stringstream command;
-    for (unsigned i = 0; i < file_cmd.size(); ++i) {
-      if (i == 0)
-        command << file_cmd[i];
-      else
-        command << " " << file_cmd[i];
-    }
-    src_file_commands[src_file_path] = command.str();
+    src_file_commands[src_file_path] = file_cmd;
   }
 
-  // Compile each of the files in turn, if any fail, error out early
+  // Compile each of the files, if any fail, error out early. Files may be
+  // compiled concurrently, within the job slots available from make.
+  std::vector<std::vector<std::string>> commands;
   for (auto file_arg : src_files) {
     auto src_file_path = mageec::util::getFullPath(file_arg);
-    auto command = src_file_commands[src_file_path];
-
-    // FIXME: Windows?
-    MAGEEC_DEBUG("Executing command: " << command);
-    int res = system(command.c_str());
-    if (res) {
-      MAGEEC_ERR("Compilation failed\ncommand: " << command);
-      return res;
+    commands.push_back(src_file_commands[src_file_path]);
+  }
+  std::unique_ptr<JobServer> job_server;
+  if (compile_jobs > 1 && commands.size() > 1) {
+    bool job_server_valid;
+    job_server = JobServer::fromEnvironment(job_server_valid);
+    if (!job_server_valid) {
+      compile_jobs = 1;
     }
   }
+  // FIXME: Windows?
+  auto failure = runCommands(commands, compile_jobs, job_server.get());
+  if (failure) {
+    MAGEEC_ERR("Compilation failed\ncommand: "
+               << joinCommand(commands[failure.get().index]));
+    return failure.get().exit_code;
+  }
 
   // If all of the file compiled successfully, generated compilation ids for
   // them and output these ids into the output file
@@ -1791,52 +1766,60 @@ int main(int argc, const char *argv[]) {
                "may not have sufficient permissions to read and write it");
     return -1;
   }
-  for (auto file_arg : src_files) {
-    std::string src_file_path = mageec::util::getFullPath(file_arg);
-    auto feature_set_ids = src_file_feature_set_ids.find(src_file_path);
-    auto param_set_id = src_file_parameter_set_ids.find(src_file_path);
 
-    // If there were no features for this file, then parameters would not have
-    // been derived and there will be no compilation id
-    if (feature_set_ids == src_file_feature_set_ids.end())
-      continue;
-    assert(param_set_id != src_file_parameter_set_ids.end());
-
-    // Generate a compilation id for the module
-    // Append the generated compilation ids to the output file
-    assert(feature_set_ids->second.module);
-    auto module_entry = feature_set_ids->second.module.get();
-    auto module_compilation = db->newCompilation(module_entry.name, "module",
-                                                 module_entry.id,
-                                                 mageec::FeatureClass::kModule,
-                                                 param_set_id->second,
-                                                 // FIXME: The compilation command
-                                                 // takes up a lot of space so
-                                                 // we don't store it for now
-                                                 nullptr, //src_file_commands[src_file_path],
-                                                 nullptr);
-
-    // TODO: Avoid static_cast here
-    uint64_t tmp = static_cast<uint64_t>(module_compilation);
-    out_file << src_file_path << ",module," << module_entry.name
-                               << ",compilation," << tmp << "\n";
-
-    // Generate a compilation id for each of the functions in the module.
-    for (auto function_entry : feature_set_ids->second.functions) {
-      auto function_compilation =
-          db->newCompilation(function_entry.name, "function",
-                             function_entry.id, mageec::FeatureClass::kFunction,
-                             param_set_id->second,
-                             // FIXME: The compilation command takes up a lot of
-                             // space so we don't store it for now.
-                             nullptr, //src_file_commands[src_file_path],
-                             module_compilation);
-
-      // TODO: Avoid static cast here
-      tmp = static_cast<uint64_t>(function_compilation);
-      out_file << src_file_path << ",function," << function_entry.name
-                                 << ",compilation," << tmp << "\n";
+  // Add the parameter sets and compilations of every file in a single
+  // transaction, rather than one per compilation, so that the lock on the
+  // database is only taken once however many functions there are. The
+  // output file is only written once the transaction has been committed, so
+  // that it never refers to compilations which are not in the database.
+  std::stringstream out_lines;
+  {
+    mageec::Database::BulkWriter writer(*db, 0);
+    for (auto file_arg : src_files) {
+      std::string src_file_path = mageec::util::getFullPath(file_arg);
+      auto feature_set_ids = src_file_feature_set_ids.find(src_file_path);
+      auto param_set = src_file_parameter_sets.find(src_file_path);
+
+      // If there were no features for this file, then parameters would not
+      // have been derived and there will be no compilation id
+      if (feature_set_ids == src_file_feature_set_ids.end())
+        continue;
+      assert(param_set != src_file_parameter_sets.end());
+      auto param_set_id = writer.addParameterSet(param_set->second);
+
+      // Generate a compilation id for the module
+      //
+      // FIXME: The compilation command takes up a lot of space so we don't
+      // store it for now
+      assert(feature_set_ids->second.module);
+      auto module_entry = feature_set_ids->second.module.get();
+      auto module_compilation =
+          writer.addCompilation({module_entry.name, "module", module_entry.id,
+                                 mageec::FeatureClass::kModule, param_set_id,
+                                 nullptr, nullptr});
+
+      // TODO: Avoid static_cast here
+      uint64_t tmp = static_cast<uint64_t>(module_compilation);
+      out_lines << src_file_path << ",module," << module_entry.name
+                                  << ",compilation," << tmp << "\n";
+
+      // Generate a compilation id for each of the functions in the module.
+      for (auto function_entry : feature_set_ids->second.functions) {
+        auto function_compilation = writer.addCompilation(
+            {function_entry.name, "function", function_entry.id,
+             mageec::FeatureClass::kFunction, param_set_id, nullptr,
+             module_compilation});
+
+        // TODO: Avoid static cast here
+        tmp = static_cast<uint64_t>(function_compilation);
+        out_lines << src_file_path << ",function," << function_entry.name
+                                    << ",compilation," << tmp << "\n";
+      }
     }
+    writer.commit();
   }
+
+  // Append the generated compilation ids to the output file
+  out_file << out_lines.str();
   return 0;
 }
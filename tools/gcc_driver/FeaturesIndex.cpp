@@ -0,0 +1,591 @@
+/*  MAGEEC GCC Features Index
+    Copyright (C) 2017 Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===--------------------- MAGEEC GCC Features Index ----------------------===//
+//
+// This implements the index of a features file. The index is laid out as
+// follows, with all integers in little endian order:
+//
+//   header:
+//     u8[4]  magic number
+//     u16    format version
+//     u16    reserved
+//     u64    size of the features file when the index was built
+//     u64    size of the features file up to the end of its last complete
+//            line
+//     u64    modification time of the features file in nanoseconds
+//     u64    crc64 of the start and end of the features file
+//     u32    number of files
+//     u32    number of entries
+//     u32    size of the string table
+//     u32    reserved
+//   for each file, sorted by source path:
+//     u32    offset of the source path in the string table
+//     u32    length of the source path
+//     u32    index of the first entry of the file
+//     u32    number of entries of the file
+//   for each entry, the module of a file first, then its functions by name:
+//     u64    feature set id
+//     u32    offset of the name in the string table
+//     u32    length of the name
+//     u8     kind of the entry, 0 for a module and 1 for a function
+//     u8     feature class
+//     u8[6]  reserved
+//   string table
+//
+//===----------------------------------------------------------------------===//
+
+#include "FeaturesIndex.h"
+
+#include "mageec/Types.h"
+#include "mageec/Util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Magic number at the start of every index
+static const uint8_t index_magic[4] = {'M', 'G', 'F', 'I'};
+
+/// Version of the format of the index
+static const unsigned index_format_version = 1;
+
+/// Size of the header, file records and entry records of the index
+static const size_t index_header_size = 56;
+static const size_t index_file_size = 16;
+static const size_t index_entry_size = 24;
+
+/// Number of bytes at each of the start and the end of the features file
+/// which are checksummed to detect that it has been replaced.
+static const size_t check_chunk_size = 4096;
+
+/// Kinds of entry in the index
+static const uint8_t kModuleEntry = 0;
+static const uint8_t kFunctionEntry = 1;
+
+/// Feature sets of each source file, keyed by source path
+typedef std::map<std::string, FileFeatureIDs> FeatureIDMap;
+
+/// \brief Read a little endian value of a given number of bytes
+static uint64_t readLE(const uint8_t *p, unsigned bytes) {
+  uint64_t value = 0;
+  for (unsigned i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(p[i]) << (i * 8);
+  }
+  return value;
+}
+
+/// \brief Split a string into substrings on an input character
+static std::vector<std::string> splitString(std::string str, char c) {
+  std::vector<std::string> res;
+
+  std::string buf;
+  for (auto I = str.begin(); I != str.end(); ++I) {
+    if (*I != c) {
+      buf.push_back(*I);
+    } else {
+      res.push_back(buf);
+      buf.clear();
+    }
+  }
+  res.push_back(buf);
+  return res;
+}
+
+/// \brief Add the feature IDs in some lines of a features file to a map
+///
+/// When there are several entries for a module, the last is used. When there
+/// are several entries for a function, the first is used.
+///
+/// \return False if a line was malformed
+static bool parseFeatureIDs(const std::string &text, FeatureIDMap &file_map) {
+  std::istringstream features_file(text);
+
+  std::string line;
+  while (std::getline(features_file, line)) {
+    std::vector<std::string> values = splitString(line, ',');
+    if (values.size() != 7)
+      continue;
+    if ((values[1] != "module") && (values[1] != "function"))
+      continue;
+    if (values[3] != "features")
+      continue;
+    if (values[5] != "feature_class")
+      continue;
+    if (!values[0].size() || !values[2].size() || !values[4].size() ||
+        !values[6].size()) {
+      continue;
+    }
+
+    std::stringstream feat_id_str(values[4]);
+    uint64_t feat_id;
+    feat_id_str >> feat_id;
+    if (feat_id_str.fail()) {
+      MAGEEC_ERR("Malformed line in features file");
+      return false;
+    }
+
+    std::stringstream feat_class_str(values[6]);
+    unsigned feat_class;
+    feat_class_str >> feat_class;
+    if (feat_class_str.fail()) {
+      MAGEEC_ERR("Malformed line in features file");
+      return false;
+    }
+
+    // Entry to be inserted into the map
+    FeatureIDEntry entry = { values[2],
+                             static_cast<mageec::FeatureSetID>(feat_id),
+                             static_cast<mageec::FeatureClass>(feat_class) };
+
+    FileFeatureIDs &file_entry = file_map[values[0]];
+    if (values[1] == "module") {
+      if (file_entry.module) {
+        FeatureIDEntry old_entry = file_entry.module.get();
+        if (old_entry.id != entry.id
+            || old_entry.feature_class != entry.feature_class) {
+          MAGEEC_WARN("Multiple entries for module: " << entry.name
+                      << " with different feature sets");
+        }
+      }
+      file_entry.module = entry;
+    } else {
+      assert(values[1] == "function");
+      if (file_entry.functions.count(entry)) {
+        FeatureIDEntry old_entry = *file_entry.functions.find(entry);
+        if (old_entry.id != entry.id
+            || old_entry.feature_class != entry.feature_class) {
+          MAGEEC_WARN("Multiple entries for function: " << entry.name
+                      << " with different feature sets");
+        }
+      }
+      file_entry.functions.insert(entry);
+    }
+  }
+  return true;
+}
+
+/// \brief Read a range of bytes of a file
+///
+/// \return False if the range could not be read in full
+static bool readRange(int fd, uint64_t offset, uint64_t len,
+                      std::string &buf) {
+  buf.resize(len);
+  uint64_t done = 0;
+  while (done < len) {
+    ssize_t res = pread(fd, &buf[done], len - done,
+                        static_cast<off_t>(offset + done));
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (res == 0) {
+      return false;
+    }
+    done += static_cast<uint64_t>(res);
+  }
+  return true;
+}
+
+/// \brief Compute the checksum used to detect that the start of a features
+/// file differs from when the index was built
+///
+/// \param len  Length of the start of the file which is checked
+static bool checksumFeatures(int fd, uint64_t len, uint64_t &crc) {
+  std::string head;
+  std::string tail;
+  uint64_t head_len = std::min<uint64_t>(len, check_chunk_size);
+  uint64_t tail_len = std::min<uint64_t>(len - head_len, check_chunk_size);
+  if (!readRange(fd, 0, head_len, head) ||
+      !readRange(fd, len - tail_len, tail_len, tail)) {
+    return false;
+  }
+  crc = mageec::util::crc64(reinterpret_cast<const uint8_t *>(head.data()),
+                            static_cast<unsigned>(head.size()));
+  crc = mageec::util::crc64Update(
+      crc, reinterpret_cast<const uint8_t *>(tail.data()),
+      static_cast<unsigned>(tail.size()));
+  return true;
+}
+
+/// \brief The fields of the header of an index
+struct IndexHeader {
+  uint64_t parsed_size;
+  uint64_t complete_size;
+  uint64_t mtime;
+  uint64_t crc;
+  uint32_t num_files;
+  uint32_t num_entries;
+  uint32_t strings_size;
+};
+
+/// \brief Read and validate the header of an index
+///
+/// \return False if the data is not an index which can be read
+static bool readHeader(const uint8_t *data, size_t size, IndexHeader &header) {
+  if (size < index_header_size ||
+      !std::equal(std::begin(index_magic), std::end(index_magic), data) ||
+      readLE(data + 4, 2) != index_format_version) {
+    return false;
+  }
+  header.parsed_size = readLE(data + 8, 8);
+  header.complete_size = readLE(data + 16, 8);
+  header.mtime = readLE(data + 24, 8);
+  header.crc = readLE(data + 32, 8);
+  header.num_files = static_cast<uint32_t>(readLE(data + 40, 4));
+  header.num_entries = static_cast<uint32_t>(readLE(data + 44, 4));
+  header.strings_size = static_cast<uint32_t>(readLE(data + 48, 4));
+
+  uint64_t expected_size =
+      index_header_size +
+      static_cast<uint64_t>(header.num_files) * index_file_size +
+      static_cast<uint64_t>(header.num_entries) * index_entry_size +
+      header.strings_size;
+  return expected_size == size && header.complete_size <= header.parsed_size;
+}
+
+/// \brief Serialize the feature IDs of a features file into an index
+static std::vector<uint8_t> writeIndex(const FeatureIDMap &file_map,
+                                       const IndexHeader &header) {
+  std::vector<uint8_t> files;
+  std::vector<uint8_t> entries;
+  std::string strings;
+  uint32_t num_entries = 0;
+
+  auto addEntry = [&](const FeatureIDEntry &entry, uint8_t kind) {
+    mageec::util::write64LE(entries, static_cast<uint64_t>(entry.id));
+    mageec::util::write32LE(entries, static_cast<uint32_t>(strings.size()));
+    mageec::util::write32LE(entries, static_cast<uint32_t>(entry.name.size()));
+    entries.push_back(kind);
+    entries.push_back(static_cast<uint8_t>(entry.feature_class));
+    entries.insert(entries.end(), 6, 0);
+    strings += entry.name;
+    ++num_entries;
+  };
+
+  // The map is ordered by source path, so the file records are written in
+  // the order needed to search them.
+  for (const auto &file : file_map) {
+    uint32_t first_entry = num_entries;
+    mageec::util::write32LE(files, static_cast<uint32_t>(strings.size()));
+    mageec::util::write32LE(files, static_cast<uint32_t>(file.first.size()));
+    strings += file.first;
+
+    if (file.second.module) {
+      addEntry(file.second.module.get(), kModuleEntry);
+    }
+    for (const auto &function : file.second.functions) {
+      addEntry(function, kFunctionEntry);
+    }
+    mageec::util::write32LE(files, first_entry);
+    mageec::util::write32LE(files, num_entries - first_entry);
+  }
+
+  std::vector<uint8_t> buf;
+  buf.insert(buf.end(), std::begin(index_magic), std::end(index_magic));
+  mageec::util::write16LE(buf, index_format_version);
+  mageec::util::write16LE(buf, 0);
+  mageec::util::write64LE(buf, header.parsed_size);
+  mageec::util::write64LE(buf, header.complete_size);
+  mageec::util::write64LE(buf, header.mtime);
+  mageec::util::write64LE(buf, header.crc);
+  mageec::util::write32LE(buf, static_cast<uint32_t>(file_map.size()));
+  mageec::util::write32LE(buf, num_entries);
+  mageec::util::write32LE(buf, static_cast<uint32_t>(strings.size()));
+  mageec::util::write32LE(buf, 0);
+  assert(buf.size() == index_header_size);
+
+  buf.insert(buf.end(), files.begin(), files.end());
+  buf.insert(buf.end(), entries.begin(), entries.end());
+  buf.insert(buf.end(), strings.begin(), strings.end());
+  return buf;
+}
+
+/// \brief Get a string from the string table of an index
+///
+/// \return False if the string lies outside of the string table
+static bool getString(const uint8_t *data, const IndexHeader &header,
+                      uint64_t offset, uint64_t len, std::string &str) {
+  if (offset + len > header.strings_size) {
+    return false;
+  }
+  const uint8_t *strings = data + index_header_size +
+                           header.num_files * index_file_size +
+                           header.num_entries * index_entry_size;
+  str.assign(reinterpret_cast<const char *>(strings + offset), len);
+  return true;
+}
+
+/// \brief Read the feature IDs of the file at an index in the file table
+///
+/// \return False if the records of the file are malformed
+static bool readFileFeatureIDs(const uint8_t *data, const IndexHeader &header,
+                               uint32_t file, FileFeatureIDs &file_ids) {
+  const uint8_t *record = data + index_header_size + file * index_file_size;
+  uint64_t first_entry = readLE(record + 8, 4);
+  uint64_t num_entries = readLE(record + 12, 4);
+  if (first_entry + num_entries > header.num_entries) {
+    return false;
+  }
+
+  const uint8_t *entries = data + index_header_size +
+                           header.num_files * index_file_size;
+  for (uint64_t i = first_entry; i < first_entry + num_entries; ++i) {
+    const uint8_t *entry_record = entries + i * index_entry_size;
+    FeatureIDEntry entry;
+    entry.id = static_cast<mageec::FeatureSetID>(readLE(entry_record, 8));
+    if (!getString(data, header, readLE(entry_record + 8, 4),
+                   readLE(entry_record + 12, 4), entry.name)) {
+      return false;
+    }
+    entry.feature_class = static_cast<mageec::FeatureClass>(entry_record[17]);
+
+    if (entry_record[16] == kModuleEntry) {
+      file_ids.module = entry;
+    } else {
+      file_ids.functions.insert(entry);
+    }
+  }
+  return true;
+}
+
+/// \brief Read every file in an index back into a map
+///
+/// \return False if the index is malformed
+static bool readIndex(const uint8_t *data, const IndexHeader &header,
+                      FeatureIDMap &file_map) {
+  for (uint32_t i = 0; i < header.num_files; ++i) {
+    const uint8_t *record = data + index_header_size + i * index_file_size;
+    std::string src_path;
+    if (!getString(data, header, readLE(record, 4), readLE(record + 4, 4),
+                   src_path) ||
+        !readFileFeatureIDs(data, header, i, file_map[src_path])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \brief Write an index, replacing any existing index atomically
+///
+/// \return False if the index could not be written
+static bool writeIndexFile(const std::string &index_path,
+                           const std::vector<uint8_t> &buf) {
+  // Several compilations may update the index at once, so each writes its
+  // own temporary file and renames it into place.
+  std::string tmp_path = index_path + ".tmp." + std::to_string(getpid());
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  size_t written = 0;
+  while (written < buf.size()) {
+    ssize_t res = write(fd, buf.data() + written, buf.size() - written);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      close(fd);
+      unlink(tmp_path.c_str());
+      return false;
+    }
+    written += static_cast<size_t>(res);
+  }
+  if (close(fd) != 0 || rename(tmp_path.c_str(), index_path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+FeaturesIndex::FeaturesIndex()
+    : m_data(nullptr), m_size(0), m_is_mapped(false), m_buffer() {}
+
+FeaturesIndex::~FeaturesIndex() {
+  if (m_is_mapped) {
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+  }
+}
+
+std::unique_ptr<FeaturesIndex>
+FeaturesIndex::open(const std::string &features_path) {
+  int features_fd = ::open(features_path.c_str(), O_RDONLY);
+  struct stat features_st;
+  if (features_fd < 0 || fstat(features_fd, &features_st) != 0) {
+    MAGEEC_ERR("Error opening features file. The file may not exist, or you "
+               "may not have sufficient permissions to read and write it");
+    if (features_fd >= 0) {
+      close(features_fd);
+    }
+    return nullptr;
+  }
+  uint64_t features_size = static_cast<uint64_t>(features_st.st_size);
+  uint64_t features_mtime =
+      static_cast<uint64_t>(features_st.st_mtim.tv_sec) * 1000000000 +
+      static_cast<uint64_t>(features_st.st_mtim.tv_nsec);
+
+  std::unique_ptr<FeaturesIndex> index(new FeaturesIndex());
+  std::string index_path = features_path + ".idx";
+
+  // Map the existing index, if there is one
+  IndexHeader header;
+  bool have_header = false;
+  int index_fd = ::open(index_path.c_str(), O_RDONLY);
+  if (index_fd >= 0) {
+    struct stat index_st;
+    if (fstat(index_fd, &index_st) == 0 && index_st.st_size > 0) {
+      void *addr = mmap(nullptr, static_cast<size_t>(index_st.st_size),
+                        PROT_READ, MAP_SHARED, index_fd, 0);
+      if (addr != MAP_FAILED) {
+        index->m_data = static_cast<const uint8_t *>(addr);
+        index->m_size = static_cast<size_t>(index_st.st_size);
+        index->m_is_mapped = true;
+        have_header = readHeader(index->m_data, index->m_size, header);
+      }
+    }
+    close(index_fd);
+  }
+
+  // Check that the part of the features file which was indexed is unchanged.
+  // Only the start and end of it are checked, as checking the whole file
+  // would cost as much as parsing it.
+  if (have_header) {
+    uint64_t crc;
+    have_header = header.parsed_size <= features_size &&
+                  checksumFeatures(features_fd, header.complete_size, crc) &&
+                  crc == header.crc;
+  }
+  if (have_header && header.parsed_size == features_size &&
+      header.mtime == features_mtime) {
+    close(features_fd);
+    MAGEEC_DEBUG("Using features index '" << index_path << "'");
+    return index;
+  }
+
+  // The index is missing or out of date. If the features file has only been
+  // appended to since it was indexed, then only the new lines need to be
+  // parsed. An index which included an incomplete final line cannot be
+  // updated, as that line may since have changed.
+  FeatureIDMap file_map;
+  uint64_t parse_from = 0;
+  if (have_header && header.parsed_size < features_size &&
+      header.complete_size == header.parsed_size &&
+      readIndex(index->m_data, header, file_map)) {
+    parse_from = header.complete_size;
+    MAGEEC_DEBUG("Updating features index '" << index_path << "'");
+  } else {
+    file_map.clear();
+    MAGEEC_DEBUG("Building features index '" << index_path << "'");
+  }
+  if (index->m_is_mapped) {
+    munmap(const_cast<uint8_t *>(index->m_data), index->m_size);
+    index->m_data = nullptr;
+    index->m_size = 0;
+    index->m_is_mapped = false;
+  }
+
+  std::string text;
+  if (!readRange(features_fd, parse_from, features_size - parse_from, text)) {
+    MAGEEC_ERR("Error reading features file '" << features_path << "'");
+    close(features_fd);
+    return nullptr;
+  }
+  if (!parseFeatureIDs(text, file_map)) {
+    close(features_fd);
+    return nullptr;
+  }
+
+  IndexHeader new_header;
+  new_header.parsed_size = features_size;
+  new_header.mtime = features_mtime;
+  new_header.complete_size = parse_from;
+  size_t last_newline = text.rfind('\n');
+  if (last_newline != std::string::npos) {
+    new_header.complete_size += last_newline + 1;
+  }
+  if (!checksumFeatures(features_fd, new_header.complete_size,
+                        new_header.crc)) {
+    MAGEEC_ERR("Error reading features file '" << features_path << "'");
+    close(features_fd);
+    return nullptr;
+  }
+  close(features_fd);
+
+  index->m_buffer = writeIndex(file_map, new_header);
+  index->m_data = index->m_buffer.data();
+  index->m_size = index->m_buffer.size();
+  if (!writeIndexFile(index_path, index->m_buffer)) {
+    MAGEEC_DEBUG("Could not write features index '" << index_path << "': "
+                 << strerror(errno));
+  }
+  return index;
+}
+
+mageec::util::Option<FileFeatureIDs>
+FeaturesIndex::lookup(const std::string &src_path) const {
+  IndexHeader header;
+  bool valid = readHeader(m_data, m_size, header);
+  assert(valid && "Features index was not validated when opened");
+  (void)valid;
+
+  // Binary search the file table for the source path
+  uint32_t lo = 0;
+  uint32_t hi = header.num_files;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    const uint8_t *record = m_data + index_header_size + mid * index_file_size;
+    std::string path;
+    if (!getString(m_data, header, readLE(record, 4), readLE(record + 4, 4),
+                   path)) {
+      MAGEEC_WARN("Features index is malformed");
+      return nullptr;
+    }
+
+    int res = path.compare(src_path);
+    if (res < 0) {
+      lo = mid + 1;
+    } else if (res > 0) {
+      hi = mid;
+    } else {
+      FileFeatureIDs file_ids;
+      if (!readFileFeatureIDs(m_data, header, mid, file_ids)) {
+        MAGEEC_WARN("Features index is malformed");
+        return nullptr;
+      }
+      return file_ids;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,113 @@
+/*  MAGEEC GCC Features Index
+    Copyright (C) 2017 Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===--------------------- MAGEEC GCC Features Index ----------------------===//
+//
+// This provides lookup of the feature set identifiers recorded for a source
+// file in a features file.
+//
+// The features file is a CSV file shared by every compilation in a
+// project, so rather than parsing the whole file for every compilation, a
+// binary index of it is kept alongside it. The index is sorted by source
+// path, and is memory mapped so that a lookup only touches the entries for
+// the source files being compiled. When the features file grows, only the
+// lines added since the index was built are parsed to update it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_GCC_FEATURES_INDEX_H
+#define MAGEEC_GCC_FEATURES_INDEX_H
+
+#include "mageec/Types.h"
+#include "mageec/Util.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+/// \struct FeatureIDEntry
+///
+/// \brief The feature set recorded for a single program unit
+struct FeatureIDEntry {
+  std::string            name;
+  mageec::FeatureSetID   id;
+  mageec::FeatureClass   feature_class;
+
+  bool operator<(const FeatureIDEntry &other) const {
+    if (name < other.name)
+      return true;
+    return false;
+  }
+};
+
+/// \struct FileFeatureIDs
+///
+/// \brief The feature sets recorded for the module and functions of a
+/// single source file
+struct FileFeatureIDs {
+  mageec::util::Option<FeatureIDEntry> module;
+  std::set<FeatureIDEntry>             functions;
+};
+
+/// \class FeaturesIndex
+///
+/// \brief Index of the feature sets in a features file, by source path
+class FeaturesIndex {
+public:
+  FeaturesIndex(const FeaturesIndex &other) = delete;
+  FeaturesIndex &operator=(const FeaturesIndex &other) = delete;
+  ~FeaturesIndex();
+
+  /// \brief Open the index for a features file
+  ///
+  /// The index is stored at the path of the features file with ".idx"
+  /// appended. If it is missing or out of date then it is brought up to
+  /// date from the features file first. If the index cannot be written, it
+  /// is only held in memory for this process.
+  ///
+  /// \param features_path  Path of the features file
+  ///
+  /// \return The index, or nullptr if the features file could not be read
+  static std::unique_ptr<FeaturesIndex> open(const std::string &features_path);
+
+  /// \brief Get the feature sets recorded for a source file
+  ///
+  /// \param src_path  Full path of the source file
+  ///
+  /// \return The feature sets of the file, or nothing if there are none
+  mageec::util::Option<FileFeatureIDs> lookup(const std::string &src_path) const;
+
+private:
+  FeaturesIndex();
+
+  /// Contents of the index. This is either mapped from the index file, or
+  /// points into m_buffer.
+  const uint8_t *m_data;
+  size_t m_size;
+
+  /// Whether m_data is mapped from the index file
+  bool m_is_mapped;
+
+  /// Index built in memory, if it was not mapped from the index file
+  std::vector<uint8_t> m_buffer;
+};
+
+#endif // MAGEEC_GCC_FEATURES_INDEX_H
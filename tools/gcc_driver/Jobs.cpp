@@ -0,0 +1,308 @@
+/*  MAGEEC GCC Jobs
+    Copyright (C) 2017 Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===-------------------------- MAGEEC GCC Jobs ---------------------------===//
+//
+// This implements concurrent execution of commands, and the client side of
+// the GNU make jobserver protocol. make passes the jobserver to its
+// children in MAKEFLAGS, as either --jobserver-auth=R,W (or
+// --jobserver-fds=R,W in older versions of make), naming the two ends of
+// a pipe, or --jobserver-auth=fifo:PATH, naming a fifo.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Jobs.h"
+#include "Process.h"
+
+#include "mageec/Util.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/// How long to wait for a token before checking for completed commands,
+/// in milliseconds
+static const int token_poll_interval = 20;
+
+JobServer::JobServer(int read_fd, int write_fd, bool owns_write_fd)
+    : m_read_fd(read_fd), m_write_fd(write_fd),
+      m_owns_write_fd(owns_write_fd), m_tokens() {}
+
+JobServer::~JobServer() {
+  while (!m_tokens.empty()) {
+    release();
+  }
+  close(m_read_fd);
+  if (m_owns_write_fd) {
+    close(m_write_fd);
+  }
+}
+
+std::unique_ptr<JobServer> JobServer::fromEnvironment(bool &valid) {
+  valid = true;
+  const char *makeflags = getenv("MAKEFLAGS");
+  if (!makeflags) {
+    return nullptr;
+  }
+
+  // Find the last jobserver argument, as later arguments take precedence
+  std::string auth;
+  std::istringstream words(makeflags);
+  std::string word;
+  while (words >> word) {
+    for (const char *prefix : {"--jobserver-auth=", "--jobserver-fds="}) {
+      if (word.compare(0, strlen(prefix), prefix) == 0) {
+        auth = word.substr(strlen(prefix));
+      }
+    }
+  }
+  if (auth.empty()) {
+    return nullptr;
+  }
+
+  // Tokens must be read without blocking, so that commands which complete
+  // can be handled while waiting for a token. Setting O_NONBLOCK on the
+  // inherited descriptors would also change them for every other process
+  // using the jobserver, so the jobserver is opened afresh instead.
+  int read_fd = -1;
+  int write_fd = -1;
+  bool owns_write_fd = false;
+  if (auth.compare(0, strlen("fifo:"), "fifo:") == 0) {
+    std::string fifo_path = auth.substr(strlen("fifo:"));
+    read_fd = open(fifo_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    write_fd = open(fifo_path.c_str(), O_WRONLY | O_CLOEXEC);
+    owns_write_fd = true;
+  } else {
+    int inherited_read_fd;
+    int inherited_write_fd;
+    char sep;
+    std::istringstream fds(auth);
+    if ((fds >> inherited_read_fd >> sep >> inherited_write_fd) &&
+        sep == ',' && fcntl(inherited_read_fd, F_GETFD) != -1 &&
+        fcntl(inherited_write_fd, F_GETFD) != -1) {
+      std::string fd_path =
+          "/proc/self/fd/" + std::to_string(inherited_read_fd);
+      read_fd = open(fd_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+      write_fd = inherited_write_fd;
+    }
+  }
+
+  if (read_fd < 0 || write_fd < 0) {
+    // make has a jobserver, but did not pass it on to this command, or it
+    // cannot be opened. Only the implicit job slot may be used.
+    MAGEEC_DEBUG("Jobserver '" << auth << "' could not be used");
+    if (read_fd >= 0) {
+      close(read_fd);
+    }
+    if (owns_write_fd && write_fd >= 0) {
+      close(write_fd);
+    }
+    valid = false;
+    return nullptr;
+  }
+  MAGEEC_DEBUG("Using jobserver '" << auth << "'");
+  return std::unique_ptr<JobServer>(
+      new JobServer(read_fd, write_fd, owns_write_fd));
+}
+
+bool JobServer::tryAcquire() {
+  char token;
+  ssize_t res;
+  do {
+    res = read(m_read_fd, &token, 1);
+  } while (res < 0 && errno == EINTR);
+  if (res != 1) {
+    return false;
+  }
+  m_tokens.push_back(token);
+  return true;
+}
+
+void JobServer::release() {
+  assert(!m_tokens.empty() && "No jobserver token to release");
+  char token = m_tokens.back();
+  ssize_t res;
+  do {
+    res = write(m_write_fd, &token, 1);
+  } while (res < 0 && errno == EINTR);
+  if (res != 1) {
+    MAGEEC_WARN("Could not return token to jobserver: " << strerror(errno));
+  }
+  m_tokens.pop_back();
+}
+
+/// \brief State of a command run by runCommands
+struct CommandState {
+  /// Whether the command has been started
+  bool started;
+  /// Exit code of the command, once it has completed
+  int exit_code;
+  /// Files capturing the standard output and error of the command, or
+  /// nullptr if the output is not captured
+  FILE *out;
+  FILE *err;
+};
+
+/// \brief Copy the contents of a file capturing output to a stream
+static void replayOutput(FILE *from, FILE *to) {
+  char buf[4096];
+  rewind(from);
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), from)) > 0) {
+    fwrite(buf, 1, len, to);
+  }
+  fflush(to);
+}
+
+/// \brief Create a file to capture the output of a command
+///
+/// The file is closed on exec, so that it is only inherited by the command
+/// whose output it captures.
+static FILE *createCaptureFile() {
+  FILE *file = tmpfile();
+  if (file) {
+    fcntl(fileno(file), F_SETFD, FD_CLOEXEC);
+  }
+  return file;
+}
+
+mageec::util::Option<CommandFailure>
+runCommands(const std::vector<std::vector<std::string>> &commands,
+            unsigned jobs, JobServer *job_server) {
+  assert(jobs > 0);
+  bool capture = jobs > 1 && commands.size() > 1;
+
+  std::vector<CommandState> states(commands.size(),
+                                   CommandState{false, 0, nullptr, nullptr});
+  std::map<pid_t, unsigned> running;
+  unsigned next = 0;
+  bool failed = false;
+
+  while (true) {
+    // Start as many commands as there are job slots for. The first running
+    // command uses the slot given to the driver itself, every other command
+    // needs a token from the jobserver.
+    while (!failed && next < commands.size() && running.size() < jobs) {
+      if (!running.empty() && job_server && !job_server->tryAcquire()) {
+        break;
+      }
+
+      CommandState &state = states[next];
+      if (capture) {
+        state.out = createCaptureFile();
+        state.err = createCaptureFile();
+        if (!state.out || !state.err) {
+          MAGEEC_ERR("Could not capture command output: " << strerror(errno));
+        }
+      }
+      MAGEEC_DEBUG("Executing command: " << joinCommand(commands[next]));
+      pid_t pid = -1;
+      if (!capture) {
+        pid = spawnProcess(commands[next]);
+      } else if (state.out && state.err) {
+        pid = spawnProcess(commands[next], fileno(state.out),
+                           fileno(state.err));
+      }
+      state.started = true;
+      if (pid < 0) {
+        state.exit_code = 127;
+        failed = true;
+        // Return the token taken for this command
+        if (job_server && !running.empty()) {
+          job_server->release();
+        }
+        break;
+      }
+      running[pid] = next;
+      ++next;
+    }
+    if (running.empty()) {
+      break;
+    }
+
+    // Wait for a command to complete. If another command could be started
+    // once a token is available, then also watch the jobserver.
+    bool want_token = job_server && !failed && next < commands.size() &&
+                      running.size() < jobs;
+    int status;
+    pid_t pid;
+    if (want_token) {
+      struct pollfd token_poll = {job_server->getFD(), POLLIN, 0};
+      poll(&token_poll, 1, token_poll_interval);
+      pid = waitpid(-1, &status, WNOHANG);
+    } else {
+      pid = waitpid(-1, &status, 0);
+    }
+    if (pid <= 0) {
+      continue;
+    }
+    auto command = running.find(pid);
+    if (command == running.end()) {
+      continue;
+    }
+    states[command->second].exit_code = getExitCode(status);
+    if (status != 0) {
+      failed = true;
+    }
+    running.erase(command);
+
+    // Keep one token less than the number of running commands, for the
+    // slot given to the driver itself
+    while (job_server && job_server->getNumTokens() > 0 &&
+           job_server->getNumTokens() >= running.size()) {
+      job_server->release();
+    }
+  }
+
+  // Write out the captured output in the order of the commands, stopping at
+  // the first which failed
+  mageec::util::Option<CommandFailure> failure;
+  for (unsigned i = 0; i < commands.size() && states[i].started; ++i) {
+    CommandState &state = states[i];
+    if (state.out && state.err) {
+      replayOutput(state.out, stdout);
+      replayOutput(state.err, stderr);
+    }
+    if (state.exit_code != 0) {
+      failure = CommandFailure{i, state.exit_code};
+      break;
+    }
+  }
+  for (auto &state : states) {
+    if (state.out) {
+      fclose(state.out);
+    }
+    if (state.err) {
+      fclose(state.err);
+    }
+  }
+  return failure;
+}
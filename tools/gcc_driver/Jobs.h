@@ -0,0 +1,127 @@
+/*  MAGEEC GCC Jobs
+    Copyright (C) 2017 Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===-------------------------- MAGEEC GCC Jobs ---------------------------===//
+//
+// This provides concurrent execution of the per-file compilation commands
+// of the driver.
+//
+// When the driver is run from a GNU make with a jobserver, a job slot is
+// taken from the jobserver for every command run beyond the first, so that
+// the parallelism of the driver and of make together stays within the
+// limit given to make.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_GCC_JOBS_H
+#define MAGEEC_GCC_JOBS_H
+
+#include "mageec/Util.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/// \class JobServer
+///
+/// \brief Client of a GNU make jobserver
+///
+/// The process is implicitly given one job slot by make. Each further slot
+/// is a token which is read from the jobserver, and must be written back
+/// once the job using it has completed.
+class JobServer {
+public:
+  JobServer(const JobServer &other) = delete;
+  JobServer &operator=(const JobServer &other) = delete;
+
+  /// \brief Return any tokens still held to the jobserver
+  ~JobServer();
+
+  /// \brief Connect to the jobserver described by the MAKEFLAGS environment
+  /// variable
+  ///
+  /// \param valid  Set to false if MAKEFLAGS names a jobserver which cannot
+  /// be used, in which case only the implicit job slot may be used.
+  ///
+  /// \return The jobserver, or nullptr if there is none which can be used
+  static std::unique_ptr<JobServer> fromEnvironment(bool &valid);
+
+  /// \brief Get a file descriptor which becomes readable when a token may
+  /// be available
+  int getFD() const { return m_read_fd; }
+
+  /// \brief Get the number of tokens currently held
+  unsigned getNumTokens() const {
+    return static_cast<unsigned>(m_tokens.size());
+  }
+
+  /// \brief Try to take a token from the jobserver, without blocking
+  ///
+  /// \return True if a token was taken
+  bool tryAcquire();
+
+  /// \brief Return a held token to the jobserver
+  void release();
+
+private:
+  JobServer(int read_fd, int write_fd, bool owns_write_fd);
+
+  /// Non-blocking descriptor from which tokens are read
+  int m_read_fd;
+  /// Descriptor to which tokens are written back
+  int m_write_fd;
+  /// Whether m_write_fd was opened by this process, rather than inherited
+  bool m_owns_write_fd;
+
+  /// Tokens currently held. Each must be returned with the same value with
+  /// which it was read.
+  std::vector<char> m_tokens;
+};
+
+/// \struct CommandFailure
+///
+/// \brief The first of a list of commands to fail
+struct CommandFailure {
+  /// Index of the command in the list
+  unsigned index;
+  /// Exit code of the command
+  int exit_code;
+};
+
+/// \brief Run a list of commands, several at once
+///
+/// Commands are started in order, and no further commands are started once
+/// one has failed. When more than one command may run at once, the output
+/// of each command is captured, and is written out in the order of the
+/// commands once they have all completed. Output is written up to and
+/// including that of the first command in the list to fail, so the output
+/// is the same as if the commands were run one at a time.
+///
+/// \param commands  Commands to run, each as a command word followed by its
+/// arguments
+/// \param jobs  Maximum number of commands to run at once. This is further
+/// limited by the jobserver, if there is one.
+/// \param job_server  Jobserver from which to take job slots, or nullptr
+///
+/// \return The first command in the list which failed, or nothing if every
+/// command succeeded
+mageec::util::Option<CommandFailure>
+runCommands(const std::vector<std::vector<std::string>> &commands,
+            unsigned jobs, JobServer *job_server);
+
+#endif // MAGEEC_GCC_JOBS_H
@@ -0,0 +1,117 @@
+/*  MAGEEC GCC Process
+    Copyright (C) 2017 Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===------------------------- MAGEEC GCC Process -------------------------===//
+//
+// This implements the launching of commands using posix_spawnp.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Process.h"
+
+#include "mageec/Util.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/// Exit code of a command which could not be started, matching the shell
+static const int spawn_failure_exit_code = 127;
+
+std::string joinCommand(const std::vector<std::string> &args) {
+  std::string command;
+  for (unsigned i = 0; i < args.size(); ++i) {
+    if (i != 0)
+      command += " ";
+    command += args[i];
+  }
+  return command;
+}
+
+pid_t spawnProcess(const std::vector<std::string> &args, int out_fd,
+                   int err_fd) {
+  assert(!args.empty() && "Command has no command word");
+
+  std::vector<char *> argv;
+  for (const auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (out_fd >= 0) {
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+  }
+  if (err_fd >= 0) {
+    posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+  }
+
+  // Anything already written by the driver should appear before the output
+  // of the command
+  std::cout.flush();
+  fflush(stdout);
+
+  pid_t pid;
+  int res = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(),
+                         environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (res != 0) {
+    MAGEEC_ERR("Could not execute '" << args[0] << "': " << strerror(res));
+    return -1;
+  }
+  return pid;
+}
+
+int getExitCode(int status) {
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return 1;
+}
+
+int runProcess(const std::vector<std::string> &args) {
+  pid_t pid = spawnProcess(args);
+  if (pid < 0) {
+    return spawn_failure_exit_code;
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      MAGEEC_ERR("Could not wait for '" << args[0] << "': "
+                 << strerror(errno));
+      return 1;
+    }
+  }
+  return getExitCode(status);
+}
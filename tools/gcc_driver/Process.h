@@ -0,0 +1,67 @@
+/*  MAGEEC GCC Process
+    Copyright (C) 2017 Embecosm Limited
+
+    This file is part of MAGEEC
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+//===------------------------- MAGEEC GCC Process -------------------------===//
+//
+// This provides the launching of the commands run by the driver.
+//
+// Commands are run directly from a vector of arguments, rather than through
+// the shell, so that arguments reach the command exactly as they were given
+// to the driver, and no shell process is started for each command.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MAGEEC_GCC_PROCESS_H
+#define MAGEEC_GCC_PROCESS_H
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/// \brief Join the arguments of a command into a single string, for display
+std::string joinCommand(const std::vector<std::string> &args);
+
+/// \brief Start a command
+///
+/// The command word is searched for in the PATH.
+///
+/// \param args  The command word followed by its arguments
+/// \param out_fd  Descriptor to which the standard output of the command is
+/// redirected, or -1 to share the standard output of the driver
+/// \param err_fd  Descriptor to which the standard error of the command is
+/// redirected, or -1 to share the standard error of the driver
+///
+/// \return The process id of the command, or -1 if it could not be started
+pid_t spawnProcess(const std::vector<std::string> &args, int out_fd = -1,
+                   int err_fd = -1);
+
+/// \brief Convert the wait status of a command to an exit code
+///
+/// A command which was killed by a signal has the exit code 128 plus the
+/// signal number, as it would have from the shell.
+int getExitCode(int status);
+
+/// \brief Run a command to completion
+///
+/// \param args  The command word followed by its arguments
+///
+/// \return The exit code of the command, or 127 if it could not be started
+int runProcess(const std::vector<std::string> &args);
+
+#endif // MAGEEC_GCC_PROCESS_H